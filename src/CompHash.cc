@@ -55,12 +55,177 @@ const HashkeyMapPtr ordered_hashkeys(const TableVal* tv) {
     return res;
 }
 
+static void write_addr(HashKey& hk, const IPAddr& a) {
+    hk.AlignWrite(sizeof(uint32_t));
+    hk.EnsureWriteSpace(sizeof(uint32_t) * 4);
+    a.CopyIPv6(static_cast<uint32_t*>(hk.KeyAtWrite()));
+    hk.SkipWrite("addr", sizeof(uint32_t) * 4);
+}
+
+static void write_subnet(HashKey& hk, const IPPrefix& p) {
+    hk.AlignWrite(sizeof(uint32_t));
+    hk.EnsureWriteSpace(sizeof(uint32_t) * 5);
+    p.Prefix().CopyIPv6(static_cast<uint32_t*>(hk.KeyAtWrite()));
+    hk.SkipWrite("subnet", sizeof(uint32_t) * 4);
+    hk.Write("subnet-width", p.Length());
+}
+
 CompositeHash::CompositeHash(TypeListPtr composite_type) : type(std::move(composite_type)) {
-    if ( type->GetTypes().size() == 1 )
+    const auto& tl = type->GetTypes();
+
+    if ( tl.size() == 1 )
         is_singleton = true;
+
+    // Single atomic values already get stored directly in the key.
+    is_fixed_width = ! is_singleton || tl[0]->Tag() == TYPE_RECORD;
+
+    HashKey hk;
+
+    for ( const auto& t : tl )
+        is_fixed_width = is_fixed_width && ReserveFixed(hk, t.get());
+}
+
+bool CompositeHash::ReserveFixed(HashKey& hk, const Type* t, int depth) {
+    switch ( t->InternalType() ) {
+        case TYPE_INTERNAL_INT: hk.ReserveType<zeek_int_t>("int"); return true;
+
+        case TYPE_INTERNAL_UNSIGNED: hk.ReserveType<zeek_int_t>("unsigned"); return true;
+
+        case TYPE_INTERNAL_ADDR: hk.Reserve("addr", sizeof(uint32_t) * 4, sizeof(uint32_t)); return true;
+
+        case TYPE_INTERNAL_SUBNET: hk.Reserve("subnet", sizeof(uint32_t) * 5, sizeof(uint32_t)); return true;
+
+        case TYPE_INTERNAL_DOUBLE: hk.ReserveType<double>("double"); return true;
+
+        default: break;
+    }
+
+    // Records nest only so deep in practice, and the limit keeps us clear
+    // of recursive types.
+    if ( t->Tag() != TYPE_RECORD || depth > 8 )
+        return false;
+
+    auto rt = t->AsRecordType();
+
+    for ( int i = 0; i < rt->NumFields(); ++i ) {
+        const auto& a = rt->FieldDecl(i)->attrs;
+
+        if ( (a && a->Find(ATTR_OPTIONAL)) || ! ReserveFixed(hk, rt->GetFieldType(i).get(), depth + 1) )
+            return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<HashKey> CompositeHash::MakeFixedHashKey(const Val& argv, bool type_check) const {
+    const auto& tl = type->GetTypes();
+    auto res = std::make_unique<HashKey>();
+
+    // Record types may have gained fields since we checked them, so
+    // recompute the size from the current types. That's cheap compared to
+    // walking the values.
+    for ( const auto& t : tl )
+        if ( ! ReserveFixed(*res, t.get()) )
+            return nullptr;
+
+    res->Allocate();
+
+    if ( is_singleton ) {
+        const Val* v = &argv;
+
+        if ( v->GetType()->Tag() == TYPE_LIST ) {
+            auto lv = v->AsListVal();
+
+            if ( lv->Length() != 1 )
+                return nullptr;
+
+            v = lv->Idx(0).get();
+        }
+
+        return FixedValHash(*res, v, tl[0].get(), type_check) ? std::move(res) : nullptr;
+    }
+
+    if ( argv.GetType()->Tag() != TYPE_LIST )
+        return nullptr;
+
+    auto lv = argv.AsListVal();
+
+    if ( static_cast<size_t>(lv->Length()) != tl.size() )
+        return nullptr;
+
+    for ( auto i = 0u; i < tl.size(); ++i )
+        if ( ! FixedValHash(*res, lv->Idx(i).get(), tl[i].get(), type_check) )
+            return nullptr;
+
+    return res;
+}
+
+bool CompositeHash::FixedValHash(HashKey& hk, const Val* v, Type* bt, bool type_check) const {
+    if ( ! v )
+        return false;
+
+    if ( type_check && v->GetType()->InternalType() != bt->InternalType() )
+        return false;
+
+    switch ( bt->InternalType() ) {
+        case TYPE_INTERNAL_INT: hk.Write("int", v->AsInt()); return true;
+
+        case TYPE_INTERNAL_UNSIGNED: hk.Write("unsigned", v->AsCount()); return true;
+
+        case TYPE_INTERNAL_ADDR: write_addr(hk, v->AsAddr()); return true;
+
+        case TYPE_INTERNAL_SUBNET: write_subnet(hk, v->AsSubNet()); return true;
+
+        case TYPE_INTERNAL_DOUBLE: hk.Write("double", v->InternalDouble()); return true;
+
+        default: break;
+    }
+
+    // A record. Values of other record types, for example ones that got
+    // coerced, take the general path.
+    if ( v->GetType().get() != bt )
+        return false;
+
+    // Reading the raw fields avoids creating Vals for them. Like
+    // GetField(), this instantiates fields with deferred initialization.
+    auto rv = const_cast<RecordVal*>(v->AsRecordVal());
+    auto rt = bt->AsRecordType();
+
+    if ( rv->NumFields() < static_cast<unsigned int>(rt->NumFields()) )
+        return false;
+
+    for ( int i = 0; i < rt->NumFields(); ++i ) {
+        const auto& f = rv->RawOptField(i);
+
+        if ( ! f )
+            return false;
+
+        switch ( rt->GetFieldType(i)->InternalType() ) {
+            case TYPE_INTERNAL_INT: hk.Write("int", f->AsInt()); break;
+
+            case TYPE_INTERNAL_UNSIGNED: hk.Write("unsigned", f->AsCount()); break;
+
+            case TYPE_INTERNAL_ADDR: write_addr(hk, f->AsAddr()->Get()); break;
+
+            case TYPE_INTERNAL_SUBNET: write_subnet(hk, f->AsSubNet()->Get()); break;
+
+            case TYPE_INTERNAL_DOUBLE: hk.Write("double", f->AsDouble()); break;
+
+            default:
+                if ( ! FixedValHash(hk, rv->GetField(i).get(), rt->GetFieldType(i).get(), false) )
+                    return false;
+        }
+    }
+
+    return true;
 }
 
 std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const Val& argv, bool type_check) const {
+    if ( is_fixed_width ) {
+        if ( auto res = MakeFixedHashKey(argv, type_check) )
+            return res;
+    }
+
     auto res = std::make_unique<HashKey>();
     const auto& tl = type->GetTypes();
 
@@ -436,21 +601,14 @@ bool CompositeHash::SingleValHash(HashKey& hk, const Val* v, Type* bt, bool type
             if ( ! EnsureTypeReserve(hk, v, bt, type_check) )
                 return false;
 
-            hk.AlignWrite(sizeof(uint32_t));
-            hk.EnsureWriteSpace(sizeof(uint32_t) * 4);
-            v->AsAddr().CopyIPv6(static_cast<uint32_t*>(hk.KeyAtWrite()));
-            hk.SkipWrite("addr", sizeof(uint32_t) * 4);
+            write_addr(hk, v->AsAddr());
             break;
 
         case TYPE_INTERNAL_SUBNET:
             if ( ! EnsureTypeReserve(hk, v, bt, type_check) )
                 return false;
 
-            hk.AlignWrite(sizeof(uint32_t));
-            hk.EnsureWriteSpace(sizeof(uint32_t) * 5);
-            v->AsSubNet().Prefix().CopyIPv6(static_cast<uint32_t*>(hk.KeyAtWrite()));
-            hk.SkipWrite("subnet", sizeof(uint32_t) * 4);
-            hk.Write("subnet-width", v->AsSubNet().Length());
+            write_subnet(hk, v->AsSubNet());
             break;
 
         case TYPE_INTERNAL_DOUBLE: hk.Write("double", v->InternalDouble()); break;
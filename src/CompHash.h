@@ -49,6 +49,19 @@ protected:
 
     bool EnsureTypeReserve(HashKey& hk, const Val* v, Type* bt, bool type_check) const;
 
+    // Fast path for index types made up of fixed-width values only, such
+    // as addresses, ports and records of those. The key size follows from
+    // the types alone, so keys get built in one pass over the values.
+    // Returns nil if the value needs the general treatment, for example
+    // because of unset record fields or type mismatches.
+    std::unique_ptr<HashKey> MakeFixedHashKey(const Val& v, bool type_check) const;
+    bool FixedValHash(HashKey& hk, const Val* v, Type* bt, bool type_check) const;
+
+    // Reserves key space for a value of the given type the way
+    // ReserveSingleTypeKeySize() would, if all values of the type take
+    // the same space. Returns false otherwise.
+    static bool ReserveFixed(HashKey& hk, const Type* t, int depth = 0);
+
     // The following are for allowing hashing of function values.
     // These can occur, for example, in sets of predicates that get
     // iterated over.  We use pointers in order to keep storage
@@ -62,6 +75,7 @@ protected:
 
     TypeListPtr type;
     bool is_singleton = false; // if just one type in index
+    bool is_fixed_width = false; // if MakeFixedHashKey() may apply
 };
 
 } // namespace zeek::detail
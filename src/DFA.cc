@@ -2,12 +2,160 @@
 
 #include "zeek/DFA.h"
 
+#include "zeek/zeek-config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/CCL.h"
 #include "zeek/Desc.h"
 #include "zeek/EquivClass.h"
 #include "zeek/Hash.h"
+#include "zeek/NetVar.h"
+#include "zeek/digest.h"
 
 namespace zeek::detail {
 
+namespace {
+
+// What a state counts for in the cache's memory accounting.
+uint64_t state_mem(DFA_State* s) { return util::pad_size(s->Size()) + padded_sizeof(*s); }
+
+// Serialized transitions that are jams or haven't been computed.
+constexpr int32_t SERIAL_JAM = -1;
+constexpr int32_t SERIAL_UNCOMPUTED = -2;
+
+template<typename T>
+void append(std::string* out, T v) {
+    out->append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+class SerialReader {
+public:
+    SerialReader(const char* arg_data, size_t arg_len) : data(arg_data), end(arg_data + arg_len) {}
+
+    template<typename T>
+    bool Read(T* v) {
+        if ( static_cast<size_t>(end - data) < sizeof(T) )
+            return false;
+
+        memcpy(v, data, sizeof(T));
+        data += sizeof(T);
+        return true;
+    }
+
+    bool Read(u_char* buf, size_t n) {
+        if ( static_cast<size_t>(end - data) < n )
+            return false;
+
+        memcpy(buf, data, n);
+        data += n;
+        return true;
+    }
+
+    bool AtEnd() const { return data == end; }
+    size_t Remaining() const { return end - data; }
+
+private:
+    const char* data;
+    const char* end;
+};
+
+// NFA state IDs come from a global counter and so depend on everything
+// compiled before. Serialized DFA states refer to NFA states by their
+// position in a depth-first walk of the NFA instead, which only depends on
+// the NFA itself. Also returns a digest of the NFA's structure and the
+// equivalence classes, which must match for serialized states to apply.
+std::vector<NFA_State*> canonical_nfa_order(NFA_State* first, const EquivClass* ec,
+                                            std::unordered_map<const NFA_State*, uint32_t>* index,
+                                            u_char digest[ZEEK_SHA256_DIGEST_LENGTH]) {
+    std::vector<NFA_State*> order;
+    std::vector<NFA_State*> stack;
+
+    if ( first ) {
+        stack.push_back(first);
+        index->emplace(first, 0);
+        order.push_back(first);
+    }
+
+    while ( ! stack.empty() ) {
+        NFA_State* n = stack.back();
+        stack.pop_back();
+
+        for ( auto x : *n->Transitions() ) {
+            if ( index->emplace(x, static_cast<uint32_t>(order.size())).second ) {
+                order.push_back(x);
+                stack.push_back(x);
+            }
+        }
+    }
+
+    std::string desc;
+    append(&desc, ec->NumClasses());
+    desc.append(reinterpret_cast<const char*>(ec->EquivClasses()), sizeof(int) * ec->NumSyms());
+
+    for ( auto n : order ) {
+        append(&desc, n->TransSym());
+        append(&desc, n->Accept());
+
+        if ( CCL* ccl = n->TransCCL() ) {
+            append(&desc, ccl->IsNegated());
+
+            for ( auto sym : *ccl->Syms() )
+                append(&desc, static_cast<int64_t>(sym));
+
+            append(&desc, int64_t(-1));
+        }
+
+        for ( auto x : *n->Transitions() )
+            append(&desc, index->at(x));
+
+        append(&desc, uint32_t(-1));
+    }
+
+    calculate_digest(Hash_SHA256, reinterpret_cast<const u_char*>(desc.data()), desc.size(), digest);
+    return order;
+}
+
+} // namespace
+
+int DFA_Accel::Scan(const u_char* p, int n) const {
+    int i = 0;
+
+#ifdef __SSE2__
+    if ( num_escapes <= MAX_VECTOR_ESCAPES ) {
+        __m128i needles[MAX_VECTOR_ESCAPES];
+
+        for ( int j = 0; j < num_escapes; ++j )
+            needles[j] = _mm_set1_epi8(static_cast<char>(escapes[j]));
+
+        for ( ; i + 16 <= n; i += 16 ) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            __m128i hits = _mm_setzero_si128();
+
+            for ( int j = 0; j < num_escapes; ++j )
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needles[j]));
+
+            if ( int mask = _mm_movemask_epi8(hits) )
+                return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    while ( i < n && ! is_escape[p[i]] )
+        ++i;
+
+    return i;
+}
+
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec, NFA_state_list* arg_nfa_states,
                      AcceptingSet* arg_accept) {
     state_num = arg_state_num;
@@ -91,6 +239,35 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine) {
     return xtions[sym];
 }
 
+void DFA_State::BuildAccel(DFA_Machine* machine) {
+    auto a = std::make_unique<DFA_Accel>();
+    const int* ecs = machine->EC()->EquivClasses();
+
+    // This computes any transitions still missing, so only states that
+    // have proven to loop a lot get here.
+    for ( int c = 0; c < 256; ++c ) {
+        if ( Xtion(ecs[c], machine) == this )
+            continue;
+
+        if ( a->num_escapes == DFA_Accel::MAX_ESCAPES ) {
+            accel_status = ACCEL_NONE;
+            return;
+        }
+
+        if ( a->num_escapes < DFA_Accel::MAX_VECTOR_ESCAPES )
+            a->escapes[a->num_escapes] = static_cast<u_char>(c);
+
+        a->is_escape[c] = true;
+        ++a->num_escapes;
+    }
+
+    auto* cache = machine->Cache();
+    cache->mem -= state_mem(this);
+    accel = std::move(a);
+    accel_status = ACCEL_READY;
+    cache->mem += state_mem(this);
+}
+
 void DFA_State::AppendIfNew(int sym, int_list* sym_list) {
     for ( auto value : *sym_list )
         if ( value == sym )
@@ -246,7 +423,7 @@ unsigned int DFA_State::Size() {
     return sizeof(*this) + util::pad_size(sizeof(DFA_State*) * num_sym) +
            (accept ? util::pad_size(sizeof(int) * accept->size()) : 0) +
            (nfa_states ? util::pad_size(sizeof(NFA_State*) * nfa_states->length()) : 0) +
-           (meta_ec ? meta_ec->Size() : 0);
+           (meta_ec ? meta_ec->Size() : 0) + (accel ? padded_sizeof(DFA_Accel) : 0);
 }
 
 DFA_State_Cache::DFA_State_Cache() { hits = misses = 0; }
@@ -301,9 +478,61 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 
 DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest) {
     states.emplace(std::move(digest), state);
+    mem += state_mem(state);
     return state;
 }
 
+void DFA_State_Cache::Evict(uint64_t max_mem, const DFA_State* start) {
+    if ( mem <= max_mem )
+        return;
+
+    // Evict down to three quarters of the limit, so that we don't end up
+    // here again right away.
+    uint64_t target = max_mem - max_mem / 4;
+
+    std::vector<DFA_State*> lru;
+    lru.reserve(states.size());
+
+    for ( const auto& entry : states )
+        if ( entry.second != start )
+            lru.push_back(entry.second);
+
+    std::sort(lru.begin(), lru.end(),
+              [](const DFA_State* a, const DFA_State* b) { return a->last_used < b->last_used; });
+
+    for ( auto s : lru ) {
+        if ( mem <= target )
+            break;
+
+        s->evicted = true;
+        mem -= state_mem(s);
+        ++evictions;
+    }
+
+    // Transitions into evicted states need computing again. The evicted
+    // states themselves may still be referenced from match states, which
+    // will find them marked and swap them for their cached equivalents.
+    for ( const auto& entry : states ) {
+        DFA_State* s = entry.second;
+
+        for ( int i = 0; i < s->num_sym; ++i ) {
+            DFA_State* x = s->xtions[i];
+
+            if ( s->evicted || (x && x != DFA_UNCOMPUTED_STATE_PTR && x->evicted) )
+                s->xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+        }
+    }
+
+    for ( auto it = states.begin(); it != states.end(); ) {
+        if ( it->second->evicted ) {
+            Unref(it->second);
+            it = states.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
 void DFA_State_Cache::GetStats(Stats* s) {
     s->dfa_states = 0;
     s->nfa_states = 0;
@@ -312,6 +541,7 @@ void DFA_State_Cache::GetStats(Stats* s) {
     s->mem = 0;
     s->hits = hits;
     s->misses = misses;
+    s->evictions = evictions;
 
     for ( const auto& state : states ) {
         DFA_State* e = state.second;
@@ -350,6 +580,187 @@ DFA_Machine::~DFA_Machine() {
     Unref(nfa);
 }
 
+void DFA_Machine::CheckMemory() {
+    ++clock;
+
+    if ( max_dfa_cache_size > 0 && dfa_state_cache->Mem() > max_dfa_cache_size )
+        dfa_state_cache->Evict(max_dfa_cache_size, start_state);
+}
+
+DFA_State* DFA_Machine::Resolve(const DFA_State* s) {
+    assert(s->Evicted());
+
+    auto state_set = new NFA_state_list(*s->nfa_states);
+    DFA_State* d;
+
+    if ( ! StateSetToDFA_State(state_set, d, ec) )
+        delete state_set;
+
+    d->last_used = clock;
+    return d;
+}
+
+void DFA_Machine::Serialize(std::string* out) const {
+    std::unordered_map<const NFA_State*, uint32_t> nfa_index;
+    u_char digest[ZEEK_SHA256_DIGEST_LENGTH];
+    canonical_nfa_order(nfa->FirstState(), ec, &nfa_index, digest);
+
+    // The start state goes first, so that Restore() can check it.
+    std::vector<DFA_State*> states;
+    std::unordered_map<const DFA_State*, int32_t> state_index;
+
+    if ( start_state ) {
+        state_index.emplace(start_state, 0);
+        states.push_back(start_state);
+    }
+
+    for ( const auto& entry : dfa_state_cache->states ) {
+        if ( state_index.emplace(entry.second, static_cast<int32_t>(states.size())).second )
+            states.push_back(entry.second);
+    }
+
+    int32_t num_sym = ec->NumClasses();
+
+    out->append(reinterpret_cast<const char*>(digest), sizeof(digest));
+    append(out, static_cast<uint32_t>(states.size()));
+    append(out, num_sym);
+
+    for ( auto s : states ) {
+        append(out, static_cast<uint32_t>(s->nfa_states->length()));
+
+        for ( auto n : *s->nfa_states )
+            append(out, nfa_index.at(n));
+
+        for ( int i = 0; i < num_sym; ++i ) {
+            DFA_State* x = s->xtions[i];
+            int32_t v = SERIAL_UNCOMPUTED;
+
+            if ( ! x )
+                v = SERIAL_JAM;
+
+            else if ( x != DFA_UNCOMPUTED_STATE_PTR ) {
+                if ( auto it = state_index.find(x); it != state_index.end() )
+                    v = it->second;
+            }
+
+            append(out, v);
+        }
+    }
+}
+
+bool DFA_Machine::Restore(const char* data, size_t len) {
+    std::unordered_map<const NFA_State*, uint32_t> nfa_index;
+    u_char digest[ZEEK_SHA256_DIGEST_LENGTH];
+    auto nfa_order = canonical_nfa_order(nfa->FirstState(), ec, &nfa_index, digest);
+
+    SerialReader r(data, len);
+    u_char stored_digest[ZEEK_SHA256_DIGEST_LENGTH];
+    uint32_t num_states;
+    int32_t num_sym;
+
+    if ( ! r.Read(stored_digest, sizeof(stored_digest)) || memcmp(digest, stored_digest, sizeof(digest)) != 0 ||
+         ! r.Read(&num_states) || ! r.Read(&num_sym) || num_sym <= 0 || num_sym != ec->NumClasses() )
+        return false;
+
+    // Each state takes at least its NFA count plus one transition per
+    // symbol, so a count the remaining data can't hold is corrupt. Check
+    // it before allocating anything sized by it.
+    size_t min_state_len = sizeof(uint32_t) + static_cast<size_t>(num_sym) * sizeof(int32_t);
+
+    if ( num_states > r.Remaining() / min_state_len )
+        return false;
+
+    // Parse and validate everything before touching the machine.
+    std::vector<std::vector<uint32_t>> state_nfas(num_states);
+    std::vector<int32_t> xtions;
+    xtions.reserve(static_cast<size_t>(num_states) * num_sym);
+
+    for ( auto& nfas : state_nfas ) {
+        uint32_t n;
+
+        if ( ! r.Read(&n) || n > nfa_order.size() )
+            return false;
+
+        nfas.resize(n);
+
+        for ( auto& idx : nfas )
+            if ( ! r.Read(&idx) || idx >= nfa_order.size() )
+                return false;
+
+        for ( int i = 0; i < num_sym; ++i ) {
+            int32_t v;
+
+            if ( ! r.Read(&v) || v < SERIAL_UNCOMPUTED || v >= static_cast<int32_t>(num_states) )
+                return false;
+
+            xtions.push_back(v);
+        }
+    }
+
+    if ( ! r.AtEnd() )
+        return false;
+
+    // The start state goes first. If it doesn't match ours, the states
+    // can't have come from this machine.
+    if ( start_state ) {
+        if ( num_states == 0 || state_nfas[0].size() != static_cast<size_t>(start_state->nfa_states->length()) )
+            return false;
+
+        std::vector<uint32_t> start_nfas;
+        start_nfas.reserve(state_nfas[0].size());
+
+        for ( auto n : *start_state->nfa_states ) {
+            auto it = nfa_index.find(n);
+
+            if ( it == nfa_index.end() )
+                return false;
+
+            start_nfas.push_back(it->second);
+        }
+
+        auto stored_nfas = state_nfas[0];
+        std::sort(start_nfas.begin(), start_nfas.end());
+        std::sort(stored_nfas.begin(), stored_nfas.end());
+
+        if ( start_nfas != stored_nfas )
+            return false;
+    }
+
+    std::vector<DFA_State*> states;
+    states.reserve(num_states);
+
+    for ( const auto& nfas : state_nfas ) {
+        auto state_set = new NFA_state_list;
+
+        for ( auto idx : nfas )
+            state_set->push_back(nfa_order[idx]);
+
+        std::sort(state_set->begin(), state_set->end(), NFA_state_cmp_neg);
+
+        DFA_State* d;
+
+        if ( ! StateSetToDFA_State(state_set, d, ec) )
+            delete state_set;
+
+        states.push_back(d);
+    }
+
+    for ( size_t i = 0; i < states.size(); ++i ) {
+        DFA_State* s = states[i];
+
+        for ( int sym = 0; sym < num_sym; ++sym ) {
+            int32_t v = xtions[i * num_sym + sym];
+
+            if ( v == SERIAL_UNCOMPUTED || s->xtions[sym] != DFA_UNCOMPUTED_STATE_PTR )
+                continue;
+
+            s->AddXtion(sym, v == SERIAL_JAM ? nullptr : states[v]);
+        }
+    }
+
+    return true;
+}
+
 void DFA_Machine::Describe(ODesc* d) const { d->Add("DFA machine"); }
 
 void DFA_Machine::Dump(FILE* f) {
@@ -392,4 +803,223 @@ int DFA_Machine::Rep(int sym) {
     return -1;
 }
 
+TEST_SUITE_BEGIN("DFA");
+
+TEST_CASE("DFA acceleration scan") {
+    u_char buf[100];
+    memset(buf, 'a', sizeof(buf));
+    buf[70] = 'y';
+
+    DFA_Accel a;
+    a.num_escapes = 2;
+    a.escapes[0] = 'x';
+    a.escapes[1] = 'y';
+    a.is_escape['x'] = a.is_escape['y'] = true;
+
+    CHECK(a.Scan(buf, sizeof(buf)) == 70);
+    CHECK(a.Scan(buf, 70) == 70);
+    CHECK(a.Scan(buf + 71, 29) == 29);
+
+    // Too many escapes for the vector path.
+    for ( int c = '0'; c <= '9'; ++c )
+        a.is_escape[c] = true;
+
+    a.num_escapes = 12;
+    buf[3] = '5';
+    CHECK(a.Scan(buf, sizeof(buf)) == 3);
+}
+
+namespace {
+
+// Builds an NFA for the given literals, where the i'th one accepts with
+// i + 1.
+NFA_Machine* make_literals_nfa(const std::vector<std::string>& literals, EquivClass* ec) {
+    NFA_Machine* nfa = nullptr;
+
+    for ( size_t i = 0; i < literals.size(); ++i ) {
+        const auto& l = literals[i];
+        auto m = new NFA_Machine(new NFA_State(static_cast<u_char>(l[0]), ec));
+
+        for ( size_t j = 1; j < l.size(); ++j )
+            m->AppendState(new NFA_State(static_cast<u_char>(l[j]), ec));
+
+        m->AddAccept(static_cast<int>(i + 1));
+        nfa = nfa ? make_alternate(nfa, m) : m;
+    }
+
+    return nfa;
+}
+
+DFA_State* walk(DFA_Machine* dfa, const EquivClass& ec, const std::string& s) {
+    DFA_State* d = dfa->StartState();
+
+    for ( auto c : s ) {
+        d = d->Xtion(ec.EquivClasses()[static_cast<u_char>(c)], dfa);
+
+        if ( ! d )
+            break;
+    }
+
+    return d;
+}
+
+} // namespace
+
+TEST_CASE("DFA loop acceleration") {
+    // [^x]*x. CCLs register with the matcher being compiled, so we need one
+    // of those, too.
+    Specific_RE_Matcher matcher(MATCH_ANYWHERE);
+    auto old_rem = rem;
+    rem = &matcher;
+
+    EquivClass* ec = matcher.EC();
+    CCL* ccl = new CCL();
+    ccl->Add('x');
+    ccl->Negate();
+    ec->CCL_Use(ccl);
+
+    auto nfa = new NFA_Machine(new NFA_State(ccl));
+    nfa->MakeClosure();
+    nfa->AppendMachine(new NFA_Machine(new NFA_State('x', ec)));
+    nfa->AddAccept(1);
+
+    ec->BuildECs();
+    matcher.ConvertCCLs();
+
+    auto dfa = new DFA_Machine(nfa, ec);
+    Unref(nfa);
+
+    std::string input(200, 'a');
+    input[150] = 'x';
+    auto p = reinterpret_cast<const u_char*>(input.data());
+
+    DFA_State* d = dfa->StartState();
+    REQUIRE(d->Xtion(ec->EquivClasses()['a'], dfa) == d);
+
+    // The state has to loop for a while before it gets accelerated.
+    int skipped = 0;
+    for ( int i = 0; i < 100 && ! skipped; ++i )
+        skipped = d->LoopLength(p, static_cast<int>(input.size()), dfa);
+
+    CHECK(skipped == 150);
+
+    auto* end = d->Xtion(ec->EquivClasses()['x'], dfa);
+    REQUIRE(end);
+    CHECK(end->Accept());
+
+    Unref(dfa);
+    rem = old_rem;
+}
+
+TEST_CASE("DFA cache eviction") {
+    std::vector<std::string> literals;
+    for ( char c = 'a'; c <= 'z'; ++c )
+        literals.push_back(std::string("q") + c + "rst");
+
+    EquivClass ec(NUM_SYM);
+    auto nfa = make_literals_nfa(literals, &ec);
+    ec.BuildECs();
+
+    auto dfa = new DFA_Machine(nfa, &ec);
+    Unref(nfa);
+
+    for ( const auto& l : literals )
+        REQUIRE(walk(dfa, ec, l)->Accept());
+
+    // Hold on to a state the way RE_Match_State does.
+    DFA_State* held = walk(dfa, ec, "qcrs");
+    Ref(held);
+
+    auto old_max = max_dfa_cache_size;
+    max_dfa_cache_size = dfa->Cache()->Mem() / 4;
+    auto before = dfa->NumStates();
+    dfa->CheckMemory();
+
+    CHECK(dfa->NumStates() < before);
+    CHECK(dfa->Cache()->Mem() <= max_dfa_cache_size);
+
+    DFA_State_Cache::Stats stats;
+    dfa->Cache()->GetStats(&stats);
+    CHECK(stats.evictions == static_cast<unsigned int>(before - dfa->NumStates()));
+
+    // Evicted states get recomputed as needed.
+    for ( size_t i = 0; i < literals.size(); ++i ) {
+        auto d = walk(dfa, ec, literals[i]);
+        REQUIRE(d);
+        REQUIRE(d->Accept());
+        CHECK(*d->Accept()->begin() == static_cast<int>(i + 1));
+    }
+
+    if ( held->Evicted() ) {
+        auto d = dfa->Resolve(held);
+        CHECK_FALSE(d->Evicted());
+        CHECK(d->Xtion(ec.EquivClasses()['t'], dfa)->Accept());
+    }
+
+    Unref(held);
+    max_dfa_cache_size = old_max;
+    Unref(dfa);
+}
+
+TEST_CASE("DFA serialization") {
+    std::vector<std::string> literals = {"foo", "bar", "baz"};
+
+    EquivClass ec1(NUM_SYM);
+    auto nfa1 = make_literals_nfa(literals, &ec1);
+    ec1.BuildECs();
+    auto dfa1 = new DFA_Machine(nfa1, &ec1);
+
+    for ( const auto& l : literals )
+        REQUIRE(walk(dfa1, ec1, l)->Accept());
+
+    std::string data;
+    dfa1->Serialize(&data);
+
+    // A second machine for the same literals has different NFA state IDs,
+    // but the states still map over.
+    EquivClass ec2(NUM_SYM);
+    auto nfa2 = make_literals_nfa(literals, &ec2);
+    ec2.BuildECs();
+    auto dfa2 = new DFA_Machine(nfa2, &ec2);
+
+    REQUIRE(dfa2->Restore(data.data(), data.size()));
+    CHECK(dfa2->NumStates() == dfa1->NumStates());
+
+    // Everything has been computed already.
+    for ( size_t i = 0; i < literals.size(); ++i ) {
+        auto d = walk(dfa2, ec2, literals[i]);
+        REQUIRE(d);
+        REQUIRE(d->Accept());
+        CHECK(*d->Accept()->begin() == static_cast<int>(i + 1));
+    }
+
+    CHECK(dfa2->NumStates() == dfa1->NumStates());
+
+    // Truncated data and data for other patterns are rejected.
+    CHECK_FALSE(dfa2->Restore(data.data(), data.size() - 1));
+
+    // So is a state count the data can't hold.
+    auto huge = data;
+    uint32_t bad_num_states = 0xffffffff;
+    memcpy(&huge[ZEEK_SHA256_DIGEST_LENGTH], &bad_num_states, sizeof(bad_num_states));
+    CHECK_FALSE(dfa2->Restore(huge.data(), huge.size()));
+
+    EquivClass ec3(NUM_SYM);
+    auto nfa3 = make_literals_nfa({"foo", "bar", "bat"}, &ec3);
+    ec3.BuildECs();
+    auto dfa3 = new DFA_Machine(nfa3, &ec3);
+    auto num_states = dfa3->NumStates();
+    CHECK_FALSE(dfa3->Restore(data.data(), data.size()));
+    CHECK(dfa3->NumStates() == num_states);
+
+    Unref(nfa1);
+    Unref(nfa2);
+    Unref(nfa3);
+    Unref(dfa1);
+    Unref(dfa2);
+    Unref(dfa3);
+}
+
+TEST_SUITE_END();
+
 } // namespace zeek::detail
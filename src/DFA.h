@@ -5,6 +5,7 @@
 #include <sys/types.h>
 #include <cassert>
 #include <map>
+#include <memory>
 #include <string>
 
 #include "zeek/NFA.h"
@@ -21,6 +22,25 @@ class DFA_Machine;
 #define DFA_UNCOMPUTED_STATE (-2)
 #define DFA_UNCOMPUTED_STATE_PTR ((DFA_State*)DFA_UNCOMPUTED_STATE)
 
+// The bytes on which a state transitions somewhere other than back to
+// itself. Lets matching skip over input that keeps the DFA in that state,
+// such as the leading ".*" of patterns that match anywhere, without
+// looking up each byte's transition.
+struct DFA_Accel {
+    // Up to this many escape bytes are scanned for with SIMD compares.
+    static constexpr int MAX_VECTOR_ESCAPES = 8;
+
+    // States with more escape bytes than this aren't worth accelerating.
+    static constexpr int MAX_ESCAPES = 64;
+
+    // Returns the number of leading bytes of p that aren't escapes.
+    int Scan(const u_char* p, int n) const;
+
+    int num_escapes = 0;
+    u_char escapes[MAX_VECTOR_ESCAPES] = {};
+    bool is_escape[256] = {};
+};
+
 class DFA_State : public Obj {
 public:
     DFA_State(int state_num, const EquivClass* ec, NFA_state_list* nfa_states, AcceptingSet* accept);
@@ -32,6 +52,17 @@ public:
 
     inline DFA_State* Xtion(int sym, DFA_Machine* machine);
 
+    // To be called when the state has transitioned to itself. Returns the
+    // number of leading bytes of p, which has n bytes, that would keep the
+    // DFA in this state. Only does the work of finding out once the state
+    // has looped often enough for that to pay off.
+    inline int LoopLength(const u_char* p, int n, DFA_Machine* machine);
+
+    // True once the state has been evicted from its machine's cache. The
+    // state must not be used for matching any longer, see
+    // DFA_Machine::Resolve().
+    bool Evicted() const { return evicted; }
+
     const AcceptingSet* Accept() const { return accept; }
     void SymPartition(const EquivClass* ec);
 
@@ -52,9 +83,14 @@ public:
 
 protected:
     friend class DFA_State_Cache;
+    friend class DFA_Machine; // for DFA_Machine::Resolve()
 
     DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
     void AppendIfNew(int sym, int_list* sym_list);
+    void BuildAccel(DFA_Machine* machine);
+
+    // Self-transitions seen before deciding whether to accelerate.
+    static constexpr unsigned int ACCEL_THRESHOLD = 64;
 
     int state_num;
     int num_sym;
@@ -65,6 +101,13 @@ protected:
     NFA_state_list* nfa_states;
     EquivClass* meta_ec; // which ec's make same transition
     DFA_State* mark;
+
+    uint64_t last_used = 0; // DFA_Machine clock of the latest transition here
+    bool evicted = false;
+
+    enum { ACCEL_UNKNOWN, ACCEL_NONE, ACCEL_READY } accel_status = ACCEL_UNKNOWN;
+    unsigned int self_loops = 0;
+    std::unique_ptr<DFA_Accel> accel;
 };
 
 using DigestStr = std::string;
@@ -78,6 +121,7 @@ struct DFA_State_Cache_Stats {
     unsigned int mem;
     unsigned int hits;
     unsigned int misses;
+    unsigned int evictions;
 };
 
 class DFA_State_Cache {
@@ -93,12 +137,28 @@ public:
 
     int NumEntries() const { return states.size(); }
 
+    // Number of bytes taken up by the cached states.
+    uint64_t Mem() const { return mem; }
+
+    // If the cached states take up more than max_mem bytes, drops least
+    // recently used states until they are well below that. Never drops
+    // the given start state. Callers must not hold on to pointers to
+    // states without a reference across this, and must check states they
+    // have referenced for Evicted() afterwards.
+    void Evict(uint64_t max_mem, const DFA_State* start);
+
     using Stats = DFA_State_Cache_Stats;
     void GetStats(Stats* s);
 
 private:
+    friend class DFA_State;   // for accounting of acceleration tables
+    friend class DFA_Machine; // for DFA_Machine::Serialize()
+
     int hits; // Statistics
     int misses;
+    unsigned int evictions = 0;
+
+    uint64_t mem = 0;
 
     // Hash indexed by NFA states (MD5s of them, actually).
     std::map<DigestStr, DFA_State*> states;
@@ -115,6 +175,25 @@ public:
 
     DFA_State_Cache* Cache() { return dfa_state_cache; }
 
+    // To be called before matching starts. Advances the clock used to
+    // find least recently used states and evicts states if the cache has
+    // outgrown max_dfa_cache_size.
+    void CheckMemory();
+
+    // Returns the cached state that's equivalent to the given evicted
+    // one, recomputing it if necessary.
+    DFA_State* Resolve(const DFA_State* s);
+
+    // Appends the states and transitions computed so far to *out, in a
+    // form that Restore() can apply to an identical machine built by a
+    // later process. The output uses host byte order.
+    void Serialize(std::string* out) const;
+
+    // Recreates states and transitions from the output of Serialize().
+    // Returns false, without changing anything, if the data doesn't come
+    // from a machine with the same NFA and equivalence classes.
+    bool Restore(const char* data, size_t len);
+
     int Rep(int sym);
 
     void Describe(ODesc* d) const override;
@@ -125,6 +204,7 @@ protected:
     friend class DFA_State_Cache;
 
     int state_count;
+    uint64_t clock = 0;
 
     // The state list has to be sorted according to IDs.
     bool StateSetToDFA_State(NFA_state_list* state_set, DFA_State*& d, const EquivClass* ec);
@@ -138,10 +218,29 @@ protected:
 };
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine) {
-    if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
-        return ComputeXtion(sym, machine);
-    else
-        return xtions[sym];
+    DFA_State* next = xtions[sym];
+
+    if ( next == DFA_UNCOMPUTED_STATE_PTR )
+        next = ComputeXtion(sym, machine);
+
+    if ( next )
+        next->last_used = machine->clock;
+
+    return next;
+}
+
+inline int DFA_State::LoopLength(const u_char* p, int n, DFA_Machine* machine) {
+    if ( accel_status == ACCEL_UNKNOWN ) {
+        if ( ++self_loops < ACCEL_THRESHOLD )
+            return 0;
+
+        BuildAccel(machine);
+    }
+
+    if ( accel_status != ACCEL_READY )
+        return 0;
+
+    return accel->Scan(p, n);
 }
 
 } // namespace zeek::detail
@@ -2,6 +2,9 @@
 
 #include "zeek/Dict.h"
 
+#include <chrono>
+#include <set>
+
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Hash.h"
 
@@ -433,6 +436,149 @@ TEST_CASE("dict iterator invalidation") {
     delete key3;
 }
 
+TEST_CASE("dict lookup after relocation") {
+    PDict<uint32_t> dict;
+
+    constexpr uint32_t num_keys = 5000;
+    std::vector<uint32_t> vals(num_keys);
+
+    for ( uint32_t i = 0; i < num_keys; i++ ) {
+        vals[i] = i;
+        detail::HashKey key(i);
+        dict.Insert(&key, &vals[i]);
+
+        // Remove every third key again so that clusters get relocated.
+        if ( i % 3 == 2 ) {
+            detail::HashKey old_key(i - 1);
+            dict.Remove(&old_key);
+        }
+    }
+
+    for ( uint32_t i = 0; i < 2 * num_keys; i++ ) {
+        detail::HashKey key(i);
+        uint32_t* v = dict.Lookup(&key);
+        CHECK(v == dict.ScanLookup(&key));
+#ifdef ZEEK_DICT_CTRL_BYTES
+        CHECK(v == dict.GroupLookup(&key));
+#endif
+
+        bool present = i < num_keys && (i % 3 != 1 || i == num_keys - 1);
+        CHECK((v != nullptr) == present);
+        if ( v )
+            CHECK(*v == i);
+    }
+
+    // Robust iteration must still visit each surviving entry exactly once while entries
+    // get removed and relocated by a few insertions.
+    std::set<uint32_t> seen;
+    uint32_t extra = 0;
+    for ( auto it = dict.begin_robust(); it != dict.end_robust(); ++it ) {
+        uint32_t k = *(uint32_t*)it->GetKey();
+        CHECK(seen.insert(k).second);
+
+        if ( k < 100 && k % 2 == 0 ) {
+            detail::HashKey new_key(num_keys + k);
+            dict.Insert(&new_key, &extra);
+        }
+        else if ( k < num_keys ) {
+            detail::HashKey key(k);
+            dict.Remove(&key);
+        }
+    }
+
+    for ( uint32_t i = 0; i < num_keys; i++ ) {
+        detail::HashKey key(i);
+        bool present = (i % 3 != 1 || i == num_keys - 1);
+        CHECK(seen.count(i) == (present ? 1 : 0));
+        CHECK(dict.Lookup(&key) == dict.ScanLookup(&key));
+    }
+}
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+TEST_CASE("dict control bytes") {
+    PDict<uint32_t> dict;
+
+    // The first half of the keys share their whole hash, so they all go into one bucket with
+    // the same tag. The second half share only the tag bits and spread over the buckets after
+    // it. Either way clusters get longer than a group, so probes have to continue into the
+    // next one and skip over matching tags of other keys.
+    constexpr uint32_t num_keys = 64;
+    std::vector<uint32_t> vals(2 * num_keys);
+    std::vector<std::unique_ptr<detail::HashKey>> keys;
+
+    for ( uint32_t i = 0; i < 2 * num_keys; i++ ) {
+        vals[i] = i;
+        detail::hash_t hash = i < num_keys ? 0xfe000001 : 0xfe000000 | i;
+        keys.emplace_back(std::make_unique<detail::HashKey>(&vals[i], sizeof(vals[i]), hash));
+    }
+
+    auto check = [&](auto present) {
+        for ( uint32_t i = 0; i < 2 * num_keys; i++ ) {
+            uint32_t* v = dict.Lookup(keys[i].get());
+            CHECK(v == dict.ScanLookup(keys[i].get()));
+            CHECK(v == dict.GroupLookup(keys[i].get()));
+            CHECK((v != nullptr) == present(i));
+        }
+    };
+
+    for ( uint32_t i = 0; i < 2 * num_keys; i++ )
+        if ( i < num_keys || i % 2 == 0 )
+            dict.Insert(keys[i].get(), &vals[i]);
+
+    check([](uint32_t i) { return i < num_keys || i % 2 == 0; });
+
+    // Removals shift the rest of a cluster down, which moves their control bytes along.
+    for ( uint32_t i = 0; i < 2 * num_keys; i += 3 )
+        dict.Remove(keys[i].get());
+
+    check([](uint32_t i) { return i % 3 != 0 && (i < num_keys || i % 2 == 0); });
+
+    dict.Clear();
+    check([](uint32_t) { return false; });
+}
+
+// Microbenchmark comparing lookups that probe the control bytes against walking the entries
+// of the cluster. Configure with --enable-dict-ctrl-bytes and run with
+// "zeek --test -tc='dict lookup benchmark' --no-skip".
+TEST_CASE("dict lookup benchmark" * doctest::skip(true)) {
+    constexpr uint32_t num_keys = 1000000;
+
+    PDict<uint32_t> dict;
+    uint32_t val = 0;
+    std::vector<detail::HashKey> keys;
+    keys.reserve(2 * num_keys);
+
+    for ( uint32_t i = 0; i < 2 * num_keys; i++ ) {
+        keys.emplace_back(i);
+        if ( i < num_keys ) {
+            detail::HashKey key(i);
+            dict.Insert(&key, &val);
+        }
+    }
+
+    auto run = [&](const char* name, auto lookup) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t found = 0;
+        for ( const auto& key : keys )
+            found += lookup(&key) != nullptr;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        MESSAGE(name << ": " << static_cast<double>(ns) / keys.size() << " ns/lookup");
+        CHECK(found == num_keys);
+    };
+
+    // Lookups move entries that are still placed for a previous table size, so that afterwards
+    // everything can be found in the current one.
+    for ( uint32_t i = 0; i < num_keys; i++ )
+        dict.Lookup(&keys[i]);
+
+    for ( int round = 0; round < 3; round++ ) {
+        run("group probe", [&](const detail::HashKey* k) { return dict.GroupLookup(k); });
+        run("entry scan", [&](const detail::HashKey* k) { return dict.ScanLookup(k); });
+    }
+}
+#endif
+
 // private
 void generic_delete_func(void* v) { free(v); }
 
@@ -9,6 +9,12 @@
 #include <memory>
 #include <vector>
 
+#include "zeek/zeek-config.h"
+
+#if defined(ZEEK_DICT_CTRL_BYTES) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "zeek/Hash.h"
 #include "zeek/Obj.h"
 #include "zeek/Reporter.h"
@@ -74,6 +80,44 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+// Configure with --enable-dict-ctrl-bytes to keep one control byte per table position next to the
+// entries. It's either DICT_CTRL_EMPTY or a 7-bit tag taken from the top of the entry's hash.
+// Lookups then compare DICT_CTRL_GROUP control bytes at once and only look at the entries
+// whose tag matches, instead of touching every entry of the cluster. This pays off while a
+// table fits into the cache; for large tables the extra memory access per lookup outweighs
+// it, so it's off by default. See the "dict lookup benchmark" test case.
+constexpr uint8_t DICT_CTRL_EMPTY = 0x80;
+constexpr int DICT_CTRL_GROUP = 16;
+
+// The tag comes from the top 7 of the 32 hash bits. FibHash() multiplies the hash by an odd
+// constant and BucketByHash() keeps the low log2_buckets bits of the product, which only depend
+// on the same number of low bits of the hash. So up to 2^25 buckets, entries of a bucket still
+// spread over all tags; beyond that, the tag bits partly determine the bucket and only filter
+// less.
+inline uint8_t DictCtrlTag(hash_t h) { return static_cast<uint8_t>((h & HASH_MASK) >> 25); }
+
+// Compares DICT_CTRL_GROUP control bytes starting at ctrl against a tag. Returns a mask with
+// bit i set if ctrl[i] holds the tag, and sets *empty to the mask of empty positions.
+inline uint32_t DictCtrlMatch(const uint8_t* ctrl, uint8_t tag, uint32_t* empty) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    *empty = static_cast<uint32_t>(_mm_movemask_epi8(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(tag)))));
+#else
+    uint32_t match = 0;
+    *empty = 0;
+    for ( int i = 0; i < DICT_CTRL_GROUP; i++ ) {
+        if ( ctrl[i] == tag )
+            match |= 1U << i;
+        else if ( ctrl[i] == DICT_CTRL_EMPTY )
+            *empty |= 1U << i;
+    }
+    return match;
+#endif
+}
+#endif // ZEEK_DICT_CTRL_BYTES
+
 /**
  * An entry stored in the dictionary.
  */
@@ -762,6 +806,10 @@ public:
             }
             free(table);
             table = nullptr;
+#ifdef ZEEK_DICT_CTRL_BYTES
+            free(ctrl);
+            ctrl = nullptr;
+#endif
         }
 
         if ( order )
@@ -837,6 +885,30 @@ public:
     }
 #endif // ZEEK_DICT_DEBUG
 
+    // Looks up a key in the current table size only by walking its cluster entry by entry. Once
+    // no remapping is pending, this returns the same as Lookup(). It's only meant for validating
+    // and benchmarking lookups.
+    T* ScanLookup(const detail::HashKey* key) const {
+        if ( ! table )
+            return nullptr;
+
+        int bucket = BucketByHash(key->Hash(), log2_buckets);
+        int position = ScanLookupIndex(key->Key(), key->Size(), key->Hash(), bucket, Capacity());
+        return position >= 0 ? table[position].value : nullptr;
+    }
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+    // Same as ScanLookup(), but probes the control bytes like Lookup() does.
+    T* GroupLookup(const detail::HashKey* key) const {
+        if ( ! table )
+            return nullptr;
+
+        int bucket = BucketByHash(key->Hash(), log2_buckets);
+        int position = GroupLookupIndex(key->Key(), key->Size(), key->Hash(), bucket, Capacity());
+        return position >= 0 ? table[position].value : nullptr;
+    }
+#endif
+
     void Dump(int level = 0) const {
         int key_size = 0;
         for ( int i = 0; i < Capacity(); i++ ) {
@@ -1120,6 +1192,28 @@ private:
         table = (detail::DictEntry<T>*)malloc(sizeof(detail::DictEntry<T>) * ExpectedCapacity());
         for ( int i = Capacity() - 1; i >= 0; i-- )
             table[i].SetEmpty();
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+        // The trailing group of empty control bytes lets a group probe start at any position.
+        ctrl = (uint8_t*)malloc(ExpectedCapacity() + detail::DICT_CTRL_GROUP);
+        memset(ctrl, detail::DICT_CTRL_EMPTY, ExpectedCapacity() + detail::DICT_CTRL_GROUP);
+#endif
+    }
+
+    // All writes of entries into the table go through these two so that the control bytes
+    // stay in sync.
+    void SetEntry(int position, const detail::DictEntry<T>& entry) {
+        table[position] = entry;
+#ifdef ZEEK_DICT_CTRL_BYTES
+        ctrl[position] = detail::DictCtrlTag(entry.hash);
+#endif
+    }
+
+    void SetEntryEmpty(int position) {
+        table[position].SetEmpty();
+#ifdef ZEEK_DICT_CTRL_BYTES
+        ctrl[position] = detail::DICT_CTRL_EMPTY;
+#endif
     }
 
     // Lookup
@@ -1184,6 +1278,13 @@ private:
     int LookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end,
                     int* insert_position = nullptr, int* insert_distance = nullptr) {
         ASSERT(begin >= 0 && begin < Buckets());
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+        // Insertions need to know where the scan stopped, which the group probe doesn't track.
+        if ( ! insert_position && ! insert_distance )
+            return GroupLookupIndex(key, key_size, hash, begin, end);
+#endif
+
         int i = begin;
         for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= begin; i++ )
             if ( BucketByPosition(i) == begin && table[i].Equal((char*)key, key_size, hash) )
@@ -1204,6 +1305,54 @@ private:
         return -1;
     }
 
+    // Walks the entries from the bucket on until the end of its cluster.
+    int ScanLookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end) const {
+        for ( int i = begin; i < end && ! table[i].Empty() && BucketByPosition(i) <= begin; i++ )
+            if ( BucketByPosition(i) == begin && table[i].Equal((const char*)key, key_size, hash) )
+                return i;
+
+        return -1;
+    }
+
+#ifdef ZEEK_DICT_CTRL_BYTES
+    // Same result as ScanLookupIndex(), but probes the control bytes a group at a time and only
+    // looks at the entries whose tag matches the hash. Entries of a cluster are ordered by
+    // bucket, so the probe ends at the first empty position or once it sees an entry of a
+    // later bucket.
+    int GroupLookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end) const {
+        uint8_t tag = detail::DictCtrlTag(hash);
+
+        // Most matches sit right at the bucket. Fetch that entry while the control bytes load
+        // so that large tables don't pay for two cache misses in a row.
+        __builtin_prefetch(&table[begin]);
+
+        for ( int group = begin; group < end; group += detail::DICT_CTRL_GROUP ) {
+            uint32_t empty;
+            uint32_t match = detail::DictCtrlMatch(ctrl + group, tag, &empty);
+
+            // Only positions before end and before the first empty one belong to the cluster.
+            int n = std::min(detail::DICT_CTRL_GROUP, end - group);
+            bool last_group = (empty & ((1U << n) - 1)) != 0;
+            if ( last_group )
+                n = __builtin_ctz(empty);
+
+            for ( match &= (1U << n) - 1; match; match &= match - 1 ) {
+                int i = group + __builtin_ctz(match);
+                int bucket = BucketByPosition(i);
+                if ( bucket > begin )
+                    return -1;
+                if ( bucket == begin && table[i].Equal((const char*)key, key_size, hash) )
+                    return i;
+            }
+
+            if ( last_group || BucketByPosition(group + n - 1) > begin )
+                return -1;
+        }
+
+        return -1;
+    }
+#endif // ZEEK_DICT_CTRL_BYTES
+
     /// Insert entry, Adjust iterators when necessary.
     void InsertRelocateAndAdjust(detail::DictEntry<T>& entry, int insert_position) {
 /// e.distance is adjusted to be the one at insert_position.
@@ -1239,13 +1388,13 @@ private:
                 ASSERT(insert_position == Capacity());
                 SizeUp(); // copied all the items to new table. as it's just copying without
                           // remapping, insert_position is now empty.
-                table[insert_position] = entry;
+                SetEntry(insert_position, entry);
                 if ( last_affected_position )
                     *last_affected_position = insert_position;
                 return;
             }
             if ( table[insert_position].Empty() ) { // the condition to end the loop.
-                table[insert_position] = entry;
+                SetEntry(insert_position, entry);
                 if ( last_affected_position )
                     *last_affected_position = insert_position;
                 return;
@@ -1257,7 +1406,7 @@ private:
             t.distance += next - insert_position;
 
             // swap
-            table[insert_position] = entry;
+            SetEntry(insert_position, entry);
             entry = t;
             insert_position = next; // append to the end of the current cluster.
         }
@@ -1307,13 +1456,13 @@ private:
             if ( position == Capacity() - 1 || table[position + 1].Empty() || table[position + 1].distance == 0 ) {
                 // no next cluster to fill, or next position is empty or next position is already in
                 // perfect bucket.
-                table[position].SetEmpty();
+                SetEntryEmpty(position);
                 if ( last_affected_position )
                     *last_affected_position = position;
                 return entry;
             }
             int next = TailOfClusterByPosition(position + 1);
-            table[position] = table[next];
+            SetEntry(position, table[next]);
             table[position].distance -= next - position; // distance improved for the item.
             position = next;
         }
@@ -1414,6 +1563,11 @@ private:
         for ( int i = prev_capacity; i < capacity; i++ )
             table[i].SetEmpty();
 
+#ifdef ZEEK_DICT_CTRL_BYTES
+        ctrl = (uint8_t*)realloc(ctrl, capacity + detail::DICT_CTRL_GROUP);
+        memset(ctrl + prev_capacity, detail::DICT_CTRL_EMPTY, capacity - prev_capacity + detail::DICT_CTRL_GROUP);
+#endif
+
         // REmap from last to first in reverse order. SizeUp can be triggered by 2 conditions, one
         // of which is that the last space in the table is occupied and there's nowhere to put new
         // items. In this case, the table doubles in capacity and the item is put at the
@@ -1563,6 +1717,9 @@ private:
 
     dict_delete_func delete_func = nullptr;
     detail::DictEntry<T>* table = nullptr;
+#ifdef ZEEK_DICT_CTRL_BYTES
+    uint8_t* ctrl = nullptr; // one control byte per table position, see DictCtrlMatch().
+#endif
     std::vector<RobustDictIterator<T>*>* iterators = nullptr;
 
     // Ordered dictionaries keep the order based on some criteria, by default the order of
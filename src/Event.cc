@@ -5,13 +5,17 @@
 #include "zeek/zeek-config.h"
 
 #include "zeek/Desc.h"
+#include "zeek/EventHandler.h"
 #include "zeek/Func.h"
+#include "zeek/ID.h"
 #include "zeek/NetVar.h"
+#include "zeek/SlabPool.h"
 #include "zeek/Trigger.h"
 #include "zeek/Val.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/telemetry/Manager.h"
 
 zeek::EventMgr zeek::event_mgr;
 
@@ -30,6 +34,10 @@ Event::Event(const EventHandlerPtr& arg_handler, zeek::Args arg_args, util::deta
         Ref(obj);
 }
 
+void* Event::operator new(size_t size) { return detail::SlabPool::Allocate(size); }
+
+void Event::operator delete(void* p, size_t size) { detail::SlabPool::Free(p, size); }
+
 void Event::Describe(ODesc* d) const {
     if ( d->IsReadable() )
         d->AddSP("event");
@@ -48,6 +56,9 @@ void Event::Dispatch(bool no_remote) {
     if ( src == util::detail::SOURCE_BROKER )
         no_remote = true;
 
+    // Frees what the handler released in bulk once it's done.
+    detail::DeferDeletes defer_deletes;
+
     if ( handler->ErrorHandler() )
         reporter->BeginErrorHandler();
 
@@ -88,9 +99,47 @@ EventMgr::~EventMgr() {
 
 void EventMgr::Enqueue(const EventHandlerPtr& h, Args vl, util::detail::SourceID src, analyzer::ID aid, Obj* obj,
                        double ts) {
+    if ( ! WantsEvent(h) ) {
+        RecycleArgs(std::move(vl));
+        return;
+    }
+
     QueueEvent(new Event(h, std::move(vl), src, aid, obj, ts));
 }
 
+bool EventMgr::WantsEvent(const EventHandlerPtr& h) const {
+    if ( h.operator->() && h->HasConsumers() )
+        return true;
+
+    // Without a handler, the meta event and plugins may still care.
+    return new_event || plugin_mgr->HavePluginForHook(plugin::HOOK_QUEUE_EVENT);
+}
+
+Args EventMgr::NewArgs(size_t n) {
+    Args vl;
+
+    if ( ! spare_args.empty() ) {
+        vl = std::move(spare_args.back());
+        spare_args.pop_back();
+    }
+
+    vl.reserve(n);
+    return vl;
+}
+
+void EventMgr::RecycleArgs(Args&& vl) {
+    // Keeps enough spares for a burst of events, but doesn't hang on to
+    // unusually large vectors.
+    constexpr size_t max_spares = 1024;
+    constexpr size_t max_spare_capacity = 16;
+
+    if ( spare_args.size() >= max_spares || vl.capacity() == 0 || vl.capacity() > max_spare_capacity )
+        return;
+
+    vl.clear();
+    spare_args.push_back(std::move(vl));
+}
+
 void EventMgr::QueueEvent(Event* event) {
     bool done = PLUGIN_HOOK_WITH_RESULT(HOOK_QUEUE_EVENT, HookQueueEvent(event), false);
 
@@ -106,6 +155,7 @@ void EventMgr::QueueEvent(Event* event) {
     }
 
     ++event_mgr.num_events_queued;
+    ++queue_depth[event->Source() != util::detail::SOURCE_LOCAL];
 }
 
 void EventMgr::Dispatch(Event* event, bool no_remote) {
@@ -113,6 +163,10 @@ void EventMgr::Dispatch(Event* event, bool no_remote) {
     current_aid = event->Analyzer();
     current_ts = event->Time();
     event->Dispatch(no_remote);
+
+    if ( event->RefCnt() == 1 )
+        RecycleArgs(std::move(event->args));
+
     Unref(event);
 }
 
@@ -139,10 +193,15 @@ void EventMgr::Drain() {
         while ( current ) {
             Event* next = current->NextEvent();
 
+            --queue_depth[current->Source() != util::detail::SOURCE_LOCAL];
             current_src = current->Source();
             current_aid = current->Analyzer();
             current_ts = current->Time();
             current->Dispatch();
+
+            if ( current->RefCnt() == 1 )
+                RecycleArgs(std::move(current->args));
+
             Unref(current);
 
             ++event_mgr.num_events_dispatched;
@@ -180,6 +239,20 @@ void EventMgr::Process() {
     // and had the opportunity to spawn new events.
 }
 
-void EventMgr::InitPostScript() { iosource_mgr->Register(this, true, false); }
+void EventMgr::InitPostScript() {
+    detail::DeferDeletes::SetBatchSize(detail::deferred_delete_batch_size);
+    EventHandler::SetDurationSampleRate(id::find_val("Telemetry::event_handler_sample_rate")->AsCount());
+
+    local_queue_depth_metric =
+        telemetry_mgr->GaugeInstance("zeek", "event_queue_depth", {{"source", "local"}},
+                                     "Number of queued events not yet dispatched", "",
+                                     []() { return static_cast<double>(event_mgr.LocalQueueDepth()); });
+    remote_queue_depth_metric =
+        telemetry_mgr->GaugeInstance("zeek", "event_queue_depth", {{"source", "remote"}},
+                                     "Number of queued events not yet dispatched", "",
+                                     []() { return static_cast<double>(event_mgr.RemoteQueueDepth()); });
+
+    iosource_mgr->Register(this, true, false);
+}
 
 } // namespace zeek
@@ -2,8 +2,10 @@
 
 #pragma once
 
+#include <memory>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 #include "zeek/Flare.h"
 #include "zeek/IntrusivePtr.h"
@@ -18,6 +20,11 @@ namespace run_state {
 extern double network_time;
 } // namespace run_state
 
+namespace telemetry {
+class Gauge;
+using GaugePtr = std::shared_ptr<Gauge>;
+} // namespace telemetry
+
 class EventMgr;
 
 class Event final : public Obj {
@@ -36,6 +43,11 @@ public:
 
     void Describe(ODesc* d) const override;
 
+    // Events are allocated and freed at a high rate, so they come from
+    // detail::SlabPool.
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
 protected:
     friend class EventMgr;
 
@@ -75,14 +87,34 @@ public:
                  analyzer::ID aid = 0, Obj* obj = nullptr, double ts = run_state::network_time);
 
     /**
-     * A version of Enqueue() taking a variable number of arguments.
+     * A version of Enqueue() taking a variable number of arguments. The
+     * argument vector reuses the storage of an already dispatched event.
      */
     template<class... Args>
     std::enable_if_t<std::is_convertible_v<std::tuple_element_t<0, std::tuple<Args...>>, ValPtr>> Enqueue(
         const EventHandlerPtr& h, Args&&... args) {
-        return Enqueue(h, zeek::Args{std::forward<Args>(args)...});
+        if ( ! WantsEvent(h) )
+            return;
+
+        auto vl = NewArgs(sizeof...(Args));
+        (vl.emplace_back(std::forward<Args>(args)), ...);
+        return Enqueue(h, std::move(vl));
     }
 
+    /**
+     * Returns false if queueing an event for the handler can't have any
+     * effect: the handler has no bodies, isn't auto-published or marked as
+     * generated always, and neither new_event() nor a plugin hooking
+     * queued events would see it. Enqueue() drops such events right away.
+     */
+    bool WantsEvent(const EventHandlerPtr& h) const;
+
+    /**
+     * Returns an empty argument vector with room for *n* arguments, reusing
+     * the storage of a dispatched event if possible.
+     */
+    zeek::Args NewArgs(size_t n);
+
     void Dispatch(Event* event, bool no_remote = false);
 
     void Drain();
@@ -104,6 +136,11 @@ public:
 
     int Size() const { return num_events_queued - num_events_dispatched; }
 
+    // Returns the number of queued events that haven't been dispatched yet,
+    // split by whether they were raised locally or received from a peer.
+    uint64_t LocalQueueDepth() const { return queue_depth[0]; }
+    uint64_t RemoteQueueDepth() const { return queue_depth[1]; }
+
     void Describe(ODesc* d) const override;
 
     // Let the IO loop know when there's more events to process
@@ -120,6 +157,9 @@ public:
 protected:
     void QueueEvent(Event* event);
 
+    // Takes back an event's arguments after dispatching it, for NewArgs().
+    void RecycleArgs(zeek::Args&& args);
+
     Event* head;
     Event* tail;
     util::detail::SourceID current_src;
@@ -127,6 +167,12 @@ protected:
     double current_ts;
     RecordVal* src_val;
     bool draining;
+    std::vector<zeek::Args> spare_args;
+
+    // Indexed by whether the events came from a peer.
+    uint64_t queue_depth[2] = {0, 0};
+    telemetry::GaugePtr local_queue_depth_metric;
+    telemetry::GaugePtr remote_queue_depth_metric;
 };
 
 extern EventMgr event_mgr;
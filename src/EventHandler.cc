@@ -10,9 +10,12 @@
 #include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/telemetry/Manager.h"
+#include "zeek/telemetry/Timer.h"
 
 namespace zeek {
 
+uint64_t EventHandler::duration_sample_rate = 0;
+
 EventHandler::EventHandler(std::string arg_name) {
     name = std::move(arg_name);
     used = false;
@@ -25,6 +28,10 @@ EventHandler::operator bool() const {
     return enabled && ((local && local->HasEnabledBodies()) || generate_always || ! auto_publish.empty());
 }
 
+bool EventHandler::HasConsumers() const {
+    return (local && local->HasBodies()) || generate_always || ! auto_publish.empty();
+}
+
 const FuncTypePtr& EventHandler::GetType(bool check_export) {
     if ( type )
         return type;
@@ -91,9 +98,28 @@ void EventHandler::Call(Args* vl, bool no_remote, double ts) {
         }
     }
 
-    if ( local )
+    if ( ! local )
+        return;
+
+    if ( duration_sample_rate == 0 || ++calls_since_sample < duration_sample_rate ) {
         // No try/catch here; we pass exceptions upstream.
         local->Invoke(vl);
+        return;
+    }
+
+    calls_since_sample = 0;
+
+    if ( ! duration ) {
+        static constexpr double bounds[] = {0.000001, 0.00001, 0.0001, 0.001, 0.01, 0.1, 1.0};
+        static auto eh_duration_family =
+            telemetry_mgr->HistogramFamily("zeek", "event-handler-duration", {"name"}, bounds,
+                                           "Sampled execution time of the given event handler", "seconds");
+
+        duration = eh_duration_family->GetOrAdd({{"name", name}});
+    }
+
+    telemetry::Timer timer{duration};
+    local->Invoke(vl);
 }
 
 void EventHandler::NewEvent(Args* vl) {
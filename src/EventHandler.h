@@ -18,7 +18,8 @@ extern double network_time;
 
 namespace telemetry {
 class Counter;
-}
+class Histogram;
+} // namespace telemetry
 
 class Func;
 using FuncPtr = IntrusivePtr<Func>;
@@ -44,6 +45,12 @@ public:
     // Returns true if there is at least one local or remote handler.
     explicit operator bool() const;
 
+    // Returns false if calling the handler can't do anything: there are no
+    // bodies, enabled or not, no auto-publish topics, and the event isn't
+    // generated always. Unlike operator bool, this doesn't change when
+    // event groups get enabled.
+    bool HasConsumers() const;
+
     // Handlers marked as error handlers will not be called recursively to
     // avoid infinite loops if they trigger a similar error themselves.
     void SetErrorHandler() { error_handler = true; }
@@ -59,6 +66,12 @@ public:
     // Returns the number of times this EventHandler has been called since startup.
     uint64_t CallCount() const;
 
+    // Sets how often the execution time of event handlers is measured: every
+    // n-th call of each handler is timed and recorded in a per-handler
+    // histogram. 0 turns the measurements off.
+    static void SetDurationSampleRate(uint64_t n) { duration_sample_rate = n; }
+    static uint64_t DurationSampleRate() { return duration_sample_rate; }
+
 private:
     void NewEvent(zeek::Args* vl); // Raise new_event() meta event.
 
@@ -73,6 +86,12 @@ private:
     // Initialize this lazy, so we don't expose metrics for 0 values.
     std::shared_ptr<zeek::telemetry::Counter> call_count;
 
+    // Likewise created on the first measured call.
+    std::shared_ptr<zeek::telemetry::Histogram> duration;
+    uint64_t calls_since_sample = 0;
+
+    static uint64_t duration_sample_rate;
+
     std::unordered_set<std::string> auto_publish;
 };
 
@@ -254,7 +254,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
             return;
         }
 
-        memcpy(&pkt[b.seq], b.block, b.upper - b.seq);
+        memcpy(&pkt[b.seq], b.Data(), b.upper - b.seq);
     }
 
     reassembled_pkt.reset();
@@ -126,15 +126,13 @@ HashKey::HashKey(const String* s) {
 
 HashKey::HashKey(const void* bytes, size_t arg_size) {
     size = write_size = arg_size;
-    key = CopyKey((char*)bytes, size);
-    is_our_dynamic = true;
+    StoreCopy((const char*)bytes, size);
 }
 
 HashKey::HashKey(const void* arg_key, size_t arg_size, hash_t arg_hash) {
     size = write_size = arg_size;
     hash = arg_hash;
-    key = CopyKey((char*)arg_key, size);
-    is_our_dynamic = true;
+    StoreCopy((const char*)arg_key, size);
 }
 
 HashKey::HashKey(const void* arg_key, size_t arg_size, hash_t arg_hash, bool /* dont_copy */) {
@@ -152,10 +150,18 @@ HashKey::HashKey(HashKey&& other) noexcept {
     read_size = other.read_size;
 
     is_our_dynamic = other.is_our_dynamic;
-    key = other.key;
+    is_inline_buffer = other.is_inline_buffer;
+
+    if ( other.key == other.key_u.buf ) {
+        key_u = other.key_u;
+        key = key_u.buf;
+    }
+    else
+        key = other.key;
 
     other.size = 0;
     other.is_our_dynamic = false;
+    other.is_inline_buffer = false;
     other.key = nullptr;
 }
 
@@ -227,6 +233,22 @@ char* HashKey::CopyKey(const char* k, size_t s) const {
     return k_copy;
 }
 
+void HashKey::StoreCopy(const char* k, size_t s) {
+    if ( s <= INLINE_KEY_SIZE ) {
+        if ( s > 0 )
+            memcpy(key_u.buf, k, s);
+
+        key = key_u.buf;
+        is_our_dynamic = false;
+        is_inline_buffer = true;
+    }
+    else {
+        key = CopyKey(k, s);
+        is_our_dynamic = true;
+        is_inline_buffer = false;
+    }
+}
+
 hash_t HashKey::HashBytes(const void* bytes, size_t size) { return KeyedHash::Hash64(bytes, size); }
 
 void HashKey::Set(bool b) {
@@ -282,13 +304,19 @@ void HashKey::Reserve(const char* tag, size_t addl_size, size_t alignment) {
 }
 
 void HashKey::Allocate() {
-    if ( key != nullptr && key != reinterpret_cast<char*>(&key_u) ) {
+    if ( IsAllocated() ) {
         reporter->InternalWarning("usage error in HashKey::Allocate(): already allocated");
         return;
     }
 
-    is_our_dynamic = true;
-    key = reinterpret_cast<char*>(new double[size / sizeof(double) + 1]);
+    if ( size <= INLINE_KEY_SIZE ) {
+        key = key_u.buf;
+        is_inline_buffer = true;
+    }
+    else {
+        is_our_dynamic = true;
+        key = reinterpret_cast<char*>(new double[size / sizeof(double) + 1]);
+    }
 
     read_size = 0;
     write_size = 0;
@@ -509,11 +537,10 @@ HashKey& HashKey::operator=(const HashKey& other) {
 
     hash = other.hash;
     size = other.size;
-    is_our_dynamic = true;
     write_size = other.write_size;
     read_size = other.read_size;
 
-    key = CopyKey(other.key, other.size);
+    StoreCopy(other.key, other.size);
 
     return *this;
 }
@@ -531,10 +558,18 @@ HashKey& HashKey::operator=(HashKey&& other) noexcept {
         delete[] key;
 
     is_our_dynamic = other.is_our_dynamic;
-    key = other.key;
+    is_inline_buffer = other.is_inline_buffer;
+
+    if ( other.key == other.key_u.buf ) {
+        key_u = other.key_u;
+        key = key_u.buf;
+    }
+    else
+        key = other.key;
 
     other.size = 0;
     other.is_our_dynamic = false;
+    other.is_inline_buffer = false;
     other.key = nullptr;
 
     return *this;
@@ -572,6 +607,53 @@ TEST_CASE("move assignment") {
     CHECK(h1 == h5);
 }
 
+TEST_CASE("inline storage") {
+    HashKey h1;
+    h1.Reserve("test", 3 * sizeof(uint64_t));
+    h1.Allocate();
+    CHECK(h1.IsAllocated());
+
+    for ( uint64_t i = 0; i < 3; ++i )
+        h1.Write("test", &i, sizeof(i));
+
+    // The buffer lives within the key itself.
+    auto p = static_cast<const char*>(h1.Key());
+    CHECK(p >= reinterpret_cast<const char*>(&h1));
+    CHECK(p < reinterpret_cast<const char*>(&h1 + 1));
+
+    HashKey h2{h1};
+    CHECK(h1 == h2);
+    CHECK(h2.Key() != h1.Key());
+
+    HashKey h3 = std::move(h2);
+    CHECK(h1 == h3);
+    CHECK(h3.IsAllocated());
+
+    uint64_t v;
+    h3.ResetRead();
+    h3.SkipRead("test", sizeof(v));
+    h3.Read("test", &v, sizeof(v));
+    CHECK(v == 1);
+
+    // Taking the key hands out a copy that the caller owns.
+    auto taken = static_cast<char*>(h3.TakeKey());
+    CHECK(memcmp(taken, h1.Key(), h1.Size()) == 0);
+    delete[] taken;
+}
+
+TEST_CASE("heap storage") {
+    std::string data(HashKey::INLINE_KEY_SIZE + 1, 'x');
+    HashKey h1(data.data(), data.size());
+    CHECK(h1.IsAllocated());
+
+    auto p = static_cast<const char*>(h1.Key());
+    CHECK((p < reinterpret_cast<const char*>(&h1) || p >= reinterpret_cast<const char*>(&h1 + 1)));
+
+    HashKey h2 = std::move(h1);
+    CHECK(h2.Key() == p);
+    CHECK(h2.Size() == data.size());
+}
+
 TEST_SUITE_END();
 
 } // namespace zeek::detail
@@ -265,9 +265,14 @@ public:
     static hash_t HashBytes(const void* bytes, size_t size);
 
     // A HashKey is "allocated" when the underlying key points somewhere
-    // other than our internal key_u union. This is almost like
+    // other than our internal key_u union, or when Allocate() placed the
+    // buffer there because it was small enough. This is almost like
     // is_our_dynamic, but remains true also after TakeKey().
-    bool IsAllocated() const { return (key != nullptr && key != reinterpret_cast<const char*>(&key_u)); }
+    bool IsAllocated() const { return key != nullptr && (key != key_u.buf || is_inline_buffer); }
+
+    // Keys up to this size are stored within the HashKey itself rather
+    // than on the heap.
+    static constexpr size_t INLINE_KEY_SIZE = 64;
 
     // Buffer size reservation. Repeated calls to these methods
     // incrementally build up the eventual buffer size to be allocated via
@@ -359,6 +364,9 @@ protected:
     void Set(double d);
     void Set(const void* p);
 
+    // Stores a copy of the given key, inline if it's small enough.
+    void StoreCopy(const char* key, size_t size);
+
     union {
         bool b;
         int i;
@@ -366,12 +374,14 @@ protected:
         uint32_t u32;
         double d;
         const void* p;
+        alignas(double) char buf[INLINE_KEY_SIZE];
     } key_u;
 
     char* key = nullptr;
     mutable hash_t hash = 0;
     size_t size = 0;
     bool is_our_dynamic = false;
+    bool is_inline_buffer = false; // Allocate() used key_u
     size_t write_size = 0;
     mutable size_t read_size = 0;
 };
@@ -110,6 +110,9 @@ namespace zeek::detail {
 int watchdog_interval;
 
 int max_timer_expires;
+bool use_timer_wheel;
+double timer_wheel_resolution;
+zeek_uint_t deferred_delete_batch_size;
 
 int ignore_checksums;
 int partial_connection_ok;
@@ -160,6 +163,7 @@ int dns_max_queries;
 double table_expire_interval;
 double table_expire_delay;
 int table_incremental_step;
+int table_expire_index_threshold;
 
 double connection_status_update_interval;
 
@@ -174,6 +178,7 @@ double pkt_profile_freq;
 int packet_filter_default;
 
 int sig_max_group_size;
+zeek_uint_t max_dfa_cache_size;
 
 int dpd_reassemble_first_packets;
 int dpd_buffer_size;
@@ -181,6 +186,8 @@ int dpd_max_packets;
 int dpd_match_only_beginning;
 int dpd_late_match_stop;
 int dpd_ignore_ports;
+zeek_uint_t dpd_buffer_total;
+int dpd_commit_on_confirmation;
 
 int record_all_packets;
 
@@ -229,8 +236,10 @@ void init_general_global_var() {
     table_expire_interval = id::find_val("table_expire_interval")->AsInterval();
     table_expire_delay = id::find_val("table_expire_delay")->AsInterval();
     table_incremental_step = id::find_val("table_incremental_step")->AsCount();
+    table_expire_index_threshold = id::find_val("table_expire_index_threshold")->AsCount();
     packet_filter_default = id::find_val("packet_filter_default")->AsBool();
     sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
+    max_dfa_cache_size = id::find_val("max_dfa_cache_size")->AsCount();
     record_all_packets = id::find_val("record_all_packets")->AsBool();
     bits_per_uid = id::find_val("bits_per_uid")->AsCount();
 }
@@ -284,6 +293,9 @@ void init_net_var() {
     watchdog_interval = int(id::find_val("watchdog_interval")->AsInterval());
 
     max_timer_expires = id::find_val("max_timer_expires")->AsCount();
+    use_timer_wheel = id::find_val("use_timer_wheel")->AsBool();
+    timer_wheel_resolution = id::find_val("timer_wheel_resolution")->AsInterval();
+    deferred_delete_batch_size = id::find_val("deferred_delete_batch_size")->AsCount();
 
     mime_segment_length = id::find_val("mime_segment_length")->AsCount();
     mime_segment_overlap_length = id::find_val("mime_segment_overlap_length")->AsCount();
@@ -325,6 +337,8 @@ void init_net_var() {
     dpd_match_only_beginning = id::find_val("dpd_match_only_beginning")->AsBool();
     dpd_late_match_stop = id::find_val("dpd_late_match_stop")->AsBool();
     dpd_ignore_ports = id::find_val("dpd_ignore_ports")->AsBool();
+    dpd_buffer_total = id::find_val("dpd_buffer_total")->AsCount();
+    dpd_commit_on_confirmation = id::find_val("dpd_commit_on_confirmation")->AsBool();
 
     tunnel_max_changes_per_connection = id::find_val("Tunnel::max_changes_per_connection")->AsCount();
 }
@@ -11,6 +11,9 @@ namespace zeek::detail {
 extern int watchdog_interval;
 
 extern int max_timer_expires;
+extern bool use_timer_wheel;
+extern double timer_wheel_resolution;
+extern zeek_uint_t deferred_delete_batch_size;
 
 extern int ignore_checksums;
 extern int partial_connection_ok;
@@ -62,6 +65,7 @@ extern int dns_max_queries;
 extern double table_expire_interval;
 extern double table_expire_delay;
 extern int table_incremental_step;
+extern int table_expire_index_threshold;
 
 extern int orig_addr_anonymization, resp_addr_anonymization;
 extern int other_addr_anonymization;
@@ -77,6 +81,7 @@ extern double pkt_profile_freq;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern zeek_uint_t max_dfa_cache_size;
 
 extern int dpd_reassemble_first_packets;
 extern int dpd_buffer_size;
@@ -84,6 +89,8 @@ extern int dpd_max_packets;
 extern int dpd_match_only_beginning;
 extern int dpd_late_match_stop;
 extern int dpd_ignore_ports;
+extern zeek_uint_t dpd_buffer_total;
+extern int dpd_commit_on_confirmation;
 
 extern int record_all_packets;
 
@@ -5,12 +5,15 @@
 #include "zeek/zeek-config.h"
 
 #include <cstdlib>
+#include <vector>
 
 #include "zeek/Desc.h"
 #include "zeek/File.h"
 #include "zeek/Func.h"
 #include "zeek/plugin/Manager.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 namespace zeek {
 namespace detail {
 
@@ -190,4 +193,126 @@ void bad_ref(int type) {
 
 void obj_delete_func(void* v) { Unref((Obj*)v); }
 
+namespace detail {
+
+bool deferring_deletes = false;
+size_t DeferDeletes::batch_size = 0;
+
+namespace {
+
+int defer_depth = 0;
+bool deleting = false;
+std::vector<Obj*> deferred;
+
+} // namespace
+
+void defer_delete(Obj* o) {
+    deferred.push_back(o);
+
+    if ( deferred.size() >= DeferDeletes::BatchSize() )
+        DeferDeletes::DeleteAll();
+}
+
+DeferDeletes::DeferDeletes() {
+    active = batch_size > 0;
+
+    if ( active && defer_depth++ == 0 )
+        deferring_deletes = true;
+}
+
+DeferDeletes::~DeferDeletes() {
+    if ( ! active || --defer_depth > 0 )
+        return;
+
+    // Objects released by the destructors below still get collected, and
+    // DeleteAll() keeps going until there are none left.
+    DeleteAll();
+    deferring_deletes = false;
+}
+
+void DeferDeletes::DeleteAll() {
+    // Destructors may release further objects, possibly filling up another
+    // batch. The outermost call picks those up.
+    if ( deleting )
+        return;
+
+    deleting = true;
+
+    static std::vector<Obj*> batch;
+
+    while ( ! deferred.empty() ) {
+        batch.swap(deferred);
+
+        for ( auto o : batch )
+            delete o;
+
+        batch.clear();
+    }
+
+    deleting = false;
+}
+
+namespace {
+
+struct Counted : Obj {
+    explicit Counted(int* arg_deleted) : deleted(arg_deleted) {}
+    ~Counted() override { ++*deleted; }
+
+    int* deleted;
+};
+
+} // namespace
+
+TEST_SUITE_BEGIN("DeferDeletes");
+
+TEST_CASE("deferred deletes happen when the outermost scope ends") {
+    int deleted = 0;
+    DeferDeletes::SetBatchSize(100);
+
+    {
+        DeferDeletes outer;
+        Unref(new Counted(&deleted));
+
+        {
+            DeferDeletes inner;
+            Unref(new Counted(&deleted));
+        }
+
+        CHECK(deleted == 0);
+    }
+
+    CHECK(deleted == 2);
+    CHECK_FALSE(deferring_deletes);
+    DeferDeletes::SetBatchSize(0);
+}
+
+TEST_CASE("deferred deletes happen once a batch is full") {
+    int deleted = 0;
+    DeferDeletes::SetBatchSize(2);
+
+    {
+        DeferDeletes scope;
+        Unref(new Counted(&deleted));
+        CHECK(deleted == 0);
+        Unref(new Counted(&deleted));
+        CHECK(deleted == 2);
+        Unref(new Counted(&deleted));
+        CHECK(deleted == 2);
+    }
+
+    CHECK(deleted == 3);
+    DeferDeletes::SetBatchSize(0);
+}
+
+TEST_CASE("deletes aren't deferred with a batch size of 0") {
+    int deleted = 0;
+    DeferDeletes scope;
+    Unref(new Counted(&deleted));
+    CHECK(deleted == 1);
+}
+
+TEST_SUITE_END();
+
+} // namespace detail
+
 } // namespace zeek
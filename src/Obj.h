@@ -5,6 +5,7 @@
 #include "zeek/zeek-config.h"
 
 #include <climits>
+#include <cstddef>
 
 namespace zeek {
 
@@ -162,6 +163,42 @@ inline void Error(const Obj* o, const char* msg) { o->Error(msg); }
 
 [[noreturn]] extern void bad_ref(int type);
 
+namespace detail {
+
+// True while a DeferDeletes instance is active. Unref() then passes objects
+// that lost their last reference to defer_delete() rather than deleting them.
+extern bool deferring_deletes;
+extern void defer_delete(Obj* o);
+
+/**
+ * While an instance exists, objects released through Unref() are collected
+ * and destroyed in bulk: whenever the batch size is reached, and when the
+ * outermost instance goes away. This keeps the frees of the many temporaries
+ * a script handler creates out of its inner loops. Instances may nest. They
+ * have no effect while the batch size is 0, the default.
+ */
+class DeferDeletes {
+public:
+    DeferDeletes();
+    ~DeferDeletes();
+
+    DeferDeletes(const DeferDeletes&) = delete;
+    DeferDeletes& operator=(const DeferDeletes&) = delete;
+
+    static void SetBatchSize(size_t n) { batch_size = n; }
+    static size_t BatchSize() { return batch_size; }
+
+    // Destroys all objects collected so far.
+    static void DeleteAll();
+
+private:
+    bool active;
+
+    static size_t batch_size;
+};
+
+} // namespace detail
+
 inline void Ref(Obj* o) {
     if ( ++(o->ref_cnt) <= 1 )
         bad_ref(0);
@@ -173,7 +210,13 @@ inline void Unref(Obj* o) {
     if ( o && --o->ref_cnt <= 0 ) {
         if ( o->ref_cnt < 0 )
             bad_ref(2);
-        delete o;
+
+        // Plugins see the destruction of objects they asked about right
+        // away.
+        if ( detail::deferring_deletes && ! o->notify_plugins )
+            detail::defer_delete(o);
+        else
+            delete o;
 
         // We could do the following if o were passed by reference.
         // o = (Obj*) 0xcd;
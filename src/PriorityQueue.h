@@ -21,12 +21,17 @@ public:
     int Offset() const { return offset; }
     void SetOffset(int off) { offset = off; }
 
+    // Used by TimerWheel to record which of its buckets holds the element.
+    int Bucket() const { return bucket; }
+    void SetBucket(int b) { bucket = b; }
+
     void MinimizeTime() { time = -HUGE_VAL; }
 
 protected:
     PQ_Element() = default;
     double time = 0.0;
     int offset = -1;
+    int bucket = -1;
 };
 
 class PriorityQueue {
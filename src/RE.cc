@@ -215,6 +215,8 @@ bool Specific_RE_Matcher::MatchAll(const u_char* bv, int n, std::vector<AcceptId
         // matched is empty.
         return n == 0;
 
+    dfa->CheckMemory();
+
     DFA_State* d = dfa->StartState();
     d = d->Xtion(ecs[SYM_BOL], dfa);
 
@@ -242,6 +244,8 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n) {
         // An empty pattern matches anything.
         return 1;
 
+    dfa->CheckMemory();
+
     DFA_State* d = dfa->StartState();
 
     d = d->Xtion(ecs[SYM_BOL], dfa);
@@ -250,12 +254,19 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n) {
 
     for ( int i = 0; i < n; ++i ) {
         int ec = ecs[bv[i]];
-        d = d->Xtion(ec, dfa);
-        if ( ! d )
+        DFA_State* next = d->Xtion(ec, dfa);
+        if ( ! next ) {
+            d = nullptr;
             break;
+        }
 
-        if ( d->Accept() )
+        if ( next->Accept() )
             return i + 1;
+
+        if ( next == d )
+            i += d->LoopLength(bv + i + 1, n - i - 1, dfa);
+
+        d = next;
     }
 
     if ( d ) {
@@ -276,6 +287,27 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as, MatchPos position
         accepted_matches.insert(am_idx(*it, position));
 }
 
+RE_Match_State::~RE_Match_State() { SetCurrentState(nullptr); }
+
+void RE_Match_State::Clear() {
+    current_pos = -1;
+    SetCurrentState(nullptr);
+    accepted_matches.clear();
+}
+
+void RE_Match_State::SetCurrentState(DFA_State* s) {
+    if ( s == current_state )
+        return;
+
+    if ( s )
+        Ref(s);
+
+    if ( current_state )
+        Unref(current_state);
+
+    current_state = s;
+}
+
 bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool clear) {
     if ( current_pos == -1 ) {
         // First call to Match().
@@ -285,9 +317,9 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
         // Initialize state and copy the accepting states of the start
         // state into the acceptance set.
         current_pos = 0;
-        current_state = dfa->StartState();
+        SetCurrentState(dfa->StartState());
 
-        const AcceptingSet* ac = current_state->Accept();
+        const AcceptingSet* ac = current_state ? current_state->Accept() : nullptr;
 
         if ( ac )
             AddMatches(*ac, 0);
@@ -295,12 +327,16 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 
     else if ( clear ) {
         current_pos = 0;
-        current_state = dfa->StartState();
+        SetCurrentState(dfa->StartState());
     }
 
     if ( ! current_state )
         return false;
 
+    dfa->CheckMemory();
+
+    if ( current_state->Evicted() )
+        SetCurrentState(dfa->Resolve(current_state));
 
     size_t old_matches = accepted_matches.size();
 
@@ -308,6 +344,8 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
     int m = bol ? n + 1 : n;
     int e = eol ? -1 : 0;
 
+    DFA_State* state = current_state;
+
     while ( --m >= e ) {
         if ( m == n )
             ec = ecs[SYM_BOL];
@@ -316,10 +354,10 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
         else
             ec = ecs[*(bv++)];
 
-        DFA_State* next_state = current_state->Xtion(ec, dfa);
+        DFA_State* next_state = state->Xtion(ec, dfa);
 
         if ( ! next_state ) {
-            current_state = nullptr;
+            state = nullptr;
             break;
         }
 
@@ -330,9 +368,20 @@ bool RE_Match_State::Match(const u_char* bv, int n, bool bol, bool eol, bool cle
 
         ++current_pos;
 
-        current_state = next_state;
+        if ( next_state == state && m > 0 ) {
+            // Skip over the input that keeps us in this state. Accepting
+            // states have already recorded their matches when entered.
+            int skip = state->LoopLength(bv, m, dfa);
+            bv += skip;
+            m -= skip;
+            current_pos += skip;
+        }
+
+        state = next_state;
     }
 
+    SetCurrentState(state);
+
     return accepted_matches.size() != old_matches;
 }
 
@@ -341,6 +390,8 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n, bool bol, bool eo
         // An empty pattern matches anything.
         return 0;
 
+    dfa->CheckMemory();
+
     // Use -1 to indicate no match.
     int last_accept = -1;
     DFA_State* d = dfa->StartState();
@@ -162,6 +162,11 @@ public:
         current_state = nullptr;
     }
 
+    ~RE_Match_State();
+
+    RE_Match_State(const RE_Match_State&) = delete;
+    RE_Match_State& operator=(const RE_Match_State&) = delete;
+
     const AcceptingMatchSet& AcceptedMatches() const { return accepted_matches; }
 
     // Returns the number of bytes fed into the matcher so far
@@ -171,15 +176,15 @@ public:
     // If clear is true, starts matching over.
     bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-    void Clear() {
-        current_pos = -1;
-        current_state = nullptr;
-        accepted_matches.clear();
-    }
+    void Clear();
 
     void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+    // Holds a reference to the state, so that it survives being evicted
+    // from the DFA's cache between calls to Match().
+    void SetCurrentState(DFA_State* s);
+
     DFA_Machine* dfa;
     int* ecs;
 
@@ -6,9 +6,12 @@
 
 #include <algorithm>
 #include <limits>
+#include <new>
+#include <string>
 
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
+#include "zeek/3rdparty/doctest.h"
 
 using std::min;
 
@@ -17,11 +20,106 @@ namespace zeek {
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
 
-DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq) {
-    seq = arg_seq;
-    upper = seq + size;
-    block = new u_char[size];
-    memcpy(block, data, size);
+DataBlockStore::~DataBlockStore() {
+    clear();
+    ::operator delete(slots);
+}
+
+DataBlockStore::const_iterator DataBlockStore::upper_bound(uint64_t seq) const {
+    size_t lo = 0;
+    size_t hi = count;
+
+    while ( lo < hi ) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if ( At(mid).first <= seq )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return {this, base + lo};
+}
+
+void DataBlockStore::Grow() {
+    size_t capacity = slots ? 2 * (mask + 1) : 8;
+    auto new_slots = static_cast<value_type*>(::operator new(capacity * sizeof(value_type)));
+
+    for ( size_t i = 0; i < count; ++i ) {
+        auto& e = At(i);
+        new (&new_slots[i]) value_type(std::move(e));
+        e.~value_type();
+    }
+
+    ::operator delete(slots);
+    slots = new_slots;
+    mask = capacity - 1;
+    head = 0;
+}
+
+DataBlockStore::const_iterator DataBlockStore::insert(const_iterator pos, DataBlock block) {
+    size_t i = pos.pos - base;
+    assert(i <= count);
+
+    if ( count == (slots ? mask + 1 : 0) )
+        Grow();
+
+    uint64_t seq = block.seq;
+
+    if ( i == 0 && count > 0 ) {
+        // Prepending only moves the head, everything else stays put.
+        head = (head - 1) & mask;
+        --base;
+        new (&At(0)) value_type(seq, std::move(block));
+        ++count;
+        return begin();
+    }
+
+    if ( i == count )
+        new (&At(count)) value_type(seq, std::move(block));
+    else {
+        // Make room by shifting the tail back by one.
+        new (&At(count)) value_type(std::move(At(count - 1)));
+
+        for ( size_t j = count - 1; j > i; --j )
+            At(j) = std::move(At(j - 1));
+
+        At(i) = value_type(seq, std::move(block));
+    }
+
+    ++count;
+    return {this, base + i};
+}
+
+DataBlock DataBlockStore::extract(const_iterator pos) {
+    size_t i = pos.pos - base;
+    assert(i < count);
+
+    DataBlock b = std::move(At(i).second);
+
+    if ( i == 0 ) {
+        At(0).~value_type();
+        head = (head + 1) & mask;
+        ++base;
+    }
+    else {
+        for ( size_t j = i; j + 1 < count; ++j )
+            At(j) = std::move(At(j + 1));
+
+        At(count - 1).~value_type();
+    }
+
+    --count;
+    return b;
+}
+
+void DataBlockStore::clear() {
+    for ( size_t i = 0; i < count; ++i )
+        At(i).~value_type();
+
+    base += count;
+    head = 0;
+    count = 0;
 }
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const {
@@ -42,10 +140,9 @@ void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* abo
 }
 
 void DataBlockList::Delete(DataBlockMap::const_iterator it) {
-    const auto& b = it->second;
-    auto size = b.Size();
+    auto size = it->second.Size();
 
-    block_map.erase(it);
+    block_map.extract(it);
     total_data_size -= size;
 
     Reassembler::total_size -= size + sizeof(DataBlock);
@@ -53,10 +150,9 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it) {
 }
 
 DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it) {
-    auto b = std::move(it->second);
+    auto b = block_map.extract(it);
     auto size = b.Size();
 
-    block_map.erase(it);
     total_data_size -= size;
 
     return b;
@@ -74,7 +170,7 @@ void DataBlockList::Clear() {
 void DataBlockList::Append(DataBlock block, uint64_t limit) {
     total_data_size += block.Size();
 
-    block_map.emplace_hint(block_map.end(), block.seq, std::move(block));
+    block_map.insert(block_map.end(), std::move(block));
 
     while ( block_map.size() > limit )
         Delete(block_map.begin());
@@ -96,7 +192,7 @@ DataBlockMap::const_iterator DataBlockList::FirstBlockAtOrBefore(uint64_t seq) c
 DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
                                                    DataBlockMap::const_iterator hint) {
     auto size = upper - seq;
-    auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
+    auto rval = block_map.insert(hint, DataBlock(data, size, seq));
 
     total_data_size += size;
     Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
@@ -111,10 +207,10 @@ DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper,
     if ( block_map.empty() )
         return Insert(seq, upper, data, block_map.end());
 
-    const auto& last = block_map.rbegin()->second;
+    const auto& last = block_map.back().second;
 
     // Special check for the common case of appending to the end.
-    if ( seq == last.upper )
+    if ( seq >= last.upper )
         return Insert(seq, upper, data, block_map.end());
 
     // Find the first block that doesn't come completely before the new data.
@@ -132,39 +228,43 @@ DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper,
     while ( std::next(it) != block_map.end() && it->second.upper <= seq )
         ++it;
 
-    const auto& b = it->second;
+    // Copy these, inserting invalidates references into the list.
+    const uint64_t b_seq = it->second.seq;
+    const uint64_t b_upper = it->second.upper;
 
-    if ( b.upper <= seq )
+    if ( b_upper <= seq )
         // b is the last block, and it comes completely before the new block.
         return Insert(seq, upper, data, block_map.end());
 
-    if ( upper <= b.seq )
+    if ( upper <= b_seq )
         // The new block comes completely before b.
         return Insert(seq, upper, data, it);
 
     DataBlockMap::const_iterator rval;
 
     // The blocks overlap.
-    if ( seq < b.seq ) {
+    if ( seq < b_seq ) {
         // The new block has a prefix that comes before b.
-        uint64_t prefix_len = b.seq - seq;
+        uint64_t prefix_len = b_seq - seq;
 
         rval = Insert(seq, seq + prefix_len, data, it);
 
+        // b now follows the prefix.
+        it = std::next(rval);
+
         data += prefix_len;
         seq += prefix_len;
     }
     else
         rval = it;
 
-    uint64_t overlap_start = seq;
-    uint64_t overlap_offset = overlap_start - b.seq;
     uint64_t new_b_len = upper - seq;
-    uint64_t b_len = b.upper - overlap_start;
+    uint64_t b_len = b_upper - seq;
     uint64_t overlap_len = min(new_b_len, b_len);
 
     if ( overlap_len < new_b_len ) {
-        // Recurse to resolve remainder of the new data.
+        // Recurse to resolve remainder of the new data. That only inserts
+        // behind b, so neither rval nor it move.
         data += overlap_len;
         seq += overlap_len;
 
@@ -292,7 +392,7 @@ void Reassembler::CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t
         uint64_t overlap_len = (nupper - nseq);
 
         if ( overlap_len )
-            Overlap(&b.block[overlap_offset], ndata, overlap_len);
+            Overlap(&b.Data()[overlap_offset], ndata, overlap_len);
     }
 }
 
@@ -349,4 +449,107 @@ void Reassembler::Undelivered(uint64_t up_to_seq) {
 
 uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype) { return Reassembler::sizes[rtype]; }
 
+TEST_SUITE_BEGIN("Reassem");
+
+namespace {
+
+class TestReassembler : public Reassembler {
+public:
+    TestReassembler() : Reassembler(0) {}
+
+    size_t NumBlocks() const { return block_list.NumBlocks(); }
+
+    std::string delivered;
+    uint64_t overlaps = 0;
+
+protected:
+    void BlockInserted(DataBlockMap::const_iterator it) override {
+        while ( it != block_list.End() ) {
+            const auto& b = it->second;
+
+            if ( b.seq > last_reassem_seq )
+                break;
+
+            if ( b.upper > last_reassem_seq ) {
+                auto skip = last_reassem_seq - b.seq;
+                delivered.append(reinterpret_cast<const char*>(b.Data()) + skip, b.Size() - skip);
+                last_reassem_seq = b.upper;
+            }
+
+            ++it;
+        }
+
+        TrimToSeq(last_reassem_seq);
+    }
+
+    void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override { ++overlaps; }
+};
+
+const u_char* bytes(const char* s) { return reinterpret_cast<const u_char*>(s); }
+
+} // namespace
+
+TEST_CASE("block store ordering and iterator stability") {
+    DataBlockStore store;
+    const u_char data[4] = {};
+
+    auto b = store.insert(store.end(), DataBlock(data, 2, 10));
+    store.insert(store.end(), DataBlock(data, 2, 20));
+
+    // Prepending and growing leave iterators alone.
+    store.insert(store.begin(), DataBlock(data, 2, 0));
+    for ( uint64_t seq = 30; seq < 300; seq += 10 )
+        store.insert(store.end(), DataBlock(data, 2, seq));
+
+    CHECK(b->first == 10);
+    CHECK(store.size() == 30);
+
+    // Fill a hole in the middle.
+    store.insert(store.upper_bound(15), DataBlock(data, 2, 15));
+    CHECK(std::next(store.upper_bound(12))->first == 20);
+
+    uint64_t prev = 0;
+    size_t n = 0;
+
+    for ( const auto& e : store ) {
+        CHECK(e.first == e.second.seq);
+        CHECK((n == 0 || e.first > prev));
+        prev = e.first;
+        ++n;
+    }
+
+    CHECK(n == 31);
+
+    auto last = std::prev(store.end());
+    CHECK(store.extract(store.begin()).seq == 0);
+    CHECK(last->first == 290);
+    CHECK(store.front().first == 10);
+
+    store.clear();
+    CHECK(store.empty());
+}
+
+TEST_CASE("reassembly of out-of-order and overlapping data") {
+    TestReassembler r;
+
+    r.NewBlock(0, 6, 3, bytes("ghi"));
+    r.NewBlock(0, 12, 2, bytes("mn"));
+    r.NewBlock(0, 3, 4, bytes("defg"));
+    CHECK(r.delivered.empty());
+    CHECK(r.overlaps == 1);
+    CHECK(r.NumBlocks() == 3);
+
+    // Covers the head, overlaps the first held block and fills part of the
+    // hole behind it.
+    r.NewBlock(0, 0, 11, bytes("abcdefghijk"));
+    CHECK(r.delivered == "abcdefghijk");
+    CHECK(r.NumBlocks() == 1);
+
+    r.NewBlock(0, 11, 1, bytes("l"));
+    CHECK(r.delivered == "abcdefghijklmn");
+    CHECK_FALSE(r.HasBlocks());
+}
+
+TEST_SUITE_END();
+
 } // namespace zeek
@@ -6,9 +6,11 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
-#include <map>
+#include <iterator>
+#include <utility>
 
 #include "zeek/Obj.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek {
 
@@ -28,71 +30,157 @@ class Reassembler;
 
 /**
  * A block/segment of data for use in the reassembly process.
+ *
+ * If the data belongs to the packet currently being processed, the block
+ * references the packet's buffer instead of copying it, see
+ * PacketDataRef.
  */
 class DataBlock {
 public:
     /**
      * Create a data block/segment with associated sequence numbering.
      */
-    DataBlock(const u_char* data, uint64_t size, uint64_t seq);
-
-    DataBlock(const DataBlock& other) {
-        seq = other.seq;
-        upper = other.upper;
-        auto size = other.Size();
-        block = new u_char[size];
-        memcpy(block, other.block, size);
-    }
+    DataBlock(const u_char* arg_data, uint64_t size, uint64_t arg_seq)
+        : seq(arg_seq), upper(arg_seq + size), data(arg_data, size) {}
 
-    DataBlock(DataBlock&& other) {
-        seq = other.seq;
-        upper = other.upper;
-        block = other.block;
-        other.block = nullptr;
-    }
+    /**
+     * @return length of the data block
+     */
+    uint64_t Size() const { return upper - seq; }
+
+    /**
+     * @return the block's data
+     */
+    const u_char* Data() const { return data.Data(); }
+
+    uint64_t seq;
+    uint64_t upper;
 
-    DataBlock& operator=(const DataBlock& other) {
-        if ( this == &other )
+private:
+    PacketDataRef data;
+};
+
+/**
+ * Ordered storage for the blocks of a DataBlockList.
+ *
+ * Blocks live in a single ring buffer sorted by sequence number, with a
+ * binary search for lookups. Reassembly mostly appends at the end and trims
+ * at the front, both of which are constant time here and, unlike with a
+ * balanced tree, need neither a node allocation nor rebalancing. Inserting
+ * at the front is constant time, too. Filling a hole in the middle shifts
+ * the blocks behind it.
+ *
+ * Iterators remain valid across appends, growing the buffer, and insertion
+ * or removal at the front. Inserting or removing elsewhere invalidates
+ * iterators to the blocks behind that position. References to elements are
+ * invalidated by any modification.
+ */
+class DataBlockStore {
+public:
+    using value_type = std::pair<uint64_t, DataBlock>;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = DataBlockStore::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return store->At(pos - store->base); }
+        pointer operator->() const { return &**this; }
+
+        const_iterator& operator++() {
+            ++pos;
             return *this;
+        }
 
-        seq = other.seq;
-        upper = other.upper;
-        auto size = other.Size();
-        delete[] block;
-        block = new u_char[size];
-        memcpy(block, other.block, size);
-        return *this;
-    }
+        const_iterator operator++(int) {
+            auto tmp = *this;
+            ++pos;
+            return tmp;
+        }
 
-    DataBlock& operator=(DataBlock&& other) {
-        if ( this == &other )
+        const_iterator& operator--() {
+            --pos;
             return *this;
+        }
 
-        seq = other.seq;
-        upper = other.upper;
-        delete[] block;
-        block = other.block;
-        other.block = nullptr;
-        return *this;
-    }
+        const_iterator operator--(int) {
+            auto tmp = *this;
+            --pos;
+            return tmp;
+        }
 
-    ~DataBlock() { delete[] block; }
+        bool operator==(const const_iterator& other) const { return pos == other.pos; }
+        bool operator!=(const const_iterator& other) const { return pos != other.pos; }
+
+    private:
+        friend class DataBlockStore;
+
+        const_iterator(const DataBlockStore* arg_store, uint64_t arg_pos) : store(arg_store), pos(arg_pos) {}
+
+        const DataBlockStore* store = nullptr;
+
+        // Position relative to the store's base. This wraps around when
+        // inserting at the front, which is fine since we only ever take
+        // differences.
+        uint64_t pos = 0;
+    };
+
+    DataBlockStore() = default;
+    ~DataBlockStore();
+
+    DataBlockStore(const DataBlockStore&) = delete;
+    DataBlockStore& operator=(const DataBlockStore&) = delete;
+
+    const_iterator begin() const { return {this, base}; }
+    const_iterator end() const { return {this, base + count}; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    const value_type& front() const { return At(0); }
+    const value_type& back() const { return At(count - 1); }
 
     /**
-     * @return length of the data block
+     * Returns an iterator to the first block starting above *seq*.
      */
-    uint64_t Size() const { return upper - seq; }
+    const_iterator upper_bound(uint64_t seq) const;
 
-    uint64_t seq;
-    uint64_t upper;
-    u_char* block;
+    /**
+     * Inserts a block in front of *pos*. The caller is responsible for
+     * keeping the blocks sorted.
+     */
+    const_iterator insert(const_iterator pos, DataBlock block);
+
+    /**
+     * Removes the block at *pos*, returning it.
+     */
+    DataBlock extract(const_iterator pos);
+
+    void clear();
+
+private:
+    value_type& At(size_t i) const { return slots[(head + i) & mask]; }
+
+    void Grow();
+
+    value_type* slots = nullptr;
+    size_t mask = 0; // capacity - 1, capacity is a power of two
+    size_t head = 0;
+    size_t count = 0;
+    uint64_t base = 0;
 };
 
-using DataBlockMap = std::map<uint64_t, DataBlock>;
+// The name stems from when blocks were stored in a std::map.
+using DataBlockMap = DataBlockStore;
 
 /**
  * The data structure used for reassembling arbitrary sequences of data
- * blocks/segments.  It internally uses an ordered map (std::map).
+ * blocks/segments.  It internally uses a DataBlockStore.
  */
 class DataBlockList {
 public:
@@ -118,7 +206,7 @@ public:
      */
     const DataBlock& FirstBlock() const {
         assert(block_map.size());
-        return block_map.begin()->second;
+        return block_map.front().second;
     }
 
     /**
@@ -127,7 +215,7 @@ public:
      */
     const DataBlock& LastBlock() const {
         assert(block_map.size());
-        return block_map.rbegin()->second;
+        return block_map.back().second;
     }
 
     /**
@@ -3,8 +3,15 @@
 
 #include "zeek/zeek-config.h"
 
+#include <unistd.h>
 #include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <functional>
+#include <iterator>
 
 #include "zeek/DFA.h"
 #include "zeek/DebugLogger.h"
@@ -15,6 +22,7 @@
 #include "zeek/IntSet.h"
 #include "zeek/IntrusivePtr.h"
 #include "zeek/NetVar.h"
+#include "zeek/PrefixTable.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleAction.h"
 #include "zeek/RuleCondition.h"
@@ -23,8 +31,13 @@
 #include "zeek/Var.h"
 #include "zeek/ZeekString.h"
 #include "zeek/analyzer/Analyzer.h"
+#include "zeek/digest.h"
 #include "zeek/module_util.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 // Functions exposed by rule-scan.l
@@ -52,6 +65,53 @@ static bool is_member_of(const int_list& l, int_list::value_type v) {
     return std::find(l.begin(), l.end(), v) != l.end();
 }
 
+// Evaluates the tests of a node's children in bulk. Equality tests on
+// header fields are grouped by field and laid out as parallel arrays of
+// masks and values, which get compared to the packet's field several at a
+// time. Equality tests on addresses go into prefix tries. All other tests
+// are evaluated one by one.
+class RuleHdrTestIndex {
+public:
+    // Nodes with fewer children aren't worth indexing.
+    static constexpr int MIN_CHILDREN = 8;
+
+    explicit RuleHdrTestIndex(RuleHdrTest* first_child);
+
+    RuleHdrTestIndex(const RuleHdrTestIndex&) = delete;
+    RuleHdrTestIndex& operator=(const RuleHdrTestIndex&) = delete;
+
+    // Appends the children matching the packet to *matches, in sibling
+    // order.
+    void Match(const IP_Hdr* ip, rule_hdr_test_list* matches) const;
+
+private:
+    struct ValueGroup {
+        RuleHdrTest::Prot prot;
+        uint32_t offset;
+        uint32_t size;
+
+        // Padded to a multiple of four with entries that never match.
+        std::vector<uint32_t> masks;
+        std::vector<uint32_t> vals;
+        std::vector<uint32_t> children; // indices into children below
+    };
+
+    struct PrefixIndex {
+        PrefixTable trie;                            // data is index into lists plus one
+        std::vector<std::vector<uint32_t>> children; // indices into children below
+    };
+
+    static void AddPrefixes(PrefixIndex* index, const RuleHdrTest* h, uint32_t child);
+    static void MatchValues(const ValueGroup& g, uint32_t v, std::vector<uint32_t>* hits);
+    static void MatchPrefixes(const PrefixIndex& index, const IPAddr& a, std::vector<uint32_t>* hits);
+
+    std::vector<RuleHdrTest*> children;
+    std::vector<ValueGroup> groups;
+    PrefixIndex src_prefixes;
+    PrefixIndex dst_prefixes;
+    std::vector<uint32_t> others; // evaluated one by one
+};
+
 RuleHdrTest::RuleHdrTest(Prot arg_prot, uint32_t arg_offset, uint32_t arg_size, Comp arg_comp,
                          maskedvalue_list* arg_vals) {
     prot = arg_prot;
@@ -61,6 +121,7 @@ RuleHdrTest::RuleHdrTest(Prot arg_prot, uint32_t arg_offset, uint32_t arg_size,
     vals = arg_vals;
     sibling = nullptr;
     child = nullptr;
+    child_index = nullptr;
     pattern_rules = nullptr;
     pure_rules = nullptr;
     ruleset = new IntSet;
@@ -77,6 +138,7 @@ RuleHdrTest::RuleHdrTest(Prot arg_prot, Comp arg_comp, vector<IPPrefix> arg_v) {
     prefix_vals = std::move(arg_v);
     sibling = nullptr;
     child = nullptr;
+    child_index = nullptr;
     pattern_rules = nullptr;
     pure_rules = nullptr;
     ruleset = new IntSet;
@@ -121,6 +183,7 @@ RuleHdrTest::RuleHdrTest(RuleHdrTest& h) {
 
     sibling = nullptr;
     child = nullptr;
+    child_index = nullptr;
     pattern_rules = nullptr;
     pure_rules = nullptr;
     ruleset = new IntSet;
@@ -141,6 +204,7 @@ RuleHdrTest::~RuleHdrTest() {
     }
 
     delete ruleset;
+    delete child_index;
 }
 
 bool RuleHdrTest::operator==(const RuleHdrTest& h) const {
@@ -328,6 +392,7 @@ bool RuleMatcher::ReadFiles(const std::vector<SignatureFile>& files) {
         return false;
 
     BuildRulesTree();
+    BuildHdrTestIndices(root);
 
     string_list exprs[Rule::TYPES];
     int_list ids[Rule::TYPES];
@@ -336,6 +401,156 @@ bool RuleMatcher::ReadFiles(const std::vector<SignatureFile>& files) {
     return ! parse_error;
 }
 
+namespace {
+
+constexpr char DFA_CACHE_MAGIC[] = "ZEEKDFA1";
+constexpr uint32_t DFA_CACHE_BYTE_ORDER = 0x01020304;
+
+} // namespace
+
+void RuleMatcher::CollectPatternSets(RuleHdrTest* hdr_test, std::vector<RuleHdrTest::PatternSet*>* sets) const {
+    for ( int i = 0; i < Rule::TYPES; ++i )
+        for ( const auto& set : hdr_test->psets[i] )
+            sets->push_back(set);
+
+    for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling )
+        CollectPatternSets(h, sets);
+}
+
+std::string RuleMatcher::PatternSetsHash(const std::vector<RuleHdrTest::PatternSet*>& sets) const {
+    std::string desc;
+
+    for ( const auto& set : sets ) {
+        for ( size_t i = 0; i < set->patterns.size(); ++i ) {
+            desc.append(set->patterns[i]);
+            desc.push_back('\0');
+            desc.append(std::to_string(set->ids[i]));
+            desc.push_back('\0');
+        }
+
+        desc.push_back('\n');
+    }
+
+    u_char digest[ZEEK_SHA256_DIGEST_LENGTH];
+    calculate_digest(Hash_SHA256, reinterpret_cast<const u_char*>(desc.data()), desc.size(), digest);
+    return {reinterpret_cast<const char*>(digest), sizeof(digest)};
+}
+
+bool RuleMatcher::LoadDFACache(const std::string& path) {
+    dfa_cache_path = path;
+
+    if ( path.empty() )
+        return false;
+
+    std::ifstream in(path, std::ios::binary);
+
+    if ( ! in )
+        return false;
+
+    std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+
+    std::vector<RuleHdrTest::PatternSet*> sets;
+    CollectPatternSets(root, &sets);
+
+    std::string header = DFA_CACHE_MAGIC;
+    header.append(reinterpret_cast<const char*>(&DFA_CACHE_BYTE_ORDER), sizeof(DFA_CACHE_BYTE_ORDER));
+    header.append(PatternSetsHash(sets));
+
+    uint32_t num_sets = sets.size();
+    header.append(reinterpret_cast<const char*>(&num_sets), sizeof(num_sets));
+
+    if ( data.compare(0, header.size(), header) != 0 ) {
+        DBG_LOG(DBG_RULES, "DFA cache %s doesn't match signatures, ignoring", path.c_str());
+        return false;
+    }
+
+    // Locate all blobs first, so that a truncated file doesn't leave us
+    // with some matchers restored and others not.
+    std::vector<std::pair<size_t, uint64_t>> blobs;
+    size_t pos = header.size();
+
+    for ( uint32_t i = 0; i < num_sets; ++i ) {
+        uint64_t len;
+
+        if ( data.size() - pos < sizeof(len) )
+            return false;
+
+        memcpy(&len, data.data() + pos, sizeof(len));
+        pos += sizeof(len);
+
+        if ( data.size() - pos < len )
+            return false;
+
+        blobs.emplace_back(pos, len);
+        pos += len;
+    }
+
+    bool ok = true;
+
+    for ( uint32_t i = 0; i < num_sets; ++i ) {
+        auto [offset, len] = blobs[i];
+
+        if ( ! sets[i]->re->DFA()->Restore(data.data() + offset, len) )
+            ok = false;
+    }
+
+    DBG_LOG(DBG_RULES, "loaded DFA cache %s%s", path.c_str(), ok ? "" : " partially");
+    return ok;
+}
+
+void RuleMatcher::SaveDFACache() const {
+    if ( dfa_cache_path.empty() )
+        return;
+
+    std::vector<RuleHdrTest::PatternSet*> sets;
+    CollectPatternSets(root, &sets);
+
+    std::string data = DFA_CACHE_MAGIC;
+    data.append(reinterpret_cast<const char*>(&DFA_CACHE_BYTE_ORDER), sizeof(DFA_CACHE_BYTE_ORDER));
+    data.append(PatternSetsHash(sets));
+
+    uint32_t num_sets = sets.size();
+    data.append(reinterpret_cast<const char*>(&num_sets), sizeof(num_sets));
+
+    std::string blob;
+
+    for ( const auto& set : sets ) {
+        blob.clear();
+        set->re->DFA()->Serialize(&blob);
+
+        uint64_t len = blob.size();
+        data.append(reinterpret_cast<const char*>(&len), sizeof(len));
+        data.append(blob);
+    }
+
+    // Write to a temporary file of our own first so that concurrent
+    // processes, like the workers of a cluster, never see a partial cache
+    // nor interleave their writes.
+    std::string tmp = dfa_cache_path + ".XXXXXX";
+    int fd = mkstemp(tmp.data());
+
+    if ( fd < 0 ) {
+        reporter->Warning("cannot create temporary signature DFA cache %s: %s", tmp.c_str(), strerror(errno));
+        return;
+    }
+
+    bool written = util::safe_write(fd, data.data(), data.size());
+
+    if ( close(fd) < 0 )
+        written = false;
+
+    if ( ! written ) {
+        reporter->Warning("cannot write signature DFA cache %s", tmp.c_str());
+        unlink(tmp.c_str());
+        return;
+    }
+
+    if ( rename(tmp.c_str(), dfa_cache_path.c_str()) < 0 ) {
+        reporter->Warning("cannot rename signature DFA cache to %s: %s", dfa_cache_path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+    }
+}
+
 void RuleMatcher::AddRule(Rule* rule) {
     if ( rules_by_id.find(rule->ID()) != rules_by_id.end() ) {
         rules_error("rule defined twice");
@@ -415,6 +630,18 @@ void RuleMatcher::InsertRuleIntoTree(Rule* r, int testnr, RuleHdrTest* dest, int
     InsertRuleIntoTree(r, testnr + 1, newtest, level + 1);
 }
 
+void RuleMatcher::BuildHdrTestIndices(RuleHdrTest* hdr_test) {
+    int num_children = 0;
+
+    for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling ) {
+        BuildHdrTestIndices(h);
+        ++num_children;
+    }
+
+    if ( num_children >= RuleHdrTestIndex::MIN_CHILDREN )
+        hdr_test->child_index = new RuleHdrTestIndex(hdr_test->child);
+}
+
 void RuleMatcher::BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids) {
     // For each type, get all patterns on this node.
     for ( Rule* r = hdr_test->pattern_rules; r; r = r->next ) {
@@ -585,6 +812,164 @@ static inline bool compare(const vector<IPPrefix>& prefixes, const IPAddr& a, Ru
     return false;
 }
 
+// Get the value of the header field a test looks at. Returns false if the
+// packet doesn't have that header.
+static inline bool hdr_value(RuleHdrTest::Prot prot, uint32_t offset, uint32_t size, const IP_Hdr* ip,
+                             uint32_t* v) {
+    switch ( prot ) {
+        case RuleHdrTest::NEXT: *v = ip->NextProto(); return true;
+
+        case RuleHdrTest::IP:
+            if ( ! ip->IP4_Hdr() )
+                return false;
+
+            *v = getval((const u_char*)ip->IP4_Hdr() + offset, size);
+            return true;
+
+        case RuleHdrTest::IPv6:
+            if ( ! ip->IP6_Hdr() )
+                return false;
+
+            *v = getval((const u_char*)ip->IP6_Hdr() + offset, size);
+            return true;
+
+        case RuleHdrTest::ICMP:
+        case RuleHdrTest::ICMPv6:
+        case RuleHdrTest::TCP:
+        case RuleHdrTest::UDP: *v = getval(ip->Payload() + offset, size); return true;
+
+        default: reporter->InternalError("unknown RuleHdrTest protocol type"); break;
+    }
+
+    return false;
+}
+
+bool RuleHdrTest::Matches(const IP_Hdr* ip) const {
+    switch ( prot ) {
+        case IPSrc: return compare(prefix_vals, ip->IPHeaderSrcAddr(), comp);
+
+        case IPDst: return compare(prefix_vals, ip->IPHeaderDstAddr(), comp);
+
+        default: break;
+    }
+
+    uint32_t v;
+    return hdr_value(prot, offset, size, ip, &v) && compare(*vals, v, comp);
+}
+
+RuleHdrTestIndex::RuleHdrTestIndex(RuleHdrTest* first_child) {
+    for ( RuleHdrTest* h = first_child; h; h = h->sibling ) {
+        auto idx = static_cast<uint32_t>(children.size());
+        children.push_back(h);
+
+        if ( h->comp != RuleHdrTest::EQ ) {
+            others.push_back(idx);
+            continue;
+        }
+
+        if ( h->prot == RuleHdrTest::IPSrc ) {
+            AddPrefixes(&src_prefixes, h, idx);
+            continue;
+        }
+
+        if ( h->prot == RuleHdrTest::IPDst ) {
+            AddPrefixes(&dst_prefixes, h, idx);
+            continue;
+        }
+
+        auto g = std::find_if(groups.begin(), groups.end(), [h](const ValueGroup& g) {
+            return g.prot == h->prot && g.offset == h->offset && g.size == h->size;
+        });
+
+        if ( g == groups.end() ) {
+            groups.push_back({h->prot, h->offset, h->size, {}, {}, {}});
+            g = groups.end() - 1;
+        }
+
+        for ( const auto& mval : *h->vals ) {
+            g->masks.push_back(mval->mask);
+            g->vals.push_back(mval->val);
+            g->children.push_back(idx);
+        }
+    }
+
+    for ( auto& g : groups ) {
+        while ( g.vals.size() % 4 != 0 ) {
+            g.masks.push_back(0);
+            g.vals.push_back(1);
+            g.children.push_back(0);
+        }
+    }
+}
+
+void RuleHdrTestIndex::AddPrefixes(PrefixIndex* index, const RuleHdrTest* h, uint32_t child) {
+    for ( const auto& p : h->prefix_vals ) {
+        auto list = reinterpret_cast<uintptr_t>(index->trie.Lookup(p.Prefix(), p.LengthIPv6(), true));
+
+        if ( ! list ) {
+            index->children.emplace_back();
+            list = index->children.size();
+            index->trie.Insert(p.Prefix(), p.LengthIPv6(), reinterpret_cast<void*>(list));
+        }
+
+        index->children[list - 1].push_back(child);
+    }
+}
+
+void RuleHdrTestIndex::MatchValues(const ValueGroup& g, uint32_t v, std::vector<uint32_t>* hits) {
+#ifdef __SSE2__
+    __m128i value = _mm_set1_epi32(static_cast<int>(v));
+
+    for ( size_t i = 0; i < g.vals.size(); i += 4 ) {
+        __m128i masks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&g.masks[i]));
+        __m128i vals = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&g.vals[i]));
+        __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(value, masks), vals);
+
+        for ( int bits = _mm_movemask_ps(_mm_castsi128_ps(eq)); bits; bits &= bits - 1 )
+            hits->push_back(g.children[i + __builtin_ctz(bits)]);
+    }
+#else
+    for ( size_t i = 0; i < g.vals.size(); ++i )
+        if ( (v & g.masks[i]) == g.vals[i] )
+            hits->push_back(g.children[i]);
+#endif
+}
+
+void RuleHdrTestIndex::MatchPrefixes(const PrefixIndex& index, const IPAddr& a, std::vector<uint32_t>* hits) {
+    if ( index.children.empty() )
+        return;
+
+    for ( const auto& [prefix, data] : index.trie.FindAll(a, 128) ) {
+        const auto& list = index.children[reinterpret_cast<uintptr_t>(data) - 1];
+        hits->insert(hits->end(), list.begin(), list.end());
+    }
+}
+
+void RuleHdrTestIndex::Match(const IP_Hdr* ip, rule_hdr_test_list* matches) const {
+    std::vector<uint32_t> hits;
+
+    for ( const auto& g : groups ) {
+        uint32_t v;
+
+        if ( hdr_value(g.prot, g.offset, g.size, ip, &v) )
+            MatchValues(g, v, &hits);
+    }
+
+    MatchPrefixes(src_prefixes, ip->IPHeaderSrcAddr(), &hits);
+    MatchPrefixes(dst_prefixes, ip->IPHeaderDstAddr(), &hits);
+
+    for ( auto idx : others )
+        if ( children[idx]->Matches(ip) )
+            hits.push_back(idx);
+
+    // Children with several values may have matched more than once.
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+
+    for ( auto idx : hits )
+        matches->push_back(children[idx]);
+}
+
 RuleFileMagicState* RuleMatcher::InitFileMagic() const {
     RuleFileMagicState* state = new RuleFileMagicState();
 
@@ -727,43 +1112,12 @@ RuleEndpointState* RuleMatcher::InitEndpoint(analyzer::Analyzer* analyzer, const
 
         if ( ip ) {
             // Descend the RuleHdrTest tree further.
-            for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling ) {
-                bool match = false;
-
-                // Evaluate the header test.
-                switch ( h->prot ) {
-                    case RuleHdrTest::NEXT: match = compare(*h->vals, ip->NextProto(), h->comp); break;
-
-                    case RuleHdrTest::IP:
-                        if ( ! ip->IP4_Hdr() )
-                            continue;
-
-                        match = compare(*h->vals, getval((const u_char*)ip->IP4_Hdr() + h->offset, h->size), h->comp);
-                        break;
-
-                    case RuleHdrTest::IPv6:
-                        if ( ! ip->IP6_Hdr() )
-                            continue;
-
-                        match = compare(*h->vals, getval((const u_char*)ip->IP6_Hdr() + h->offset, h->size), h->comp);
-                        break;
-
-                    case RuleHdrTest::ICMP:
-                    case RuleHdrTest::ICMPv6:
-                    case RuleHdrTest::TCP:
-                    case RuleHdrTest::UDP:
-                        match = compare(*h->vals, getval(ip->Payload() + h->offset, h->size), h->comp);
-                        break;
-
-                    case RuleHdrTest::IPSrc: match = compare(h->prefix_vals, ip->IPHeaderSrcAddr(), h->comp); break;
-
-                    case RuleHdrTest::IPDst: match = compare(h->prefix_vals, ip->IPHeaderDstAddr(), h->comp); break;
-
-                    default: reporter->InternalError("unknown RuleHdrTest protocol type"); break;
-                }
-
-                if ( match )
-                    tests.push_back(h);
+            if ( hdr_test->child_index )
+                hdr_test->child_index->Match(ip, &tests);
+            else {
+                for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling )
+                    if ( h->Matches(ip) )
+                        tests.push_back(h);
             }
         }
     }
@@ -1078,6 +1432,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test) const {
         stats->mem = 0;
         stats->hits = 0;
         stats->misses = 0;
+        stats->evictions = 0;
         stats->nfa_states = 0;
         hdr_test = root;
     }
@@ -1096,6 +1451,7 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test) const {
             stats->mem += cstats.mem;
             stats->hits += cstats.hits;
             stats->misses += cstats.misses;
+            stats->evictions += cstats.evictions;
             stats->nfa_states += cstats.nfa_states;
         }
     }
@@ -47,6 +47,7 @@ namespace detail {
 class RE_Match_State;
 class Specific_RE_Matcher;
 class RuleMatcher;
+class RuleHdrTestIndex;
 class IntSet;
 
 extern RuleMatcher* rule_matcher;
@@ -96,6 +97,9 @@ private:
     // Likewise, the operator== checks only for same test semantics.
     bool operator==(const RuleHdrTest& h) const;
 
+    // Evaluates the test against a packet's headers.
+    bool Matches(const IP_Hdr* ip) const;
+
     Prot prot;
     Comp comp;
     maskedvalue_list* vals;
@@ -109,6 +113,7 @@ private:
 
     // The following are all set by RuleMatcher::BuildRulesTree().
     friend class RuleMatcher;
+    friend class RuleHdrTestIndex;
 
     struct PatternSet {
         PatternSet() : re() {}
@@ -136,6 +141,10 @@ private:
 
     RuleHdrTest* sibling; // linkage within HdrTest tree
     RuleHdrTest* child;
+
+    // Flattened form of the children's tests for nodes with many
+    // children, or nil. See RuleMatcher::BuildHdrTestIndices().
+    RuleHdrTestIndex* child_index;
 };
 
 using rule_hdr_test_list = PList<RuleHdrTest>;
@@ -255,6 +264,17 @@ public:
     // Parse the given files and built up data structures.
     bool ReadFiles(const std::vector<SignatureFile>& files);
 
+    // Warms up the pattern matchers' DFAs with states computed by an
+    // earlier run with the same signatures, as saved by SaveDFACache().
+    // Also remembers the path for saving. Returns false if the file
+    // doesn't exist or doesn't match the loaded signatures, which is not
+    // an error.
+    bool LoadDFACache(const std::string& path);
+
+    // Writes the DFA states computed so far to the file passed to
+    // LoadDFACache(), if any.
+    void SaveDFACache() const;
+
     /**
      * Initialize a state object for matching file magic signatures.
      * @return A state object that can be used for file magic mime type
@@ -332,6 +352,9 @@ public:
         // # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
         unsigned int hits;
         unsigned int misses; // # cache misses
+
+        // # DFA states evicted to stay within max_dfa_cache_size
+        unsigned int evictions;
     };
 
     Val* BuildRuleStateValue(const Rule* rule, const RuleEndpointState* state) const;
@@ -349,6 +372,9 @@ private:
     // Insert one rule into the current tree.
     void InsertRuleIntoTree(Rule* r, int testnr, RuleHdrTest* dest, int level);
 
+    // Traverse tree building indices for nodes with many children.
+    void BuildHdrTestIndices(RuleHdrTest* hdr_test);
+
     // Traverse tree building the combined regular expressions.
     void BuildRegEx(RuleHdrTest* hdr_test, string_list* exprs, int_list* ids);
 
@@ -379,12 +405,20 @@ private:
 
     static bool AllRulePatternsMatched(const Rule* r, MatchPos matchpos, const AcceptingMatchSet& ams);
 
+    // Returns all pattern sets in a fixed order.
+    void CollectPatternSets(RuleHdrTest* hdr_test, std::vector<RuleHdrTest::PatternSet*>* sets) const;
+
+    // Returns a hash identifying the signatures' patterns, for keying the
+    // DFA cache.
+    std::string PatternSetsHash(const std::vector<RuleHdrTest::PatternSet*>& sets) const;
+
     int RE_level;
     bool has_non_file_magic_rule;
     bool parse_error;
     RuleHdrTest* root;
     rule_list rules;
     rule_dict rules_by_id;
+    std::string dfa_cache_path;
 };
 
 // Keeps bi-directional matching-state.
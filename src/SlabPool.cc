@@ -0,0 +1,98 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/SlabPool.h"
+
+#include <cstring>
+#include <new>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+SlabPool& SlabPool::Instance() {
+    // Deliberately never destroyed: buffers held by other statics may get
+    // freed during shutdown after this would have gone away.
+    static SlabPool* pool = new SlabPool();
+    return *pool;
+}
+
+size_t SlabPool::SizeClass(size_t n) {
+    size_t c = 0;
+    size_t chunk = MIN_CHUNK_SIZE;
+
+    while ( chunk < n ) {
+        chunk <<= 1;
+        ++c;
+    }
+
+    return c;
+}
+
+void* SlabPool::DoAllocate(size_t n) {
+    if ( n > MAX_CHUNK_SIZE )
+        return ::operator new(n);
+
+    auto c = SizeClass(n);
+
+    if ( ! free_lists[c] ) {
+        // Carve a new slab into chunks of this class.
+        size_t chunk = MIN_CHUNK_SIZE << c;
+        auto slab = static_cast<char*>(::operator new(SLAB_SIZE));
+        slabs.push_back(slab);
+
+        for ( size_t off = SLAB_SIZE; off >= chunk; off -= chunk ) {
+            auto f = reinterpret_cast<FreeChunk*>(slab + off - chunk);
+            f->next = free_lists[c];
+            free_lists[c] = f;
+        }
+    }
+
+    auto f = free_lists[c];
+    free_lists[c] = f->next;
+    return f;
+}
+
+void SlabPool::DoFree(void* p, size_t n) {
+    if ( ! p )
+        return;
+
+    if ( n > MAX_CHUNK_SIZE ) {
+        ::operator delete(p);
+        return;
+    }
+
+    auto c = SizeClass(n);
+    auto f = static_cast<FreeChunk*>(p);
+    f->next = free_lists[c];
+    free_lists[c] = f;
+}
+
+TEST_SUITE_BEGIN("SlabPool");
+
+TEST_CASE("slab pool reuses chunks of the same class") {
+    auto a = SlabPool::Allocate(100);
+    memset(a, 'a', 100);
+    SlabPool::Free(a, 100);
+
+    // 100 and 128 bytes share a size class, 129 doesn't.
+    auto b = SlabPool::Allocate(128);
+    CHECK(a == b);
+
+    auto c = SlabPool::Allocate(129);
+    CHECK(c != b);
+
+    SlabPool::Free(b, 128);
+    SlabPool::Free(c, 129);
+}
+
+TEST_CASE("slab pool passes large requests through") {
+    auto slab_bytes = SlabPool::SlabBytes();
+    auto p = SlabPool::Allocate(SlabPool::MAX_CHUNK_SIZE + 1);
+    memset(p, 0, SlabPool::MAX_CHUNK_SIZE + 1);
+    CHECK(SlabPool::SlabBytes() == slab_bytes);
+    SlabPool::Free(p, SlabPool::MAX_CHUNK_SIZE + 1);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
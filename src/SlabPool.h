@@ -0,0 +1,62 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zeek::detail {
+
+/**
+ * Allocator for short-lived byte buffers, such as reassembly segments.
+ *
+ * Requests up to MAX_CHUNK_SIZE bytes are rounded up to one of a few
+ * power-of-two size classes and carved out of larger slabs. Freed chunks go
+ * onto a per-class free list and get reused by the next request of the same
+ * class, so steady-state traffic doesn't hit the system allocator at all.
+ * Larger requests are passed through to operator new.
+ *
+ * Slabs are kept for the lifetime of the process. The pool is only used by
+ * the main thread and isn't thread-safe.
+ */
+class SlabPool {
+public:
+    static constexpr size_t MIN_CHUNK_SIZE = 64;
+    static constexpr size_t MAX_CHUNK_SIZE = 2048;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    /**
+     * Returns a buffer of at least *n* bytes. *n* must be non-zero.
+     */
+    static void* Allocate(size_t n) { return Instance().DoAllocate(n); }
+
+    /**
+     * Returns a buffer to the pool. *n* must be the size it was allocated
+     * with.
+     */
+    static void Free(void* p, size_t n) { Instance().DoFree(p, n); }
+
+    /**
+     * Returns the number of bytes held in slabs, whether in use or not.
+     */
+    static uint64_t SlabBytes() { return Instance().slabs.size() * SLAB_SIZE; }
+
+private:
+    static constexpr size_t NUM_CLASSES = 6; // 64 .. 2048
+
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+
+    static SlabPool& Instance();
+
+    static size_t SizeClass(size_t n);
+    void* DoAllocate(size_t n);
+    void DoFree(void* p, size_t n);
+
+    FreeChunk* free_lists[NUM_CLASSES] = {};
+    std::vector<char*> slabs;
+};
+
+} // namespace zeek::detail
@@ -195,10 +195,12 @@ void ProfileLogger::Log() {
         threading::MsgThread::Stats s = i->second;
         file->Write(util::fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
                               " (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+                              " (#queue full: in=%" PRIu64 " out=%" PRIu64 ")"
                               "\n",
                               run_state::network_time, i->first.c_str(), s.sent_in, s.sent_out, s.pending_in,
                               s.pending_out, s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-                              s.queue_out_stats.num_reads, s.queue_out_stats.num_writes));
+                              s.queue_out_stats.num_reads, s.queue_out_stats.num_writes, s.queue_in_stats.num_full,
+                              s.queue_out_stats.num_full));
     }
 
     auto cs = broker_mgr->GetStatistics();
@@ -99,6 +99,9 @@ void TimerMgr::InitPostScript() {
 
     dispatch_all_expired = zeek::detail::max_timer_expires == 0;
 
+    if ( zeek::detail::use_timer_wheel )
+        UseTimerWheel(zeek::detail::timer_wheel_resolution);
+
     cumulative_num_metric =
         telemetry_mgr->CounterInstance("zeek", "timers", {}, "Cumulative number of timers", "",
                                        []() { return static_cast<double>(timer_mgr->CumulativeNum()); });
@@ -116,13 +119,28 @@ void TimerMgr::InitPostScript() {
     }
 }
 
+void TimerMgr::UseTimerWheel(double resolution) {
+    if ( wheel )
+        return;
+
+    if ( resolution <= 0.0 )
+        reporter->FatalError("timer_wheel_resolution must be positive");
+
+    wheel = std::make_unique<TimerWheel>(resolution);
+
+    while ( auto* timer = q->Remove() )
+        wheel->Add(timer);
+
+    q.reset();
+}
+
 void TimerMgr::Add(Timer* timer) {
     DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f", timer_type_to_string(timer->Type()), timer, timer->Time());
 
     // Add the timer even if it's already expired - that way, if
     // multiple already-added timers are added, they'll still
     // execute in sorted order.
-    if ( ! q->Add(timer) )
+    if ( ! (wheel ? wheel->Add(timer) : q->Add(timer)) )
         reporter->InternalError("out of memory");
 
     ++current_timers[timer->Type()];
@@ -139,6 +157,9 @@ void TimerMgr::Expire() {
 }
 
 int TimerMgr::DoAdvance(double new_t, int max_expire) {
+    if ( wheel )
+        wheel->Advance(new_t);
+
     Timer* timer = Top();
     for ( num_expired = 0; (num_expired < max_expire || dispatch_all_expired) && timer && timer->Time() <= new_t;
           ++num_expired ) {
@@ -161,7 +182,7 @@ int TimerMgr::DoAdvance(double new_t, int max_expire) {
 }
 
 void TimerMgr::Remove(Timer* timer) {
-    if ( ! q->Remove(timer) )
+    if ( ! (wheel ? wheel->Remove(timer) : q->Remove(timer)) )
         reporter->InternalError("asked to remove a missing timer");
 
     --current_timers[timer->Type()];
@@ -169,6 +190,11 @@ void TimerMgr::Remove(Timer* timer) {
 }
 
 double TimerMgr::GetNextTimeout() {
+    if ( wheel ) {
+        double next = wheel->NextTime();
+        return next < 0 ? -1 : std::max(0.0, next - run_state::network_time);
+    }
+
     Timer* top = Top();
     if ( top )
         return std::max(0.0, top->Time() - run_state::network_time);
@@ -176,8 +202,8 @@ double TimerMgr::GetNextTimeout() {
     return -1;
 }
 
-Timer* TimerMgr::Remove() { return (Timer*)q->Remove(); }
+Timer* TimerMgr::Remove() { return (Timer*)(wheel ? wheel->Remove() : q->Remove()); }
 
-Timer* TimerMgr::Top() { return (Timer*)q->Top(); }
+Timer* TimerMgr::Top() { return (Timer*)(wheel ? wheel->Top() : q->Top()); }
 
 } // namespace zeek::detail
@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "zeek/PriorityQueue.h"
+#include "zeek/TimerWheel.h"
 #include "zeek/iosource/IOSource.h"
 
 namespace zeek {
@@ -121,9 +122,9 @@ public:
 
     double Time() const { return t ? t : 1; } // 1 > 0
 
-    size_t Size() const { return q->Size(); }
-    size_t PeakSize() const { return q->PeakSize(); }
-    size_t CumulativeNum() const { return q->CumulativeNum(); }
+    size_t Size() const { return wheel ? wheel->Size() : q->Size(); }
+    size_t PeakSize() const { return wheel ? wheel->PeakSize() : q->PeakSize(); }
+    size_t CumulativeNum() const { return wheel ? wheel->CumulativeNum() : q->CumulativeNum(); }
 
     double LastTimestamp() const { return last_timestamp; }
 
@@ -145,6 +146,15 @@ public:
      */
     void InitPostScript();
 
+    /**
+     * Switches the manager from its default binary heap to a hierarchical
+     * timing wheel with the given tick resolution. Pending timers move
+     * over to the wheel.
+     *
+     * @param resolution the length of a tick of the wheel, in seconds.
+     */
+    void UseTimerWheel(double resolution);
+
 private:
     int DoAdvance(double t, int max_expire);
     void Remove(Timer* timer);
@@ -167,7 +177,9 @@ private:
     telemetry::GaugePtr lag_time_metric;
     telemetry::GaugePtr current_timer_metrics[NUM_TIMER_TYPES];
 
+    // Exactly one of these holds the pending timers.
     std::unique_ptr<PriorityQueue> q;
+    std::unique_ptr<TimerWheel> wheel;
 };
 
 extern TimerMgr* timer_mgr;
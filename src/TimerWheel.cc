@@ -0,0 +1,337 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TimerWheel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Both require v to be non-zero.
+inline int highest_bit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int i = 0;
+    while ( v >>= 1 )
+        ++i;
+    return i;
+#endif
+}
+
+inline int lowest_bit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(v);
+#else
+    int i = 0;
+    while ( ! (v & 1) ) {
+        v >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+} // namespace
+
+TimerWheel::TimerWheel(double arg_resolution) : resolution(arg_resolution) {}
+
+TimerWheel::~TimerWheel() {
+    for ( auto& b : buckets )
+        for ( auto* e : b )
+            delete e;
+}
+
+int64_t TimerWheel::ToTick(double t) const {
+    double tick = std::floor(t / resolution);
+
+    if ( ! (tick > 0) )
+        return 0;
+
+    // Keep far-out times (including infinity) representable, they all end
+    // up in the overflow bucket anyway.
+    if ( tick >= static_cast<double>(INT64_MAX / 2) )
+        return INT64_MAX / 2;
+
+    return static_cast<int64_t>(tick);
+}
+
+void TimerWheel::Insert(PQ_Element* e, int64_t tick) {
+    if ( tick <= current_tick ) {
+        e->SetBucket(READY_BUCKET);
+        ready.Add(e);
+        return;
+    }
+
+    // The level is determined by the most significant bit in which the
+    // tick differs from the current one.
+    int level = highest_bit(static_cast<uint64_t>(tick ^ current_tick)) / LEVEL_BITS;
+    int bucket;
+
+    if ( level < NUM_LEVELS ) {
+        int slot = (tick >> (level * LEVEL_BITS)) & (SLOTS_PER_LEVEL - 1);
+        bucket = level * SLOTS_PER_LEVEL + slot;
+        occupied[level] |= uint64_t(1) << slot;
+    }
+    else {
+        bucket = OVERFLOW_BUCKET;
+        overflow_min_tick = std::min(overflow_min_tick, tick);
+    }
+
+    auto& b = buckets[bucket];
+    e->SetBucket(bucket);
+    e->SetOffset(static_cast<int>(b.size()));
+    b.push_back(e);
+    ++num_pending;
+}
+
+void TimerWheel::Unlink(PQ_Element* e) {
+    int bucket = e->Bucket();
+    auto& b = buckets[bucket];
+
+    // Elements within a bucket aren't ordered, so fill the gap with the
+    // last one.
+    PQ_Element* last = b.back();
+    last->SetOffset(e->Offset());
+    b[e->Offset()] = last;
+    b.pop_back();
+
+    if ( b.empty() && bucket != OVERFLOW_BUCKET )
+        occupied[bucket / SLOTS_PER_LEVEL] &= ~(uint64_t(1) << (bucket % SLOTS_PER_LEVEL));
+
+    e->SetBucket(READY_BUCKET);
+    e->SetOffset(-1);
+    --num_pending;
+}
+
+bool TimerWheel::Add(PQ_Element* e) {
+    Insert(e, ToTick(e->Time()));
+
+    ++cumulative_num;
+
+    if ( Size() > peak_size )
+        peak_size = Size();
+
+    return true;
+}
+
+PQ_Element* TimerWheel::Remove(PQ_Element* e) {
+    int bucket = e->Bucket();
+
+    if ( bucket == READY_BUCKET )
+        return ready.Remove(e);
+
+    if ( bucket < 0 || bucket > OVERFLOW_BUCKET )
+        return nullptr;
+
+    const auto& b = buckets[bucket];
+    if ( e->Offset() < 0 || e->Offset() >= static_cast<int>(b.size()) || b[e->Offset()] != e )
+        return nullptr; // not in wheel
+
+    Unlink(e);
+    return e;
+}
+
+PQ_Element* TimerWheel::Remove() {
+    while ( ready.Size() == 0 && Step(INT64_MAX) )
+        ;
+
+    return ready.Remove();
+}
+
+bool TimerWheel::NextEvent(int64_t* tick, int* bucket) const {
+    // Elements of a level all lie beyond the current slot of that level,
+    // and anything in a lower level comes before anything in a higher one.
+    for ( int level = 0; level < NUM_LEVELS; ++level ) {
+        int shift = level * LEVEL_BITS;
+        int current_slot = (current_tick >> shift) & (SLOTS_PER_LEVEL - 1);
+
+        if ( current_slot == SLOTS_PER_LEVEL - 1 )
+            continue;
+
+        uint64_t later = occupied[level] & (~uint64_t(0) << (current_slot + 1));
+
+        if ( ! later )
+            continue;
+
+        int slot = lowest_bit(later);
+        int64_t base = (current_tick >> (shift + LEVEL_BITS)) << (shift + LEVEL_BITS);
+        *tick = base | (static_cast<int64_t>(slot) << shift);
+        *bucket = level * SLOTS_PER_LEVEL + slot;
+        return true;
+    }
+
+    if ( buckets[OVERFLOW_BUCKET].empty() )
+        return false;
+
+    constexpr int span = NUM_LEVELS * LEVEL_BITS;
+    *tick = std::max(current_tick + 1, (overflow_min_tick >> span) << span);
+    *bucket = OVERFLOW_BUCKET;
+    return true;
+}
+
+bool TimerWheel::Step(int64_t limit) {
+    int64_t tick;
+    int bucket;
+
+    if ( ! NextEvent(&tick, &bucket) || tick > limit )
+        return false;
+
+    current_tick = tick;
+
+    std::vector<PQ_Element*> elements;
+    elements.swap(buckets[bucket]);
+    num_pending -= static_cast<int>(elements.size());
+
+    if ( bucket == OVERFLOW_BUCKET )
+        overflow_min_tick = INT64_MAX;
+    else
+        occupied[bucket / SLOTS_PER_LEVEL] &= ~(uint64_t(1) << (bucket % SLOTS_PER_LEVEL));
+
+    // Relative to the new current tick, the elements either are due now or
+    // belong into a lower level.
+    for ( auto* e : elements )
+        Insert(e, ToTick(e->Time()));
+
+    // Hand the vector's memory back to the bucket unless it got refilled.
+    if ( buckets[bucket].empty() ) {
+        elements.clear();
+        buckets[bucket].swap(elements);
+    }
+
+    return true;
+}
+
+void TimerWheel::Advance(double t) {
+    int64_t target = ToTick(t);
+
+    if ( target <= current_tick )
+        return;
+
+    while ( Step(target) )
+        ;
+
+    current_tick = target;
+}
+
+double TimerWheel::NextTime() const {
+    if ( const auto* top = ready.Top() )
+        return top->Time();
+
+    int64_t tick;
+    int bucket;
+
+    if ( NextEvent(&tick, &bucket) )
+        return static_cast<double>(tick) * resolution;
+
+    return -1.0;
+}
+
+TEST_SUITE_BEGIN("TimerWheel");
+
+namespace {
+
+class TestElement : public PQ_Element {
+public:
+    explicit TestElement(double t) : PQ_Element(t) {}
+};
+
+} // namespace
+
+TEST_CASE("timer wheel ordering") {
+    TimerWheel wheel(0.001);
+    std::vector<double> times = {1000.5, 1000.0005, 1000.0, 1060.0, 1000.5, 5000.0, 1000.25, 1e9};
+
+    for ( double t : times )
+        wheel.Add(new TestElement(t));
+
+    CHECK(wheel.Size() == static_cast<int>(times.size()));
+    CHECK(wheel.CumulativeNum() == times.size());
+
+    // Nothing is due before the first advance past a pending time.
+    CHECK(wheel.Top() == nullptr);
+    CHECK(wheel.NextTime() <= 1000.0);
+
+    wheel.Advance(1000.3);
+    std::vector<double> due;
+    while ( wheel.Top() && wheel.Top()->Time() <= 1000.3 ) {
+        auto* e = wheel.Remove();
+        due.push_back(e->Time());
+        delete e;
+    }
+
+    CHECK(due == std::vector<double>{1000.0, 1000.0005, 1000.25});
+
+    // The remaining ones come out in order as well.
+    std::sort(times.begin(), times.end());
+    for ( size_t i = 3; i < times.size(); ++i ) {
+        auto* e = wheel.Remove();
+        REQUIRE(e != nullptr);
+        CHECK(e->Time() == times[i]);
+        delete e;
+    }
+
+    CHECK(wheel.Remove() == nullptr);
+    CHECK(wheel.Size() == 0);
+    CHECK(wheel.PeakSize() == static_cast<int>(times.size()));
+    CHECK(wheel.NextTime() < 0);
+}
+
+TEST_CASE("timer wheel cancel and advance") {
+    TimerWheel wheel(0.01);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> delay(0.0, 500.0);
+
+    std::vector<TestElement*> elements;
+    for ( int i = 0; i < 5000; ++i ) {
+        auto* e = new TestElement(100.0 + delay(rng));
+        elements.push_back(e);
+        CHECK(wheel.Add(e));
+    }
+
+    // Cancel every third element.
+    std::vector<double> expected;
+    for ( size_t i = 0; i < elements.size(); ++i ) {
+        if ( i % 3 == 0 ) {
+            CHECK(wheel.Remove(elements[i]) == elements[i]);
+            CHECK(wheel.Remove(elements[i]) == nullptr);
+            delete elements[i];
+        }
+        else
+            expected.push_back(elements[i]->Time());
+    }
+
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<double> dispatched;
+    for ( double now = 100.0; now <= 700.0; now += 0.37 ) {
+        wheel.Advance(now);
+
+        while ( wheel.Top() && wheel.Top()->Time() <= now ) {
+            auto* e = wheel.Remove();
+            dispatched.push_back(e->Time());
+            delete e;
+        }
+
+        // Timers added at or before the current time are due right away.
+        if ( dispatched.size() == 100 ) {
+            auto* e = new TestElement(now - 1.0);
+            wheel.Add(e);
+            CHECK(wheel.Top() == e);
+            CHECK(wheel.Remove(e) == e);
+            delete e;
+        }
+    }
+
+    CHECK(dispatched == expected);
+    CHECK(wheel.Size() == 0);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
@@ -0,0 +1,119 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "zeek/PriorityQueue.h"
+
+namespace zeek::detail {
+
+/**
+ * A hierarchical timing wheel ordering PQ_Elements by time.
+ *
+ * Time is divided into ticks of a fixed resolution. Elements due in a future
+ * tick live unsorted in the slots of NUM_LEVELS wheels of SLOTS_PER_LEVEL
+ * slots each, where the slots of each level span SLOTS_PER_LEVEL times as
+ * many ticks as those of the level below. Adding and removing such elements
+ * takes constant time. As the wheel advances, slots of higher levels get
+ * redistributed into the lower ones, and the elements of the current tick
+ * move into a small priority queue. That queue, and thus Top() and Remove(),
+ * returns elements in exact time order.
+ *
+ * Elements keep their position in Offset() and Bucket().
+ */
+class TimerWheel {
+public:
+    static constexpr int LEVEL_BITS = 6;
+    static constexpr int SLOTS_PER_LEVEL = 1 << LEVEL_BITS;
+    static constexpr int NUM_LEVELS = 6;
+
+    /**
+     * @param resolution The length of a tick, in seconds.
+     */
+    explicit TimerWheel(double resolution);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * Moves all elements due at or before time t into the ready queue, so
+     * that Top() considers them.
+     */
+    void Advance(double t);
+
+    /**
+     * Returns the earliest element that's due as of the most recent
+     * Advance(), or nil if none. The wheel may hold later elements.
+     */
+    PQ_Element* Top() const { return ready.Top(); }
+
+    /**
+     * Removes and returns the earliest element, advancing the wheel past
+     * the current time if necessary. Returns nil if the wheel is empty.
+     */
+    PQ_Element* Remove();
+
+    /**
+     * Removes element e. Returns e, or nullptr if e wasn't in the wheel.
+     */
+    PQ_Element* Remove(PQ_Element* e);
+
+    /**
+     * Adds a new element. Elements at or before the current time go
+     * straight into the ready queue.
+     */
+    bool Add(PQ_Element* e);
+
+    /**
+     * Returns a lower bound for the time of the earliest element, or a
+     * negative value if the wheel is empty. If an element is ready, this is
+     * its exact time.
+     */
+    double NextTime() const;
+
+    int Size() const { return num_pending + ready.Size(); }
+    int PeakSize() const { return peak_size; }
+    uint64_t CumulativeNum() const { return cumulative_num; }
+
+private:
+    // Bucket() of elements in the ready queue.
+    static constexpr int READY_BUCKET = -1;
+    // Bucket() of elements beyond the range of the highest level.
+    static constexpr int OVERFLOW_BUCKET = NUM_LEVELS * SLOTS_PER_LEVEL;
+
+    int64_t ToTick(double t) const;
+
+    // Puts an element into the bucket matching its tick relative to the
+    // current tick.
+    void Insert(PQ_Element* e, int64_t tick);
+    void Unlink(PQ_Element* e);
+
+    // Finds the next tick after the current one at which a bucket needs
+    // processing. Returns false if there's none.
+    bool NextEvent(int64_t* tick, int* bucket) const;
+
+    // Moves the current tick forward to the next event, as long as that's
+    // not past limit, and processes the corresponding bucket. Returns false
+    // if there's nothing to do.
+    bool Step(int64_t limit);
+
+    double resolution;
+    int64_t current_tick = 0;
+
+    std::vector<PQ_Element*> buckets[OVERFLOW_BUCKET + 1];
+    // One bit per non-empty slot, for each level.
+    uint64_t occupied[NUM_LEVELS] = {};
+    // Lower bound for the ticks of the elements in the overflow bucket.
+    int64_t overflow_min_tick = INT64_MAX;
+
+    PriorityQueue ready;
+
+    int num_pending = 0;
+    int peak_size = 0;
+    uint64_t cumulative_num = 0;
+};
+
+} // namespace zeek::detail
@@ -15,6 +15,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <map>
 #include <set>
 
 #include "zeek/Attr.h"
@@ -1615,6 +1616,75 @@ void detail::TablePatternMatcher::Build() {
         reporter->FatalError("failed compile set for disjunctive matching");
 }
 
+// Expiration bookkeeping of a TableVal. Once a table with an expiration
+// attribute reaches table_expire_index_threshold entries, its keys get filed
+// into buckets by the second of their last expiration-relevant access, and
+// expiration rounds only look at the buckets that are due. Reads and writes
+// don't move keys between buckets: a key that turns out to have been accessed
+// since it was filed simply gets filed again under its new access time.
+class detail::TableExpireState {
+public:
+    // Appends a key to the given bucket.
+    void File(int bucket, const HashKey& k) {
+        auto& keys = buckets[bucket].keys;
+        uint32_t size = k.Size();
+        hash_t hash = k.Hash();
+        keys.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        keys.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        keys.append(static_cast<const char*>(k.Key()), size);
+        ++stats.pending;
+    }
+
+    // Returns a copy of the oldest filed key and sets bucket to where it's
+    // filed, or returns nullptr if the index is empty.
+    std::unique_ptr<HashKey> Peek(int* bucket) {
+        while ( ! buckets.empty() ) {
+            auto it = buckets.begin();
+            const auto& b = it->second;
+
+            if ( b.pos >= b.keys.size() ) {
+                buckets.erase(it);
+                continue;
+            }
+
+            const char* p = b.keys.data() + b.pos;
+            uint32_t size;
+            hash_t hash;
+            memcpy(&size, p, sizeof(size));
+            memcpy(&hash, p + sizeof(size), sizeof(hash));
+
+            *bucket = it->first;
+            return std::make_unique<HashKey>(p + sizeof(size) + sizeof(hash), size, hash);
+        }
+
+        return nullptr;
+    }
+
+    // Drops the key last returned by Peek() for the given bucket.
+    void Pop(int bucket) {
+        auto& b = buckets[bucket];
+        uint32_t size;
+        memcpy(&size, b.keys.data() + b.pos, sizeof(size));
+        b.pos += sizeof(size) + sizeof(hash_t) + size;
+        --stats.pending;
+    }
+
+    void Clear() {
+        buckets.clear();
+        stats.pending = 0;
+    }
+
+    TableExpireStats stats;
+
+private:
+    struct Bucket {
+        std::string keys; // sequence of (uint32 size, hash, key bytes)
+        size_t pos = 0;   // offset of the next key to look at
+    };
+
+    std::map<int, Bucket> buckets;
+};
+
 TableVal::TableVal(TableTypePtr t, detail::AttributesPtr a) : Val(t) {
     bool ordered = (a != nullptr && a->Find(detail::ATTR_ORDERED) != nullptr);
     Init(std::move(t), ordered);
@@ -1668,6 +1738,10 @@ TableVal::~TableVal() {
 void TableVal::RemoveAll() {
     delete expire_iterator;
     expire_iterator = nullptr;
+
+    if ( expire_state )
+        expire_state->Clear();
+
     // Here we take the brute force approach.
     delete table_val;
     table_val = new PDict<TableEntryVal>;
@@ -1794,6 +1868,14 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<detail::HashKey> k, ValPtr n
     if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
         new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
+    if ( expire_state && expire_state->stats.indexed ) {
+        // A replaced entry's key is already filed.
+        if ( old_entry_val )
+            new_entry_val->expire_bucket = old_entry_val->expire_bucket;
+        else
+            FileForExpiration(new_entry_val, k_copy);
+    }
+
     Modified();
 
     if ( change_func || (broker_forward && ! broker_store.empty()) ) {
@@ -2149,6 +2231,13 @@ void TableVal::GetPatternMatcherStats(detail::DFA_State_Cache_Stats* stats) cons
     return pattern_matcher->GetStats(stats);
 }
 
+void TableVal::GetExpireStats(detail::TableExpireStats* stats) const {
+    if ( expire_state )
+        *stats = expire_state->stats;
+    else
+        *stats = {};
+}
+
 bool TableVal::UpdateTimestamp(Val* index) {
     TableEntryVal* v;
 
@@ -2578,6 +2667,22 @@ void TableVal::DoExpire(double t) {
         // error, it has been reported already.
         return;
 
+    if ( ! expire_state )
+        expire_state = std::make_unique<detail::TableExpireState>();
+
+    auto& stats = expire_state->stats;
+    ++stats.rounds;
+
+    // Switch to the index between two scans through the table.
+    if ( ! stats.indexed && ! expire_iterator && zeek::detail::table_expire_index_threshold > 0 &&
+         table_val->Length() >= zeek::detail::table_expire_index_threshold )
+        BuildExpireIndex();
+
+    if ( stats.indexed ) {
+        DoIndexedExpire(t, timeout);
+        return;
+    }
+
     if ( ! expire_iterator ) {
         auto it = table_val->begin_robust();
         expire_iterator = new RobustDictIterator(std::move(it));
@@ -2588,6 +2693,7 @@ void TableVal::DoExpire(double t) {
     for ( int i = 0; i < zeek::detail::table_incremental_step && *expire_iterator != table_val->end_robust();
           ++i, ++(*expire_iterator) ) {
         auto v = (*expire_iterator)->value;
+        ++stats.visited;
 
         if ( v->ExpireAccessTime() == 0 ) {
             // This happens when we insert val while network_time
@@ -2599,63 +2705,125 @@ void TableVal::DoExpire(double t) {
 
         else if ( v->ExpireAccessTime() + timeout < t ) {
             auto k = (*expire_iterator)->GetHashKey();
-            ListValPtr idx = nullptr;
+            ExpireEntry(v, *k, timeout, &modified);
 
-            if ( expire_func ) {
-                idx = RecreateIndex(*k);
-                double secs = CallExpireFunc(idx);
+            if ( ! expire_iterator )
+                // Entire table got dropped (e.g. clear_table() / RemoveAll())
+                break;
+        }
+    }
 
-                // It's possible that the user-provided
-                // function modified or deleted the table
-                // value, so look it up again.
-                v = table_val->Lookup(k.get());
+    if ( modified )
+        Modified();
 
-                if ( ! v ) { // user-provided function deleted it
-                    if ( ! expire_iterator )
-                        // Entire table got dropped (e.g. clear_table() / RemoveAll())
-                        break;
+    if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() ) {
+        delete expire_iterator;
+        expire_iterator = nullptr;
+        InitTimer(zeek::detail::table_expire_interval);
+    }
+    else
+        InitTimer(zeek::detail::table_expire_delay);
+}
 
-                    continue;
-                }
+void TableVal::DoIndexedExpire(double t, double timeout) {
+    bool modified = false;
+    int i = 0;
 
-                if ( secs > 0 ) {
-                    // User doesn't want us to expire
-                    // this now.
-                    v->SetExpireAccess(run_state::network_time - timeout + secs);
-                    continue;
-                }
-            }
+    for ( ; i < zeek::detail::table_incremental_step; ++i ) {
+        int bucket;
+        auto k = expire_state->Peek(&bucket);
 
-            if ( subnets ) {
-                if ( ! idx )
-                    idx = RecreateIndex(*k);
-                if ( ! subnets->Remove(idx.get()) )
-                    reporter->InternalWarning("index not in prefix table");
-            }
+        // All keys in a bucket share the access time they were filed under.
+        if ( ! k || run_state::zeek_start_network_time + bucket + timeout >= t )
+            break;
 
-            table_val->RemoveEntry(k.get());
-            if ( change_func ) {
-                if ( ! idx )
-                    idx = RecreateIndex(*k);
+        auto v = table_val->Lookup(k.get());
 
-                CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
-            }
+        if ( v && v->ExpireAccessTime() == 0 )
+            // Not expirable yet, see DoExpire().
+            break;
 
-            delete v;
-            modified = true;
-        }
+        expire_state->Pop(bucket);
+        ++expire_state->stats.visited;
+
+        // Gone, or re-inserted and filed elsewhere since.
+        if ( ! v || v->expire_bucket != bucket )
+            continue;
+
+        if ( v->ExpireAccessTime() + timeout >= t )
+            // Accessed since it was filed.
+            FileForExpiration(v, *k);
+
+        else if ( (v = ExpireEntry(v, *k, timeout, &modified)) )
+            FileForExpiration(v, *k);
     }
 
     if ( modified )
         Modified();
 
-    if ( ! expire_iterator || (*expire_iterator) == table_val->end_robust() ) {
-        delete expire_iterator;
-        expire_iterator = nullptr;
+    // If the round ran out of steps, there may be more keys due.
+    if ( i == zeek::detail::table_incremental_step )
+        InitTimer(zeek::detail::table_expire_delay);
+    else
         InitTimer(zeek::detail::table_expire_interval);
+}
+
+TableEntryVal* TableVal::ExpireEntry(TableEntryVal* v, const detail::HashKey& k, double timeout, bool* modified) {
+    ListValPtr idx = nullptr;
+
+    if ( expire_func ) {
+        idx = RecreateIndex(k);
+        double secs = CallExpireFunc(idx);
+
+        // It's possible that the user-provided
+        // function modified or deleted the table
+        // value, so look it up again.
+        v = table_val->Lookup(&k);
+
+        if ( ! v ) // user-provided function deleted it
+            return nullptr;
+
+        if ( secs > 0 ) {
+            // User doesn't want us to expire
+            // this now.
+            v->SetExpireAccess(run_state::network_time - timeout + secs);
+            return v;
+        }
     }
-    else
-        InitTimer(zeek::detail::table_expire_delay);
+
+    if ( subnets ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+        if ( ! subnets->Remove(idx.get()) )
+            reporter->InternalWarning("index not in prefix table");
+    }
+
+    table_val->RemoveEntry(k);
+    if ( change_func ) {
+        if ( ! idx )
+            idx = RecreateIndex(k);
+
+        CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
+    }
+
+    delete v;
+    ++expire_state->stats.expired;
+    *modified = true;
+    return nullptr;
+}
+
+void TableVal::BuildExpireIndex() {
+    expire_state->stats.indexed = true;
+
+    for ( const auto& e : *table_val ) {
+        auto k = e.GetHashKey();
+        FileForExpiration(e.value, *k);
+    }
+}
+
+void TableVal::FileForExpiration(TableEntryVal* v, const detail::HashKey& k) {
+    v->expire_bucket = v->expire_access_time;
+    expire_state->File(v->expire_bucket, k);
 }
 
 double TableVal::GetExpireTime() {
@@ -2892,7 +3060,7 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(t), is_managed(t->
 RecordVal::RecordVal(RecordTypePtr t, std::vector<std::optional<ZVal>> init_vals)
     : Val(t), is_managed(t->ManagedFields()) {
     rt = std::move(t);
-    record_val = std::move(init_vals);
+    record_val = OptZValVector(init_vals);
 }
 
 RecordVal::~RecordVal() {
@@ -2920,7 +3088,7 @@ void RecordVal::Assign(int field, ValPtr new_val) {
 }
 
 void RecordVal::Remove(int field) {
-    auto& f_i = record_val[field];
+    auto f_i = record_val[field];
     if ( f_i ) {
         if ( IsManaged(field) )
             ZVal::DeleteManagedType(*f_i);
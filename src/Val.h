@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <array>
+#include <climits>
 #include <list>
 #include <unordered_map>
 #include <variant>
@@ -51,9 +52,19 @@ class Frame;
 class PrefixTable;
 class HashKey;
 class TablePatternMatcher;
+class TableExpireState;
 
 struct DFA_State_Cache_Stats;
 
+// Statistics about the expiration of a table's entries.
+struct TableExpireStats {
+    bool indexed = false; // whether entries are indexed by access time
+    uint64_t rounds = 0;  // number of expiration rounds
+    uint64_t visited = 0; // number of entries looked at across all rounds
+    uint64_t expired = 0; // number of entries expired
+    uint64_t pending = 0; // number of keys waiting in the index
+};
+
 class ValTrace;
 class ZBody;
 class CPPRuntime;
@@ -731,6 +742,10 @@ protected:
     // to save a few bytes, as we do not need a high resolution for these
     // anyway.
     int expire_access_time;
+
+    // If the table indexes its entries for expiration, the access time
+    // under which this entry's key got filed.
+    int expire_bucket = INT_MIN;
 };
 
 class TableValTimer final : public detail::Timer {
@@ -905,6 +920,10 @@ public:
     // the DFA's state for introspection.
     void GetPatternMatcherStats(detail::DFA_State_Cache_Stats* stats) const;
 
+    // Fills stats with information about the expiration of the table's
+    // entries.
+    void GetExpireStats(detail::TableExpireStats* stats) const;
+
     // Sets the timestamp for the given index to network time.
     // Returns false if index does not exist.
     bool UpdateTimestamp(Val* index);
@@ -1054,6 +1073,21 @@ protected:
     // Calls &expire_func and returns its return interval;
     double CallExpireFunc(ListValPtr idx);
 
+    // Expires the given entry stored under k. If &expire_func asks to
+    // keep the entry for longer, returns it with its access time moved
+    // accordingly; otherwise returns nullptr.
+    TableEntryVal* ExpireEntry(TableEntryVal* v, const detail::HashKey& k, double timeout, bool* modified);
+
+    // Expiration round for tables whose entries are indexed by access
+    // time; only looks at the entries that are due.
+    void DoIndexedExpire(double t, double timeout);
+
+    // Starts indexing the table's entries by access time.
+    void BuildExpireIndex();
+
+    // Files the entry's key in the expiration index under its access time.
+    void FileForExpiration(TableEntryVal* v, const detail::HashKey& k);
+
     // Enum for the different kinds of changes an &on_change handler can see
     enum OnChangeType { ELEMENT_NEW, ELEMENT_CHANGED, ELEMENT_REMOVED, ELEMENT_EXPIRED };
 
@@ -1073,6 +1107,7 @@ protected:
     detail::ExprPtr expire_func;
     TableValTimer* timer;
     RobustDictIterator<TableEntryVal>* expire_iterator;
+    std::unique_ptr<detail::TableExpireState> expire_state;
     std::unique_ptr<detail::PrefixTable> subnets;
     std::unique_ptr<detail::TablePatternMatcher> pattern_matcher;
     ValPtr def_val;
@@ -1177,7 +1212,7 @@ public:
     void AssignInterval(int field, double new_val) { Assign(field, new_val); }
 
     void Assign(int field, StringVal* new_val) {
-        auto& fv = record_val[field];
+        auto fv = record_val[field];
         if ( fv )
             ZVal::DeleteManagedType(*fv);
         fv = ZVal(new_val);
@@ -1235,7 +1270,7 @@ public:
      * @return  The value at the given field index.
      */
     ValPtr GetField(int field) const {
-        auto& fv = record_val[field];
+        auto fv = record_val[field];
         if ( ! fv ) {
             const auto& fi = rt->DeferredInits()[field];
             if ( ! fi )
@@ -1435,17 +1470,17 @@ protected:
      */
     void AppendField(ValPtr v, const TypePtr& t) {
         if ( v )
-            record_val.emplace_back(ZVal(v, t));
+            record_val.push_back(ZVal(v, t));
         else
-            record_val.emplace_back(std::nullopt);
+            record_val.push_back(std::nullopt);
     }
 
     // For internal use by low-level ZAM instructions and event tracing.
     // Caller assumes responsibility for memory management.  The first
     // version allows manipulation of whether the field is present at all.
     // The second version ensures that the optional value is present.
-    std::optional<ZVal>& RawOptField(int field) {
-        auto& f = record_val[field];
+    OptZValVector::Element RawOptField(int field) {
+        auto f = record_val[field];
         if ( ! f ) {
             const auto& fi = rt->DeferredInits()[field];
             if ( fi )
@@ -1456,7 +1491,7 @@ protected:
     }
 
     ZVal& RawField(int field) {
-        auto& f = RawOptField(field);
+        auto f = RawOptField(field);
         if ( ! f )
             f = ZVal();
         return *f;
@@ -1473,7 +1508,7 @@ protected:
 
 private:
     void DeleteFieldIfManaged(unsigned int field) {
-        auto& f = record_val[field];
+        auto f = record_val[field];
         if ( f && IsManaged(field) )
             ZVal::DeleteManagedType(*f);
     }
@@ -1491,7 +1526,7 @@ private:
     // Low-level values of each of the fields.
     //
     // Lazily modified during GetField(), so mutable.
-    mutable std::vector<std::optional<ZVal>> record_val;
+    mutable OptZValVector record_val;
 
     // Whether a given field requires explicit memory management.
     const std::vector<bool>& is_managed;
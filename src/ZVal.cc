@@ -1,11 +1,16 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <chrono>
+#include <cstring>
+
 #include "zeek/File.h"
 #include "zeek/Func.h"
 #include "zeek/OpaqueVal.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 using namespace zeek;
 
 bool* ZVal::zval_was_nil_addr = nullptr;
@@ -201,3 +206,168 @@ bool ZVal::IsManagedType(const TypePtr& t) {
         default: return false;
     }
 }
+
+OptZValVector::OptZValVector(const std::vector<std::optional<ZVal>>& init) {
+    reserve(init.size());
+
+    for ( const auto& v : init )
+        push_back(v);
+}
+
+OptZValVector::OptZValVector(OptZValVector&& other) noexcept : vals(other.vals), num(other.num), cap(other.cap) {
+    other.vals = nullptr;
+    other.num = other.cap = 0;
+}
+
+OptZValVector& OptZValVector::operator=(OptZValVector&& other) noexcept {
+    if ( this != &other ) {
+        ::operator delete(vals);
+        vals = other.vals;
+        num = other.num;
+        cap = other.cap;
+        other.vals = nullptr;
+        other.num = other.cap = 0;
+    }
+
+    return *this;
+}
+
+void OptZValVector::resize(size_t n) {
+    reserve(n);
+
+    // Elements past the end are always missing, so only shrinking needs
+    // to update their bits.
+    for ( size_t i = n; i < num; ++i )
+        Reset(i);
+
+    num = n;
+}
+
+void OptZValVector::Grow(size_t new_cap) {
+    // ZVals are trivially copyable, so plain memory suffices.
+    auto new_vals = static_cast<ZVal*>(::operator new((new_cap + Words(new_cap)) * sizeof(ZVal)));
+    auto new_bits = new_vals + new_cap;
+
+    if ( vals ) {
+        memcpy(new_vals, vals, num * sizeof(ZVal));
+        memcpy(new_bits, vals + cap, Words(cap) * sizeof(ZVal));
+    }
+
+    memset(new_bits + Words(cap), 0, (Words(new_cap) - Words(cap)) * sizeof(ZVal));
+
+    ::operator delete(vals);
+    vals = new_vals;
+    cap = new_cap;
+}
+
+TEST_SUITE_BEGIN("OptZValVector");
+
+TEST_CASE("opt zval vector tracks presence") {
+    OptZValVector v;
+    v.resize(3);
+    CHECK(v.size() == 3);
+    CHECK_FALSE(v[0]);
+    CHECK_FALSE(v[2]);
+
+    v[1] = ZVal(zeek_int_t(42));
+    CHECK(v[1]);
+    CHECK(v[1]->AsInt() == 42);
+    CHECK_FALSE(v[0]);
+
+    v[1] = std::nullopt;
+    CHECK_FALSE(v[1]);
+
+    std::optional<ZVal> o = v[1];
+    CHECK_FALSE(o);
+}
+
+TEST_CASE("opt zval vector keeps elements when growing") {
+    OptZValVector v;
+
+    for ( zeek_uint_t i = 0; i < 200; ++i ) {
+        if ( i % 3 == 0 )
+            v.push_back(std::nullopt);
+        else
+            v.push_back(ZVal(i));
+    }
+
+    CHECK(v.size() == 200);
+
+    for ( size_t i = 0; i < 200; ++i ) {
+        CHECK(v.Has(i) == (i % 3 != 0));
+        if ( i % 3 != 0 )
+            CHECK(v[i]->AsCount() == i);
+    }
+
+    v.resize(70);
+    v.resize(130);
+    CHECK(v[68]);
+    CHECK_FALSE(v[71]);
+    CHECK_FALSE(v[129]);
+}
+
+TEST_CASE("opt zval vector converts from optionals") {
+    std::vector<std::optional<ZVal>> init = {ZVal(1.5), std::nullopt};
+    OptZValVector v(init);
+    CHECK(v.size() == 2);
+    CHECK(v[0]->AsDouble() == 1.5);
+    CHECK_FALSE(v[1]);
+
+    OptZValVector w(std::move(v));
+    CHECK(w.size() == 2);
+    CHECK(v.size() == 0);
+}
+
+// Microbenchmark comparing record field storage as a vector of optionals with the packed layout.
+// Run with "zeek --test -tc='opt zval vector benchmark' --no-skip".
+TEST_CASE("opt zval vector benchmark" * doctest::skip(true)) {
+    constexpr size_t num_records = 100000;
+    constexpr size_t num_fields = 30;
+
+    auto run = [&](const char* name, auto make, size_t bytes_per_record) {
+        auto start = std::chrono::steady_clock::now();
+        zeek_uint_t sum = 0;
+
+        for ( size_t r = 0; r < num_records; ++r ) {
+            auto rec = make();
+
+            for ( size_t i = 0; i < num_fields; ++i )
+                if ( i % 4 != 0 )
+                    rec[i] = ZVal(zeek_uint_t(i));
+
+            for ( size_t i = 0; i < num_fields; ++i )
+                if ( rec[i] )
+                    sum += rec[i]->AsCount();
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        MESSAGE(name << ": " << static_cast<double>(ns) / num_records << " ns/record, " << bytes_per_record
+                     << " bytes/record");
+        CHECK(sum > 0);
+    };
+
+    for ( int round = 0; round < 3; ++round ) {
+        run(
+            "optionals",
+            [] {
+                std::vector<std::optional<ZVal>> v;
+                v.resize(num_fields);
+                return v;
+            },
+            sizeof(std::vector<std::optional<ZVal>>) + num_fields * sizeof(std::optional<ZVal>));
+
+        OptZValVector sample;
+        sample.resize(num_fields);
+        run(
+            "packed",
+            [] {
+                OptZValVector v;
+                v.resize(num_fields);
+                return v;
+            },
+            sizeof(OptZValVector) + sample.Footprint());
+    }
+}
+
+TEST_SUITE_END();
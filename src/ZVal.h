@@ -6,6 +6,11 @@
 
 #include "zeek/zeek-config.h"
 
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <vector>
+
 namespace zeek {
 
 class AddrVal;
@@ -203,4 +208,113 @@ private:
     static bool* zval_was_nil_addr;
 };
 
+// A vector of ZVals that may each be missing, as used for the fields of
+// records. Which elements are present is kept in a bitmap that follows the
+// values in the same allocation, so an element costs just the 8 bytes of its
+// ZVal rather than the 16 of a std::optional<ZVal>.
+class OptZValVector {
+public:
+    // Refers to an element, behaving like a std::optional<ZVal>&. Only valid
+    // until the vector grows.
+    class Element {
+    public:
+        explicit operator bool() const { return vec->Has(index); }
+        bool has_value() const { return vec->Has(index); }
+
+        ZVal& operator*() const { return vec->vals[index]; }
+        ZVal* operator->() const { return &vec->vals[index]; }
+
+        operator std::optional<ZVal>() const {
+            if ( has_value() )
+                return **this;
+
+            return std::nullopt;
+        }
+
+        Element& operator=(const ZVal& v) {
+            vec->Set(index, v);
+            return *this;
+        }
+
+        Element& operator=(std::nullopt_t) {
+            vec->Reset(index);
+            return *this;
+        }
+
+        Element& operator=(const std::optional<ZVal>& v) {
+            if ( v )
+                vec->Set(index, *v);
+            else
+                vec->Reset(index);
+
+            return *this;
+        }
+
+        Element& operator=(const Element& other) { return *this = static_cast<std::optional<ZVal>>(other); }
+
+    private:
+        friend class OptZValVector;
+
+        Element(OptZValVector* arg_vec, size_t arg_index) : vec(arg_vec), index(arg_index) {}
+
+        OptZValVector* vec;
+        size_t index;
+    };
+
+    OptZValVector() = default;
+    explicit OptZValVector(const std::vector<std::optional<ZVal>>& init);
+
+    OptZValVector(OptZValVector&& other) noexcept;
+    OptZValVector& operator=(OptZValVector&& other) noexcept;
+
+    OptZValVector(const OptZValVector&) = delete;
+    OptZValVector& operator=(const OptZValVector&) = delete;
+
+    ~OptZValVector() { ::operator delete(vals); }
+
+    size_t size() const { return num; }
+
+    Element operator[](size_t i) { return {this, i}; }
+
+    bool Has(size_t i) const { return (vals[cap + i / 64].AsCount() >> (i % 64)) & 1; }
+
+    void Set(size_t i, const ZVal& v) {
+        vals[i] = v;
+        vals[cap + i / 64].AsCountRef() |= Bit(i);
+    }
+
+    void Reset(size_t i) { vals[cap + i / 64].AsCountRef() &= ~Bit(i); }
+
+    // Makes room for n elements without changing the size.
+    void reserve(size_t n) {
+        if ( n > cap )
+            Grow(n);
+    }
+
+    // Changes the size to n. New elements are missing.
+    void resize(size_t n);
+
+    void push_back(const std::optional<ZVal>& v) {
+        if ( num == cap )
+            Grow(cap > 0 ? 2 * cap : 4);
+
+        (*this)[num++] = v;
+    }
+
+    // Returns the number of bytes allocated for the elements.
+    size_t Footprint() const { return (cap + Words(cap)) * sizeof(ZVal); }
+
+private:
+    static size_t Words(size_t n) { return (n + 63) / 64; }
+    static zeek_uint_t Bit(size_t i) { return zeek_uint_t(1) << (i % 64); }
+
+    void Grow(size_t new_cap);
+
+    // The values of the first cap elements, followed by their presence
+    // bits.
+    ZVal* vals = nullptr;
+    uint32_t num = 0;
+    uint32_t cap = 0;
+};
+
 } // namespace zeek
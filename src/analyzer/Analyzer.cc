@@ -7,6 +7,7 @@
 
 #include "zeek/3rdparty/doctest.h"
 #include "zeek/Event.h"
+#include "zeek/NetVar.h"
 #include "zeek/ZeekString.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/pia/PIA.h"
@@ -645,6 +646,15 @@ void Analyzer::AnalyzerConfirmation(zeek::Tag arg_tag) {
 
     if ( analyzer_confirmation_info )
         EnqueueAnalyzerConfirmationInfo(effective_tag);
+
+    // A top-level analyzer, i.e. a sibling of the connection's PIA, knows
+    // the protocol now. The PIA doesn't need to keep data for others.
+    if ( zeek::detail::dpd_commit_on_confirmation && conn && parent ) {
+        auto* pia = conn->GetPrimaryPIA();
+
+        if ( pia && pia->AsAnalyzer() != this && pia->AsAnalyzer()->Parent() == parent )
+            pia->Commit();
+    }
 }
 
 void Analyzer::EnqueueAnalyzerViolationInfo(const char* reason, const char* data, int len, const zeek::Tag& arg_tag) {
@@ -7,11 +7,14 @@
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
 #include "zeek/RunState.h"
+#include "zeek/SlabPool.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Flags.h"
 #include "zeek/analyzer/protocol/tcp/TCP_Reassembler.h"
 
 namespace zeek::analyzer::pia {
 
+uint64_t PIA::total_buffered = 0;
+
 PIA::PIA(analyzer::Analyzer* arg_as_analyzer) : state(INIT), as_analyzer(arg_as_analyzer), conn(), current_packet() {}
 
 PIA::~PIA() { ClearBuffer(&pkt_buffer); }
@@ -21,25 +24,53 @@ void PIA::ClearBuffer(Buffer* buffer) {
     for ( DataBlock* b = buffer->head; b; b = next ) {
         next = b->next;
         delete b->ip;
-        delete[] b->data;
-        delete b;
+        b->~DataBlock();
+        zeek::detail::SlabPool::Free(b, sizeof(DataBlock));
     }
 
+    total_buffered -= buffer->stored;
+
     buffer->head = buffer->tail = nullptr;
     buffer->size = 0;
+    buffer->stored = 0;
 }
 
-void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data, bool is_orig, const IP_Hdr* ip) {
-    u_char* tmp = nullptr;
+void PIA::CommitBuffer(Buffer* buffer) {
+    if ( buffer->committed || (buffer->state != INIT && buffer->state != BUFFERING) )
+        return;
 
-    if ( data ) {
-        tmp = new u_char[len];
-        memcpy(tmp, data, len);
+    auto size = buffer->size;
+    ClearBuffer(buffer);
+    buffer->size = size;
+    buffer->committed = true;
+}
+
+void PIA::Commit() {
+    DBG_LOG(DBG_ANALYZER, "PIA committing after analyzer confirmation");
+    CommitBuffer(&pkt_buffer);
+}
+
+bool PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data, bool is_orig, const IP_Hdr* ip) {
+    if ( buffer->committed ) {
+        if ( data )
+            buffer->size += len;
+
+        return true;
+    }
+
+    if ( data && zeek::detail::dpd_buffer_total > 0 && total_buffered + len > zeek::detail::dpd_buffer_total ) {
+        DBG_LOG(DBG_ANALYZER, "PIA total buffer size exceeded");
+        return false;
     }
 
-    DataBlock* b = new DataBlock;
+    // Blocks are small and short-lived, and come from the same slabs as
+    // copies of their data.
+    DataBlock* b = new (zeek::detail::SlabPool::Allocate(sizeof(DataBlock))) DataBlock;
     b->ip = ip ? ip->Copy() : nullptr;
-    b->data = tmp;
+
+    if ( data )
+        b->buffered = PacketDataRef(data, len);
+
     b->is_orig = is_orig;
     b->len = len;
     b->seq = seq;
@@ -52,19 +83,24 @@ void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data,
     else
         buffer->head = buffer->tail = b;
 
-    if ( data )
+    if ( data ) {
         buffer->size += len;
+        buffer->stored += len;
+        total_buffered += len;
+    }
+
+    return true;
 }
 
-void PIA::AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig, const IP_Hdr* ip) {
-    AddToBuffer(buffer, -1, len, data, is_orig, ip);
+bool PIA::AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig, const IP_Hdr* ip) {
+    return AddToBuffer(buffer, -1, len, data, is_orig, ip);
 }
 
 void PIA::ReplayPacketBuffer(analyzer::Analyzer* analyzer) {
     DBG_LOG(DBG_ANALYZER, "PIA replaying %" PRIu64 " total packet bytes", pkt_buffer.size);
 
     for ( DataBlock* b = pkt_buffer.head; b; b = b->next )
-        analyzer->DeliverPacket(b->len, b->data, b->is_orig, -1, b->ip, 0);
+        analyzer->DeliverPacket(b->len, b->Data(), b->is_orig, -1, b->ip, 0);
 }
 
 void PIA::PIA_Done() { FinishEndpointMatcher(); }
@@ -85,8 +121,8 @@ void PIA::PIA_DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t
         new_state = BUFFERING;
 
     if ( (pkt_buffer.state == BUFFERING || new_state == BUFFERING) && len > 0 ) {
-        AddToBuffer(&pkt_buffer, seq, len, data, is_orig, ip);
-        if ( pkt_buffer.size > zeek::detail::dpd_buffer_size || ++pkt_buffer.chunks > zeek::detail::dpd_max_packets )
+        if ( ! AddToBuffer(&pkt_buffer, seq, len, data, is_orig, ip) ||
+             pkt_buffer.size > zeek::detail::dpd_buffer_size || ++pkt_buffer.chunks > zeek::detail::dpd_max_packets )
             new_state = zeek::detail::dpd_match_only_beginning ? SKIPPING : MATCHING_ONLY;
     }
 
@@ -123,7 +159,11 @@ void PIA::DoMatch(const u_char* data, int len, bool is_orig, bool bol, bool eol,
 }
 
 void PIA_UDP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
-    if ( pkt_buffer.state == MATCHING_ONLY ) {
+    // The analyzer that made us commit isn't a late match.
+    if ( pkt_buffer.committed && Parent()->HasChildAnalyzer(tag) )
+        return;
+
+    if ( pkt_buffer.state == MATCHING_ONLY || pkt_buffer.committed ) {
         DBG_LOG(DBG_ANALYZER, "analyzer found but buffer already exceeded");
         // FIXME: This is where to check whether an analyzer
         // supports partial connections once we get such.
@@ -137,7 +177,9 @@ void PIA_UDP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
             event_mgr.Enqueue(protocol_late_match, ConnVal(), tval);
         }
 
-        pkt_buffer.state = zeek::detail::dpd_late_match_stop ? SKIPPING : MATCHING_ONLY;
+        if ( zeek::detail::dpd_late_match_stop )
+            pkt_buffer.state = SKIPPING;
+
         return;
     }
 
@@ -295,8 +337,7 @@ void PIA_TCP::DeliverStream(int len, const u_char* data, bool is_orig) {
     }
 
     if ( stream_buffer.state == BUFFERING || new_state == BUFFERING ) {
-        AddToBuffer(&stream_buffer, len, data, is_orig);
-        if ( stream_buffer.size > zeek::detail::dpd_buffer_size ||
+        if ( ! AddToBuffer(&stream_buffer, len, data, is_orig) || stream_buffer.size > zeek::detail::dpd_buffer_size ||
              ++stream_buffer.chunks > zeek::detail::dpd_max_packets )
             new_state = zeek::detail::dpd_match_only_beginning ? SKIPPING : MATCHING_ONLY;
     }
@@ -322,7 +363,11 @@ void PIA_TCP::Undelivered(uint64_t seq, int len, bool is_orig) {
 }
 
 void PIA_TCP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
-    if ( stream_buffer.state == MATCHING_ONLY ) {
+    // The analyzer that made us commit isn't a late match.
+    if ( stream_buffer.committed && Parent()->HasChildAnalyzer(tag) )
+        return;
+
+    if ( stream_buffer.state == MATCHING_ONLY || stream_buffer.committed ) {
         DBG_LOG(DBG_ANALYZER, "analyzer found but buffer already exceeded");
         // FIXME: This is where to check whether an analyzer supports
         // partial connections once we get such.
@@ -336,7 +381,9 @@ void PIA_TCP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
             event_mgr.Enqueue(protocol_late_match, ConnVal(), tval);
         }
 
-        stream_buffer.state = zeek::detail::dpd_late_match_stop ? SKIPPING : MATCHING_ONLY;
+        if ( zeek::detail::dpd_late_match_stop )
+            stream_buffer.state = SKIPPING;
+
         return;
     }
 
@@ -404,9 +451,11 @@ void PIA_TCP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
         // worth the effort.
 
         if ( b->is_orig )
-            reass_orig->DataSent(run_state::network_time, orig_seq = b->seq, b->len, b->data, tcp::TCP_Flags(), true);
+            reass_orig->DataSent(run_state::network_time, orig_seq = b->seq, b->len, b->Data(), tcp::TCP_Flags(),
+                                 true);
         else
-            reass_resp->DataSent(run_state::network_time, resp_seq = b->seq, b->len, b->data, tcp::TCP_Flags(), true);
+            reass_resp->DataSent(run_state::network_time, resp_seq = b->seq, b->len, b->Data(), tcp::TCP_Flags(),
+                                 true);
     }
 
     // We also need to pass the current packet on.
@@ -434,12 +483,17 @@ void PIA_TCP::ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule) {
 
 void PIA_TCP::DeactivateAnalyzer(zeek::Tag tag) { reporter->InternalError("PIA_TCP::Deact not implemented yet"); }
 
+void PIA_TCP::Commit() {
+    PIA::Commit();
+    CommitBuffer(&stream_buffer);
+}
+
 void PIA_TCP::ReplayStreamBuffer(analyzer::Analyzer* analyzer) {
     DBG_LOG(DBG_ANALYZER, "PIA_TCP replaying %" PRIu64 " total stream bytes", stream_buffer.size);
 
     for ( DataBlock* b = stream_buffer.head; b; b = b->next ) {
-        if ( b->data )
-            analyzer->NextStream(b->len, b->data, b->is_orig);
+        if ( b->Data() )
+            analyzer->NextStream(b->len, b->Data(), b->is_orig);
         else
             analyzer->NextUndelivered(b->seq, b->len, b->is_orig);
     }
@@ -5,6 +5,7 @@
 #include "zeek/RuleMatcher.h"
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/analyzer/protocol/tcp/TCP.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 namespace zeek::detail {
 class RuleEndpointState;
@@ -31,6 +32,15 @@ public:
     // Called when PIA wants to remove an Analyzer.
     virtual void DeactivateAnalyzer(zeek::Tag tag) = 0;
 
+    // Called when one of the connection's analyzers has confirmed its
+    // protocol, see dpd_commit_on_confirmation. Releases the buffered data
+    // and stops buffering more. Analyzers matched afterwards count as late
+    // matches.
+    virtual void Commit();
+
+    // Returns the number of payload bytes buffered by all PIAs.
+    static uint64_t TotalBuffered() { return total_buffered; }
+
     void Match(zeek::detail::Rule::PatternType type, const u_char* data, int len, bool is_orig, bool bol, bool eol,
                bool clear_state);
 
@@ -75,28 +85,41 @@ protected:
 
     // Buffers one chunk of data.  Used both for packet payload (incl.
     // sequence numbers for TCP) and chunks of a reassembled stream.
+    // Buffered chunks keep their data in buffered, which references the
+    // packet's buffer where possible. The current packet just points to
+    // its data.
     struct DataBlock {
         IP_Hdr* ip = nullptr;
         const u_char* data = nullptr;
+        PacketDataRef buffered;
         bool is_orig = false;
         size_t len = 0;
         size_t cap_len = 0;
         uint64_t seq = 0;
         DataBlock* next = nullptr;
+
+        const u_char* Data() const { return data ? data : buffered.Data(); }
     };
 
+    // A committed buffer still counts the data it's offered, so that
+    // matching stops at the same point, but doesn't keep it.
     struct Buffer {
         DataBlock* head = nullptr;
         DataBlock* tail = nullptr;
         int64_t size = 0;
+        int64_t stored = 0; // bytes of payload held by the blocks
         int64_t chunks = 0;
         State state = INIT;
+        bool committed = false;
     };
 
-    void AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data, bool is_orig,
+    // Returns false if the data wasn't buffered because dpd_buffer_total
+    // has been reached.
+    bool AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data, bool is_orig,
                      const IP_Hdr* ip = nullptr);
-    void AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig, const IP_Hdr* ip = nullptr);
+    bool AddToBuffer(Buffer* buffer, int len, const u_char* data, bool is_orig, const IP_Hdr* ip = nullptr);
     void ClearBuffer(Buffer* buffer);
+    void CommitBuffer(Buffer* buffer);
 
     DataBlock* CurrentPacket() { return &current_packet; }
 
@@ -115,6 +138,8 @@ private:
     analyzer::Analyzer* as_analyzer;
     Connection* conn;
     DataBlock current_packet;
+
+    static uint64_t total_buffered;
 };
 
 // PIA for UDP.
@@ -173,6 +198,7 @@ protected:
 
     void ActivateAnalyzer(zeek::Tag tag, const zeek::detail::Rule* rule = nullptr) override;
     void DeactivateAnalyzer(zeek::Tag tag) override;
+    void Commit() override;
 
 private:
     // FIXME: Not sure yet whether we need both pkt_buffer and stream_buffer.
@@ -4,6 +4,7 @@
 
 #include "zeek/analyzer/Component.h"
 #include "zeek/analyzer/protocol/pia/PIA.h"
+#include "zeek/telemetry/Manager.h"
 
 namespace zeek::plugin::detail::Zeek_PIA {
 
@@ -18,6 +19,26 @@ public:
         config.description = "Analyzers implementing Dynamic Protocol";
         return config;
     }
+
+protected:
+    void InitPostScript() override {
+        zeek::plugin::Plugin::InitPostScript();
+
+        buffered = zeek::telemetry_mgr->GaugeInstance("zeek", "dpd_buffered", {},
+                                                      "Payload buffered for dynamic protocol detection", "bytes", []() {
+                                                          return static_cast<double>(
+                                                              zeek::analyzer::pia::PIA::TotalBuffered());
+                                                      });
+    }
+
+    void Done() override {
+        // Release the gauge while the telemetry manager is still around.
+        buffered.reset();
+        zeek::plugin::Plugin::Done();
+    }
+
+private:
+    zeek::telemetry::GaugePtr buffered;
 } plugin;
 
 } // namespace zeek::plugin::detail::Zeek_PIA
@@ -278,7 +278,7 @@ void TCP_Reassembler::MatchUndelivered(uint64_t up_to_seq, bool use_last_upper)
         // undelivered data implicitly being bol-anchored. It's unclear
         // if that was intended, but there's hardly a right way here,
         // so that seems ok.
-        tcp_analyzer->Conn()->Match(zeek::detail::Rule::PAYLOAD, b.block, b.Size(), IsOrig(), false, false, false);
+        tcp_analyzer->Conn()->Match(zeek::detail::Rule::PAYLOAD, b.Data(), b.Size(), IsOrig(), false, false, false);
     }
 }
 
@@ -312,7 +312,7 @@ void TCP_Reassembler::RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const F
 }
 
 void TCP_Reassembler::RecordBlock(const DataBlock& b, const FilePtr& f) {
-    if ( f->Write((const char*)b.block, b.Size()) )
+    if ( f->Write((const char*)b.Data(), b.Size()) )
         return;
 
     reporter->Error("TCP_Reassembler contents write failed");
@@ -362,7 +362,7 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it) {
             if ( record_contents_file )
                 RecordBlock(b, record_contents_file);
 
-            DeliverBlock(seq, len, b.block);
+            DeliverBlock(seq, len, b.Data());
         }
 
         ++it;
@@ -78,6 +78,12 @@ public:
      */
     const std::string& GetID() const { return id; }
 
+    /**
+     * @return the offset up to which data has been delivered in order.
+     * While a chunk is being delivered, that's the chunk's offset.
+     */
+    uint64_t GetStreamOffset() const { return stream_offset; }
+
     /**
      * @return value of "last_active" field in #val record;
      */
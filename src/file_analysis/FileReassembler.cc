@@ -54,7 +54,7 @@ void FileReassembler::BlockInserted(DataBlockMap::const_iterator it) {
         if ( b.seq == last_reassem_seq ) { // New stuff.
             uint64_t len = b.Size();
             last_reassem_seq += len;
-            the_file->DeliverStream(b.block, len);
+            the_file->DeliverStream(b.Data(), len);
         }
 
         ++it;
@@ -6,6 +6,7 @@
 #include <string>
 
 #include "zeek/Event.h"
+#include "zeek/NetVar.h"
 #include "zeek/file_analysis/Manager.h"
 #include "zeek/util.h"
 
@@ -19,6 +20,21 @@ Extract::Extract(RecordValPtr args, file_analysis::File* file, const std::string
       written(0),
       limit_includes_missing(arg_limit_includes_missing) {
     char buf[128];
+
+    if ( BifConst::file_extract_threads > 0 ) {
+        file_stream = nullptr;
+        int fd = open(filename.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+        if ( fd >= 0 )
+            writer = std::make_shared<ExtractWriter>(fd, filename, BifConst::file_extract_buffer_size);
+        else {
+            util::zeek_strerror_r(errno, buf, sizeof(buf));
+            reporter->Error("cannot open %s: %s", filename.c_str(), buf);
+        }
+
+        return;
+    }
+
     file_stream = fopen(filename.data(), "wb");
 
     if ( file_stream ) {
@@ -35,6 +51,11 @@ Extract::Extract(RecordValPtr args, file_analysis::File* file, const std::string
 }
 
 Extract::~Extract() {
+    if ( writer ) {
+        writer->Close();
+        ExtractWriter::ReportErrors();
+    }
+
     if ( file_stream && fclose(file_stream) ) {
         char buf[128];
         util::zeek_strerror_r(errno, buf, sizeof(buf));
@@ -92,8 +113,33 @@ static bool check_limit_exceeded(uint64_t lim, uint64_t written, uint64_t len, u
     return false;
 }
 
+bool Extract::Write(const u_char* data, uint64_t len) {
+    if ( writer ) {
+        ExtractWriter::ReportErrors();
+
+        if ( writer->Write(data, len) )
+            return true;
+
+        // The writer has reported the error, or will on Close().
+        writer->Close();
+        writer.reset();
+        return false;
+    }
+
+    if ( fwrite(data, len, 1, file_stream) != 1 ) {
+        char buf[128];
+        util::zeek_strerror_r(errno, buf, sizeof(buf));
+        reporter->Error("failed to write to extracted file %s: %s", filename.data(), buf);
+        fclose(file_stream);
+        file_stream = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
 bool Extract::DeliverStream(const u_char* data, uint64_t len) {
-    if ( ! file_stream )
+    if ( ! file_stream && ! writer )
         return false;
 
     uint64_t towrite = 0;
@@ -107,16 +153,9 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len) {
         limit_exceeded = check_limit_exceeded(limit, written, len, &towrite);
     }
 
-    char buf[128];
-
     if ( towrite > 0 ) {
-        if ( fwrite(data, towrite, 1, file_stream) != 1 ) {
-            util::zeek_strerror_r(errno, buf, sizeof(buf));
-            reporter->Error("failed to write to extracted file %s: %s", filename.data(), buf);
-            fclose(file_stream);
-            file_stream = nullptr;
+        if ( ! Write(data, towrite) )
             return false;
-        }
 
         written += towrite;
     }
@@ -125,7 +164,10 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len) {
     // the extraction limit and the file analysis File still proceeding to
     // do other analysis without destructing/closing this one until the very end,
     // so flush anything currently buffered.
-    if ( limit_exceeded && fflush(file_stream) ) {
+    if ( limit_exceeded && writer )
+        writer->Flush();
+    else if ( limit_exceeded && fflush(file_stream) ) {
+        char buf[128];
         util::zeek_strerror_r(errno, buf, sizeof(buf));
         reporter->Warning("cannot fflush extracted file %s: %s", filename.data(), buf);
     }
@@ -134,7 +176,7 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len) {
 }
 
 bool Extract::Undelivered(uint64_t offset, uint64_t len) {
-    if ( ! file_stream )
+    if ( ! file_stream && ! writer )
         return false;
 
     if ( limit_includes_missing ) {
@@ -157,6 +199,11 @@ bool Extract::Undelivered(uint64_t offset, uint64_t len) {
         written += len;
     }
 
+    if ( writer ) {
+        writer->Seek(len + offset);
+        return true;
+    }
+
     if ( fseek(file_stream, len + offset, SEEK_SET) != 0 ) {
         char buf[128];
         util::zeek_strerror_r(errno, buf, sizeof(buf));
@@ -3,22 +3,29 @@
 #pragma once
 
 #include <cstdio>
+#include <memory>
 #include <string>
 
 #include "zeek/Val.h"
 #include "zeek/file_analysis/Analyzer.h"
 #include "zeek/file_analysis/File.h"
+#include "zeek/file_analysis/analyzer/extract/ExtractWriter.h"
 #include "zeek/file_analysis/analyzer/extract/events.bif.h"
 
 namespace zeek::file_analysis::detail {
 
 /**
  * An analyzer to extract content of files to local disk.
+ *
+ * If \c file_extract_threads is non-zero, the data is written by an
+ * ExtractWriter on background threads instead of the main thread.
  */
 class Extract : public file_analysis::Analyzer {
 public:
     /**
      * Destructor.  Will close the file that was used for data extraction.
+     * With a background writer, the file gets closed once all data queued
+     * for it is written.
      */
     ~Extract() override;
 
@@ -69,8 +76,16 @@ protected:
             bool arg_limit_includes_missing);
 
 private:
+    /**
+     * Writes data at the current position, either directly or through
+     * the background writer. Reports and closes the file on errors.
+     * @return false if the data couldn't be written.
+     */
+    bool Write(const u_char* data, uint64_t len);
+
     std::string filename;
     FILE* file_stream;
+    std::shared_ptr<ExtractWriter> writer; // only when writing in the background
     uint64_t limit;              // the file extraction limit
     uint64_t written;            // how many bytes we have written so far
     bool limit_includes_missing; // do count missing bytes against limit if true
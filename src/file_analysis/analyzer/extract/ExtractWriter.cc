@@ -0,0 +1,258 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/file_analysis/analyzer/extract/ExtractWriter.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "zeek/Flare.h"
+#include "zeek/NetVar.h"
+#include "zeek/Reporter.h"
+#include "zeek/iosource/IOSource.h"
+#include "zeek/iosource/Manager.h"
+#include "zeek/threading/TaskPool.h"
+#include "zeek/util.h"
+
+namespace zeek::file_analysis::detail {
+
+namespace {
+
+// Bytes queued across all writers beyond which the main thread waits.
+constexpr uint64_t max_queued_bytes = 256 * 1024 * 1024;
+
+// State shared by all writers. The mutex also protects the writers' queues.
+struct {
+    std::mutex mutex;
+    std::condition_variable progress;
+    uint64_t queued_blocks = 0;
+    uint64_t queued_bytes = 0;
+    uint64_t running_writers = 0;
+    std::vector<std::string> errors;
+} state;
+
+// Wakes up the main loop to report errors as soon as a writer thread runs
+// into one, even if no extraction is going on at the time.
+class ErrorSource final : public iosource::IOSource {
+public:
+    ErrorSource() : IOSource(true) {
+        if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
+            reporter->FatalError("Failed to register file extraction error descriptor");
+    }
+
+    // Called with the mutex held. Fire() runs on the writer threads, so it
+    // mustn't use the reporter.
+    void Fire() { flare.Fire(true); }
+    void Extinguish() { flare.Extinguish(); }
+
+    double GetNextTimeout() override { return -1.0; }
+    void Process() override {}
+    void ProcessFd(int fd, int flags) override { ExtractWriter::ReportErrors(); }
+    const char* Tag() override { return "FileExtract::ErrorSource"; }
+
+private:
+    zeek::detail::Flare flare;
+};
+
+ErrorSource* error_source() {
+    static ErrorSource source;
+    return &source;
+}
+
+threading::TaskPool* writer_pool() {
+    static threading::TaskPool pool(BifConst::file_extract_threads);
+    return &pool;
+}
+
+// Runs on the writer threads, so can't use util::fmt().
+std::string error_message(const char* what, const std::string& filename, int err) {
+    char buf[128];
+    util::zeek_strerror_r(err, buf, sizeof(buf));
+    return std::string(what) + " " + filename + ": " + buf;
+}
+
+// Returns 0 on success, else the errno value.
+int write_all(int fd, const char* data, size_t len, uint64_t offset) {
+    while ( len > 0 ) {
+        ssize_t n = pwrite(fd, data, len, static_cast<off_t>(offset));
+
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+
+            return errno;
+        }
+
+        data += n;
+        len -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+} // namespace
+
+ExtractWriter::ExtractWriter(int arg_fd, std::string arg_filename, uint64_t arg_buffer_size)
+    : fd(arg_fd), filename(std::move(arg_filename)), buffer_size(arg_buffer_size > 0 ? arg_buffer_size : 1) {
+    // Set up on the main thread, before any writer thread may need it.
+    error_source();
+}
+
+ExtractWriter::~ExtractWriter() {
+    if ( fd >= 0 )
+        close(fd);
+}
+
+bool ExtractWriter::Write(const unsigned char* data, uint64_t len) {
+    if ( Failed() )
+        return false;
+
+    while ( len > 0 ) {
+        if ( pending.data.empty() )
+            pending.offset = position;
+
+        // Blocks end at multiples of the buffer size, so that all but the
+        // first and last block of a file are aligned and full.
+        uint64_t n = std::min(len, buffer_size - position % buffer_size);
+        pending.data.append(reinterpret_cast<const char*>(data), n);
+        data += n;
+        len -= n;
+        position += n;
+
+        if ( position % buffer_size == 0 )
+            Submit(false);
+    }
+
+    return true;
+}
+
+void ExtractWriter::Seek(uint64_t offset) {
+    if ( offset == position )
+        return;
+
+    Flush();
+    position = offset;
+}
+
+void ExtractWriter::Flush() {
+    if ( ! pending.data.empty() )
+        Submit(false);
+}
+
+void ExtractWriter::Close() { Submit(true); }
+
+bool ExtractWriter::Failed() const {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return failed;
+}
+
+void ExtractWriter::ReportErrors() {
+    std::vector<std::string> errors;
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        errors.swap(state.errors);
+
+        if ( ! errors.empty() )
+            error_source()->Extinguish();
+    }
+
+    for ( const auto& e : errors )
+        reporter->Error("%s", e.c_str());
+}
+
+void ExtractWriter::Finish() {
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.progress.wait(lock, [] { return state.running_writers == 0; });
+    }
+
+    ReportErrors();
+}
+
+uint64_t ExtractWriter::QueuedBlocks() {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.queued_blocks;
+}
+
+uint64_t ExtractWriter::QueuedBytes() {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.queued_bytes;
+}
+
+void ExtractWriter::Submit(bool arg_closing) {
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    if ( ! pending.data.empty() ) {
+        // Every queued block belongs to a running writer, so this makes
+        // progress.
+        state.progress.wait(lock, [] { return state.queued_bytes < max_queued_bytes; });
+
+        ++state.queued_blocks;
+        state.queued_bytes += pending.data.size();
+        blocks.push_back(std::move(pending));
+        pending = Block{position, {}};
+    }
+
+    if ( arg_closing )
+        closing = true;
+
+    if ( running || (blocks.empty() && ! closing) )
+        return;
+
+    running = true;
+    ++state.running_writers;
+    lock.unlock();
+    writer_pool()->Submit([self = shared_from_this()] { self->Drain(); });
+}
+
+void ExtractWriter::Drain() {
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    while ( ! blocks.empty() ) {
+        auto block = std::move(blocks.front());
+        blocks.pop_front();
+
+        // After an error, just drop the rest.
+        bool skip = failed;
+        lock.unlock();
+
+        int err = skip ? 0 : write_all(fd, block.data.data(), block.data.size(), block.offset);
+
+        lock.lock();
+        --state.queued_blocks;
+        state.queued_bytes -= block.data.size();
+        state.progress.notify_all();
+
+        if ( err ) {
+            failed = true;
+            state.errors.push_back(error_message("failed to write to extracted file", filename, err));
+            error_source()->Fire();
+        }
+    }
+
+    if ( closing && fd >= 0 ) {
+        int closing_fd = fd;
+        fd = -1;
+        lock.unlock();
+
+        int err = close(closing_fd) ? errno : 0;
+
+        lock.lock();
+
+        if ( err ) {
+            state.errors.push_back(error_message("cannot close", filename, err));
+            error_source()->Fire();
+        }
+    }
+
+    running = false;
+    --state.running_writers;
+    state.progress.notify_all();
+}
+
+} // namespace zeek::file_analysis::detail
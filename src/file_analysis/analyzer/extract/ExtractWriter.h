@@ -0,0 +1,119 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace zeek::file_analysis::detail {
+
+/**
+ * Writes an extracted file from a background thread, so that a slow disk
+ * doesn't stall the main thread.
+ *
+ * Data is collected into blocks of up to the configured buffer size, which
+ * end at offsets that are multiples of that size. Full blocks are queued to
+ * a pool of writer threads shared by all files and written with pwrite(),
+ * one block of a given file at a time. If more than a fixed amount of data
+ * is queued across all files, the main thread waits for the writers to
+ * catch up.
+ *
+ * Errors are detected asynchronously. The writer stops writing once one
+ * occurs and Failed() starts returning true. The error messages are reported
+ * from the main thread by ReportErrors(), which the main loop calls as soon
+ * as there are any.
+ */
+class ExtractWriter : public std::enable_shared_from_this<ExtractWriter> {
+public:
+    /**
+     * Constructor.
+     * @param fd file descriptor of the extraction file, which the writer
+     *        takes ownership of.
+     * @param filename the file's name, for error messages.
+     * @param buffer_size bytes to collect before writing them out.
+     */
+    ExtractWriter(int fd, std::string filename, uint64_t buffer_size);
+
+    /**
+     * Destructor. Only runs once the writer threads are done with the file.
+     */
+    ~ExtractWriter();
+
+    /**
+     * Appends data at the current position.
+     * @return false if an earlier write failed, else true.
+     */
+    bool Write(const unsigned char* data, uint64_t len);
+
+    /**
+     * Moves the position for the next Write(), leaving a hole in the file.
+     */
+    void Seek(uint64_t offset);
+
+    /**
+     * Queues all data collected so far, even if it doesn't fill a block.
+     */
+    void Flush();
+
+    /**
+     * Queues the remaining data and closes the file once that's written.
+     * The writer must not be used afterwards.
+     */
+    void Close();
+
+    /**
+     * Returns true if writing to the file failed.
+     */
+    bool Failed() const;
+
+    /**
+     * Reports the errors of all writers that occurred since the last call
+     * through the reporter. Must be called from the main thread.
+     */
+    static void ReportErrors();
+
+    /**
+     * Waits for all writers to finish and reports their errors. Used at
+     * shutdown.
+     */
+    static void Finish();
+
+    /**
+     * Returns the number of blocks queued by all writers and not yet
+     * written.
+     */
+    static uint64_t QueuedBlocks();
+
+    /**
+     * Returns the number of bytes queued by all writers and not yet
+     * written.
+     */
+    static uint64_t QueuedBytes();
+
+private:
+    struct Block {
+        uint64_t offset = 0;
+        std::string data;
+    };
+
+    void Submit(bool closing);
+    void Drain();
+
+    int fd;
+    std::string filename;
+    uint64_t buffer_size;
+
+    // Only accessed by the main thread.
+    Block pending;
+    uint64_t position = 0;
+
+    // Protected by the mutex shared by all writers.
+    std::deque<Block> blocks;
+    bool running = false;
+    bool closing = false;
+    bool failed = false;
+};
+
+} // namespace zeek::file_analysis::detail
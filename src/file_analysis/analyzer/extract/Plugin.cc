@@ -4,6 +4,7 @@
 
 #include "zeek/file_analysis/Component.h"
 #include "zeek/file_analysis/analyzer/extract/Extract.h"
+#include "zeek/telemetry/Manager.h"
 
 namespace zeek::plugin::detail::Zeek_FileExtract {
 
@@ -17,6 +18,37 @@ public:
         config.description = "Extract file content";
         return config;
     }
+
+protected:
+    void InitPostScript() override {
+        zeek::plugin::Plugin::InitPostScript();
+
+        using zeek::file_analysis::detail::ExtractWriter;
+
+        queued_blocks =
+            zeek::telemetry_mgr->GaugeInstance("zeek", "file_extract_queued_blocks", {},
+                                               "Blocks of extracted file data waiting to be written", "", []() {
+                                                   return static_cast<double>(ExtractWriter::QueuedBlocks());
+                                               });
+        queued_bytes =
+            zeek::telemetry_mgr->GaugeInstance("zeek", "file_extract_queued", {},
+                                               "Bytes of extracted file data waiting to be written", "bytes", []() {
+                                                   return static_cast<double>(ExtractWriter::QueuedBytes());
+                                               });
+    }
+
+    void Done() override {
+        zeek::file_analysis::detail::ExtractWriter::Finish();
+
+        // Release the gauges while the telemetry manager is still around.
+        queued_blocks.reset();
+        queued_bytes.reset();
+        zeek::plugin::Plugin::Done();
+    }
+
+private:
+    zeek::telemetry::GaugePtr queued_blocks;
+    zeek::telemetry::GaugePtr queued_bytes;
 } plugin;
 
 } // namespace zeek::plugin::detail::Zeek_FileExtract
@@ -2,14 +2,117 @@
 
 #include "zeek/file_analysis/analyzer/hash/Hash.h"
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 
 #include "zeek/Event.h"
+#include "zeek/NetVar.h"
 #include "zeek/file_analysis/Manager.h"
+#include "zeek/threading/TaskPool.h"
 #include "zeek/util.h"
 
 namespace zeek::file_analysis::detail {
 
+namespace {
+
+using ChunkPtr = std::shared_ptr<const std::string>;
+
+// Bytes queued for a single digest before DeliverStream() waits for the
+// workers to catch up.
+constexpr size_t max_pending_bytes = 16 * 1024 * 1024;
+
+// The most recent chunk copied for hashing. All hash analyzers of a file
+// get handed the same data within one delivery of the file, so the MD5,
+// SHA1 and SHA256 analyzers can share a single copy. Analyzers catching up
+// on the BOF buffer get other data at the same stream offset, hence the
+// pointer is part of the key. Only used on the main thread.
+struct {
+    std::string file_id;
+    uint64_t stream_offset = 0;
+    const u_char* ptr = nullptr;
+    ChunkPtr data;
+} last_chunk;
+
+void release_last_chunk(const std::string& file_id) {
+    if ( last_chunk.data && last_chunk.file_id == file_id ) {
+        last_chunk.data.reset();
+        last_chunk.ptr = nullptr;
+    }
+}
+
+threading::TaskPool* hash_pool() {
+    // Separate from TaskPool::Shared() so the size follows file_hash_threads.
+    static threading::TaskPool pool(BifConst::file_hash_threads);
+    return &pool;
+}
+
+} // namespace
+
+/**
+ * Feeds the chunks of one file to its digest on the hash pool. At most one
+ * task per job runs at any time, so chunks are hashed in order.
+ */
+class HashJob : public std::enable_shared_from_this<HashJob> {
+public:
+    explicit HashJob(HashVal* arg_hash) : hash(arg_hash) {}
+
+    /**
+     * Queues a chunk, waiting first if too much data is already pending.
+     */
+    void Add(ChunkPtr chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [this] { return pending_bytes < max_pending_bytes; });
+
+        pending_bytes += chunk->size();
+        chunks.push_back(std::move(chunk));
+
+        if ( running )
+            return;
+
+        running = true;
+        lock.unlock();
+        hash_pool()->Submit([self = shared_from_this()] { self->Drain(); });
+    }
+
+    /**
+     * Waits until all queued chunks have been fed to the digest. Afterwards
+     * the main thread owns the digest again.
+     */
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        progress.wait(lock, [this] { return ! running; });
+    }
+
+private:
+    void Drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while ( ! chunks.empty() ) {
+            auto chunk = std::move(chunks.front());
+            chunks.pop_front();
+            lock.unlock();
+
+            hash->Feed(chunk->data(), chunk->size());
+
+            lock.lock();
+            pending_bytes -= chunk->size();
+            progress.notify_all();
+        }
+
+        running = false;
+        progress.notify_all();
+    }
+
+    HashVal* hash; // Owned by the analyzer, which waits for us before releasing it.
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::deque<ChunkPtr> chunks;
+    size_t pending_bytes = 0;
+    bool running = false;
+};
+
 StringValPtr MD5::kind_val = make_intrusive<StringVal>("md5");
 StringValPtr SHA1::kind_val = make_intrusive<StringVal>("sha1");
 StringValPtr SHA256::kind_val = make_intrusive<StringVal>("sha256");
@@ -21,9 +124,19 @@ Hash::Hash(RecordValPtr args, file_analysis::File* file, HashVal* hv, StringValP
       fed(false),
       kind(std::move(arg_kind)) {
     hash->Init();
+
+    if ( BifConst::file_hash_threads > 0 )
+        job = std::make_shared<HashJob>(hash);
 }
 
-Hash::~Hash() { Unref(hash); }
+Hash::~Hash() {
+    if ( job ) {
+        job->Wait();
+        release_last_chunk(GetFile()->GetID());
+    }
+
+    Unref(hash);
+}
 
 bool Hash::DeliverStream(const u_char* data, uint64_t len) {
     if ( ! hash->IsValid() )
@@ -32,7 +145,26 @@ bool Hash::DeliverStream(const u_char* data, uint64_t len) {
     if ( ! fed )
         fed = len > 0;
 
-    hash->Feed(data, len);
+    if ( ! job ) {
+        hash->Feed(data, len);
+        return true;
+    }
+
+    if ( len == 0 )
+        return true;
+
+    auto file = GetFile();
+    const auto& id = file->GetID();
+
+    if ( ! last_chunk.data || last_chunk.ptr != data || last_chunk.data->size() != len ||
+         last_chunk.stream_offset != file->GetStreamOffset() || last_chunk.file_id != id ) {
+        last_chunk.file_id = id;
+        last_chunk.stream_offset = file->GetStreamOffset();
+        last_chunk.ptr = data;
+        last_chunk.data = std::make_shared<const std::string>(reinterpret_cast<const char*>(data), len);
+    }
+
+    job->Add(last_chunk.data);
     return true;
 }
 
@@ -44,6 +176,11 @@ bool Hash::EndOfFile() {
 bool Hash::Undelivered(uint64_t offset, uint64_t len) { return false; }
 
 void Hash::Finalize() {
+    if ( job ) {
+        job->Wait();
+        release_last_chunk(GetFile()->GetID());
+    }
+
     if ( ! hash->IsValid() || ! fed )
         return;
 
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "zeek/OpaqueVal.h"
@@ -12,8 +13,15 @@
 
 namespace zeek::file_analysis::detail {
 
+class HashJob;
+
 /**
  * An analyzer to produce a hash of file contents.
+ *
+ * If \c file_hash_threads is non-zero, the digest is computed on a shared
+ * pool of threads instead of the main thread. Chunks are queued in order
+ * and fed to the digest one at a time, and the "file_hash" event is raised
+ * from the main thread once all of them are done.
  */
 class Hash : public file_analysis::Analyzer {
 public:
@@ -65,6 +73,9 @@ private:
     HashVal* hash;
     bool fed;
     StringValPtr kind;
+
+    // Only set when hashing off the main thread.
+    std::shared_ptr<HashJob> job;
 };
 
 /**
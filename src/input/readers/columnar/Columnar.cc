@@ -0,0 +1,355 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/input/readers/columnar/Columnar.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+
+#include "zeek/input/readers/columnar/columnar.bif.h"
+#include "zeek/logging/writers/columnar/Format.h"
+#include "zeek/threading/SerialTypes.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::input::reader::detail {
+
+using namespace zeek::logging::writer::detail::columnar;
+
+Columnar::Columnar(ReaderFrontend* frontend) : ReaderBackend(frontend) {}
+
+Columnar::~Columnar() { DoClose(); }
+
+void Columnar::DoClose() { CloseInput(); }
+
+bool Columnar::OpenInput() {
+    in = std::make_unique<std::ifstream>(fname.c_str(), std::ios_base::in | std::ios_base::binary);
+
+    if ( in->fail() ) {
+        Error(Fmt("Init: cannot open %s", fname.c_str()));
+        in.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void Columnar::CloseInput() {
+    if ( in ) {
+        in->close();
+        in.reset();
+    }
+}
+
+bool Columnar::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields) {
+    path_prefix = BifConst::InputColumnar::path_prefix->ToStdString();
+
+    if ( ! info.source || strlen(info.source) == 0 ) {
+        Error("No source path provided");
+        return false;
+    }
+
+    fname = info.source;
+
+    // Handle path-prefixing. See similar logic in Ascii::OpenFile().
+    if ( fname.front() != '/' && ! path_prefix.empty() ) {
+        std::string path = path_prefix;
+        std::size_t last = path.find_last_not_of('/');
+
+        if ( last == std::string::npos ) // Nothing but slashes -- weird but ok...
+            path = "/";
+        else
+            path.erase(last + 1);
+
+        fname = path + "/" + fname;
+    }
+
+    if ( ! OpenInput() )
+        return false;
+
+    if ( UpdateModificationTime() == -1 )
+        return false;
+
+    return DoUpdate();
+}
+
+int Columnar::UpdateModificationTime() {
+    struct stat sb;
+
+    if ( stat(fname.c_str(), &sb) == -1 ) {
+        Error(Fmt("Could not get stat for %s", fname.c_str()));
+        return -1;
+    }
+
+    if ( sb.st_ino == ino && sb.st_mtime == mtime )
+        // no change
+        return 0;
+
+    mtime = sb.st_mtime;
+    ino = sb.st_ino;
+    return 1;
+}
+
+bool Columnar::ReadExactly(std::string* buf, size_t n) {
+    buf->resize(n);
+    in->read(buf->data(), static_cast<std::streamsize>(n));
+
+    if ( static_cast<size_t>(in->gcount()) == n )
+        return true;
+
+    in->clear(); // remove end of file evil bits
+    return false;
+}
+
+bool Columnar::ReadHeader() {
+    if ( ! ReadExactly(&group, sizeof(MAGIC)) || memcmp(group.data(), MAGIC, sizeof(MAGIC)) != 0 ) {
+        Error(Fmt("%s is not a columnar log file", fname.c_str()));
+        return false;
+    }
+
+    uint64_t len = 0;
+    for ( int shift = 0; shift < 64; shift += 7 ) {
+        int c = in->get();
+
+        if ( c == std::char_traits<char>::eof() ) {
+            in->clear();
+            break;
+        }
+
+        len |= static_cast<uint64_t>(c & 0x7f) << shift;
+
+        if ( ! (c & 0x80) )
+            break;
+    }
+
+    if ( len == 0 || len > MAX_CHUNK_SIZE || ! ReadExactly(&group, len) ) {
+        Error(Fmt("truncated header in %s", fname.c_str()));
+        return false;
+    }
+
+    ByteReader r(reinterpret_cast<const uint8_t*>(group.data()), group.size());
+    std::string path;
+
+    if ( r.GetVarint() != VERSION ) {
+        Error(Fmt("unsupported version of columnar log file %s", fname.c_str()));
+        return false;
+    }
+
+    r.GetString(&path);
+    r.GetDouble(); // open time
+    uint64_t num_columns = r.GetVarint();
+
+    if ( ! r.Ok() || num_columns > r.Remaining() ) {
+        Error(Fmt("corrupt header in %s", fname.c_str()));
+        return false;
+    }
+
+    file_columns.clear();
+    for ( uint64_t i = 0; i < num_columns; ++i ) {
+        FileColumn c;
+        r.GetString(&c.name);
+        c.type = static_cast<TypeTag>(r.GetU8());
+        c.subtype = static_cast<TypeTag>(r.GetU8());
+        r.GetU8(); // optional
+        file_columns.push_back(std::move(c));
+    }
+
+    if ( ! r.Ok() ) {
+        Error(Fmt("corrupt header in %s", fname.c_str()));
+        return false;
+    }
+
+    column_to_field.assign(file_columns.size(), -1);
+
+    for ( int i = 0; i < NumFields(); ++i ) {
+        const Field* f = Fields()[i];
+        auto it = std::find_if(file_columns.begin(), file_columns.end(),
+                               [f](const FileColumn& c) { return c.name == f->name; });
+
+        if ( it == file_columns.end() ) {
+            Error(Fmt("field %s not found in %s", f->name, fname.c_str()));
+            return false;
+        }
+
+        bool container = f->type == TYPE_TABLE || f->type == TYPE_VECTOR;
+
+        if ( it->type != f->type || (container && it->subtype != f->subtype) ) {
+            Error(Fmt("field %s has type %s in %s, expected %s", f->name, type_name(it->type), fname.c_str(),
+                      type_name(f->type)));
+            return false;
+        }
+
+        column_to_field[it - file_columns.begin()] = i;
+    }
+
+    return true;
+}
+
+bool Columnar::ReadRowGroups() {
+    std::vector<std::vector<Value*>> values(NumFields());
+
+    while ( true ) {
+        auto start = in->tellg();
+        bool complete = false;
+
+        if ( ReadExactly(&group, 12) ) {
+            ByteReader pr(reinterpret_cast<const uint8_t*>(group.data()), group.size());
+
+            if ( pr.GetU32() != ROW_GROUP_MAGIC ) {
+                Error(Fmt("corrupt row group in %s", fname.c_str()));
+                return false;
+            }
+
+            uint64_t len = pr.GetU64();
+
+            if ( len > MAX_CHUNK_SIZE ) {
+                Error(Fmt("row group too large in %s", fname.c_str()));
+                return false;
+            }
+
+            complete = ReadExactly(&group, len);
+        }
+
+        if ( ! complete ) {
+            // Nothing more, or the writer is still in the middle of the
+            // next row group.
+            in->seekg(start);
+            return true;
+        }
+
+        ByteReader r(reinterpret_cast<const uint8_t*>(group.data()), group.size());
+        uint64_t rows = r.GetVarint();
+        uint64_t num_columns = r.GetVarint();
+
+        bool ok = r.Ok() && num_columns == file_columns.size() && rows <= MAX_CHUNK_SIZE;
+        std::string error = "corrupt row group";
+
+        for ( uint64_t c = 0; ok && c < num_columns; ++c ) {
+            auto compression = static_cast<Compression>(r.GetU8());
+            uint64_t raw_size = r.GetVarint();
+            uint64_t stored_size = r.GetVarint();
+            const uint8_t* data = r.GetBytes(stored_size);
+
+            if ( ! data ) {
+                ok = false;
+                break;
+            }
+
+            int field = column_to_field[c];
+
+            if ( field < 0 )
+                continue;
+
+            if ( compression != Compression::None ) {
+                if ( ! CompressionAvailable(compression) ) {
+                    error = std::string("unsupported ") + CompressionName(compression) + " compression";
+                    ok = false;
+                    break;
+                }
+
+                if ( ! Decompress(compression, data, stored_size, raw_size, &raw) ) {
+                    ok = false;
+                    break;
+                }
+
+                data = reinterpret_cast<const uint8_t*>(raw.data());
+            }
+
+            else if ( raw_size != stored_size ) {
+                ok = false;
+                break;
+            }
+
+            ok = DecodeColumn(Fields()[field], data, raw_size, rows, &values[field]);
+        }
+
+        if ( ! ok ) {
+            for ( auto& column : values )
+                for ( auto* v : column )
+                    delete v;
+
+            Error(Fmt("%s in %s", error.c_str(), fname.c_str()));
+            return false;
+        }
+
+        for ( uint64_t i = 0; i < rows; ++i ) {
+            Value** fields = new Value*[NumFields()];
+
+            for ( int j = 0; j < NumFields(); ++j )
+                fields[j] = values[j][i];
+
+            if ( Info().mode == MODE_STREAM )
+                Put(fields);
+            else
+                SendEntry(fields);
+        }
+
+        for ( auto& column : values )
+            column.clear();
+    }
+}
+
+bool Columnar::DoUpdate() {
+    if ( firstrun )
+        firstrun = false;
+
+    else {
+        switch ( Info().mode ) {
+            case MODE_REREAD: {
+                switch ( UpdateModificationTime() ) {
+                    case -1: return false; // error
+                    case 0: return true;   // no change
+                    case 1: break;         // file changed. reread.
+                    default: assert(false);
+                }
+                // fallthrough
+            }
+
+            case MODE_MANUAL:
+                CloseInput();
+
+                if ( ! OpenInput() )
+                    return false;
+
+                break;
+
+            case MODE_STREAM:
+                // Continue after the last complete row group.
+                break;
+
+            default: assert(false);
+        }
+    }
+
+    if ( in->tellg() == 0 && ! ReadHeader() )
+        return false;
+
+    if ( ! ReadRowGroups() )
+        return false;
+
+    if ( Info().mode != MODE_STREAM )
+        EndCurrentSend();
+
+    return true;
+}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time) {
+    switch ( Info().mode ) {
+        case MODE_MANUAL:
+            // yay, we do nothing :)
+            break;
+
+        case MODE_REREAD:
+        case MODE_STREAM:
+            Update(); // call update and not DoUpdate, because update
+                      // checks disabled.
+            break;
+
+        default: assert(false);
+    }
+
+    return true;
+}
+
+} // namespace zeek::input::reader::detail
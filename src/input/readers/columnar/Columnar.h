@@ -0,0 +1,74 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/input/ReaderBackend.h"
+
+namespace zeek::input::reader::detail {
+
+/**
+ * Reader for files written by the columnar log writer. Only the columns
+ * matching the requested fields get decompressed and decoded.
+ */
+class Columnar : public ReaderBackend {
+public:
+    explicit Columnar(ReaderFrontend* frontend);
+    ~Columnar() override;
+
+    static ReaderBackend* Instantiate(ReaderFrontend* frontend) { return new Columnar(frontend); }
+
+protected:
+    bool DoInit(const ReaderInfo& info, int arg_num_fields, const threading::Field* const* fields) override;
+    void DoClose() override;
+    bool DoUpdate() override;
+    bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+    struct FileColumn {
+        std::string name;
+        TypeTag type;
+        TypeTag subtype;
+    };
+
+    bool OpenInput();
+    void CloseInput();
+    int UpdateModificationTime();
+
+    // Reads the file header and maps the requested fields to its columns.
+    bool ReadHeader();
+
+    // Reads and sends all complete row groups following the current
+    // position. Stops without error at an incomplete one, leaving the
+    // position at its start.
+    bool ReadRowGroups();
+
+    // Reads exactly n bytes into buf. Returns false if there aren't enough,
+    // in which case the position is undefined.
+    bool ReadExactly(std::string* buf, size_t n);
+
+    std::string fname;
+    std::unique_ptr<std::ifstream> in;
+    time_t mtime = 0;
+    ino_t ino = 0;
+    bool firstrun = true;
+
+    std::vector<FileColumn> file_columns;
+    // For each column of the file, the index of the requested field it
+    // provides, or -1 if none.
+    std::vector<int> column_to_field;
+
+    // Scratch buffers, kept across row groups.
+    std::string group;
+    std::string raw;
+
+    // Options set from the script-level.
+    std::string path_prefix;
+};
+
+} // namespace zeek::input::reader::detail
@@ -0,0 +1,142 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/PacketBuffer.h"
+
+#include <cstring>
+#include <utility>
+
+#include "zeek/SlabPool.h"
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek {
+
+PacketBuffer* PacketBuffer::current = nullptr;
+uint64_t PacketBuffer::num_detached = 0;
+
+void PacketBuffer::Bind(const u_char* arg_data, uint32_t arg_len) {
+    if ( detached )
+        delete[] data;
+
+    data = arg_data;
+    len = arg_len;
+    detached = false;
+}
+
+void PacketBuffer::Detach() {
+    if ( detached || ! data )
+        return;
+
+    auto tmp = new u_char[len];
+    memcpy(tmp, data, len);
+    data = tmp;
+    detached = true;
+    ++num_detached;
+}
+
+PacketDataRef::PacketDataRef(const u_char* data, uint64_t arg_len) : len(arg_len) {
+    auto b = PacketBuffer::Current();
+
+    if ( b && b->Contains(data, len) ) {
+        buffer = {NewRef{}, b};
+        offset = data - b->Data();
+    }
+    else
+        CopyFrom(data);
+}
+
+PacketDataRef::PacketDataRef(const PacketDataRef& other)
+    : buffer(other.buffer), offset(other.offset), len(other.len) {
+    if ( ! buffer )
+        CopyFrom(other.copy);
+}
+
+PacketDataRef::PacketDataRef(PacketDataRef&& other) noexcept
+    : buffer(std::move(other.buffer)),
+      offset(other.offset),
+      copy(std::exchange(other.copy, nullptr)),
+      len(std::exchange(other.len, 0)) {}
+
+PacketDataRef& PacketDataRef::operator=(const PacketDataRef& other) {
+    if ( this != &other ) {
+        PacketDataRef tmp(other);
+        *this = std::move(tmp);
+    }
+
+    return *this;
+}
+
+PacketDataRef& PacketDataRef::operator=(PacketDataRef&& other) noexcept {
+    if ( this != &other ) {
+        FreeCopy();
+        buffer = std::move(other.buffer);
+        offset = other.offset;
+        copy = std::exchange(other.copy, nullptr);
+        len = std::exchange(other.len, 0);
+    }
+
+    return *this;
+}
+
+void PacketDataRef::CopyFrom(const u_char* data) {
+    if ( ! data )
+        return;
+
+    // The pool doesn't do zero-sized chunks.
+    copy = static_cast<u_char*>(detail::SlabPool::Allocate(len ? len : 1));
+    memcpy(copy, data, len);
+}
+
+void PacketDataRef::FreeCopy() {
+    detail::SlabPool::Free(copy, len ? len : 1);
+}
+
+TEST_SUITE_BEGIN("PacketBuffer");
+
+TEST_CASE("packet data references and detaching") {
+    u_char ring_slot[12] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l'};
+    auto b = new PacketBuffer();
+    b->Bind(ring_slot, 8);
+
+    PacketBuffer::SetCurrent(b);
+    PacketDataRef inside(ring_slot + 2, 4);
+    PacketDataRef past_end(ring_slot + 6, 4);
+    PacketBuffer::SetCurrent(nullptr);
+
+    CHECK(inside.IsReference());
+    CHECK(inside.Data() == ring_slot + 2);
+    CHECK_FALSE(past_end.IsReference());
+    CHECK(b->Shared());
+
+    PacketDataRef copied = inside;
+    CHECK(copied.IsReference());
+
+    // The source wants its slot back.
+    auto detached_before = PacketBuffer::NumDetached();
+    b->Detach();
+    CHECK(PacketBuffer::NumDetached() == detached_before + 1);
+    memset(ring_slot, 'x', sizeof(ring_slot));
+
+    CHECK(memcmp(inside.Data(), "cdef", 4) == 0);
+    CHECK(memcmp(copied.Data(), "cdef", 4) == 0);
+
+    // The source drops its reference, the consumers keep theirs.
+    b->Unref();
+    CHECK(memcmp(inside.Data(), "cdef", 4) == 0);
+}
+
+TEST_CASE("packet data copies without a current buffer") {
+    u_char bytes[4] = {1, 2, 3, 4};
+    PacketDataRef r(bytes, sizeof(bytes));
+    CHECK_FALSE(r.IsReference());
+    CHECK(r.Data() != bytes);
+    CHECK(memcmp(r.Data(), bytes, sizeof(bytes)) == 0);
+
+    PacketDataRef moved = std::move(r);
+    CHECK(moved.Len() == 4);
+    CHECK(r.Len() == 0);
+    CHECK(r.Data() == nullptr);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek
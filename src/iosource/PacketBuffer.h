@@ -0,0 +1,172 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+
+#include "zeek/IntrusivePtr.h"
+
+namespace zeek {
+
+/**
+ * Reference-counted handle for the data of a packet that came out of a
+ * packet source.
+ *
+ * Initially, the buffer points to memory owned by the source, such as a
+ * slot of a capture ring. Consumers that want to keep data of the packet
+ * around beyond its processing, like reassembly or the PIA, can take a
+ * reference to the buffer through PacketDataRef instead of copying the
+ * data. Before the source reuses the memory, it calls Detach() on buffers
+ * that are still referenced, which moves the data to the heap. Either way,
+ * Data() always returns a valid pointer for as long as the buffer lives.
+ *
+ * Buffers are only used by the main thread, and reference counting isn't
+ * thread-safe.
+ */
+class PacketBuffer {
+public:
+    PacketBuffer() = default;
+    ~PacketBuffer() {
+        if ( detached )
+            delete[] data;
+    }
+
+    PacketBuffer(const PacketBuffer&) = delete;
+    PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+    /**
+     * Points the buffer to a packet's data. Must only be called while
+     * nobody else references the buffer.
+     *
+     * @param data The packet data, owned by the packet source.
+     *
+     * @param len The number of bytes valid in *data*.
+     */
+    void Bind(const u_char* data, uint32_t len);
+
+    /**
+     * Copies the data to the heap, if it still points to the source's
+     * memory. Afterwards, the source is free to reuse that memory.
+     */
+    void Detach();
+
+    /**
+     * Returns the packet data.
+     */
+    const u_char* Data() const { return data; }
+
+    /**
+     * Returns the number of bytes of packet data.
+     */
+    uint32_t Len() const { return len; }
+
+    /**
+     * Returns true if the given range lies within the packet data.
+     */
+    bool Contains(const u_char* p, uint64_t n) const {
+        return data && p >= data && n <= len && static_cast<uint64_t>(p - data) <= len - n;
+    }
+
+    /**
+     * Returns true if the data has been copied to the heap.
+     */
+    bool IsDetached() const { return detached; }
+
+    /**
+     * Returns true if somebody besides the packet source references the
+     * buffer.
+     */
+    bool Shared() const { return ref_cnt > 1; }
+
+    void Ref() { ++ref_cnt; }
+    void Unref() {
+        if ( --ref_cnt == 0 )
+            delete this;
+    }
+
+    /**
+     * Returns the buffer of the packet currently being dispatched, or null
+     * if there is none. Data handed to analyzers that lies within this
+     * buffer may be referenced instead of copied.
+     */
+    static PacketBuffer* Current() { return current; }
+
+    /**
+     * Sets the buffer of the packet currently being dispatched. Used by
+     * packet sources.
+     */
+    static void SetCurrent(PacketBuffer* b) { current = b; }
+
+    /**
+     * Returns the number of times buffers had to be copied because they
+     * were still referenced when their source needed the memory back.
+     */
+    static uint64_t NumDetached() { return num_detached; }
+
+private:
+    const u_char* data = nullptr;
+    uint32_t len = 0;
+    bool detached = false;
+    int ref_cnt = 1;
+
+    static PacketBuffer* current;
+    static uint64_t num_detached;
+};
+
+inline void Ref(PacketBuffer* b) { b->Ref(); }
+inline void Unref(PacketBuffer* b) { b->Unref(); }
+
+using PacketBufferPtr = IntrusivePtr<PacketBuffer>;
+
+/**
+ * A range of bytes that references the current packet's buffer if the
+ * bytes lie within it, and holds its own copy otherwise. Copies come from
+ * detail::SlabPool.
+ */
+class PacketDataRef {
+public:
+    PacketDataRef() = default;
+
+    /**
+     * Constructor.
+     *
+     * @param data The start of the range.
+     *
+     * @param len The number of bytes in the range.
+     */
+    PacketDataRef(const u_char* data, uint64_t len);
+
+    PacketDataRef(const PacketDataRef& other);
+    PacketDataRef(PacketDataRef&& other) noexcept;
+    PacketDataRef& operator=(const PacketDataRef& other);
+    PacketDataRef& operator=(PacketDataRef&& other) noexcept;
+
+    ~PacketDataRef() { FreeCopy(); }
+
+    /**
+     * Returns the bytes, or null for a default-constructed instance.
+     */
+    const u_char* Data() const { return buffer ? buffer->Data() + offset : copy; }
+
+    /**
+     * Returns the number of bytes.
+     */
+    uint64_t Len() const { return len; }
+
+    /**
+     * Returns true if the bytes are referenced rather than copied.
+     */
+    bool IsReference() const { return buffer != nullptr; }
+
+private:
+    void CopyFrom(const u_char* data);
+    void FreeCopy();
+
+    PacketBufferPtr buffer;
+    uint64_t offset = 0;
+    u_char* copy = nullptr;
+    uint64_t len = 0;
+};
+
+} // namespace zeek
@@ -23,9 +23,10 @@ PktSrc::Properties::Properties() {
     link_type = -1;
     netmask = NETMASK_UNKNOWN;
     is_live = false;
+    batch_size = 1;
 }
 
-PktSrc::PktSrc() {
+PktSrc::PktSrc() : batch(1) {
     have_packet = false;
     // Small lie to make a new PktSrc look like the previous ExtractNextPacket() was successful.
     had_packet = true;
@@ -57,6 +58,12 @@ void PktSrc::Opened(const Properties& arg_props) {
     props = arg_props;
     SetClosed(false);
 
+    // Sizing the batch once here means the Packet instances never move
+    // while a batch is outstanding.
+    batch.resize(std::max(props.batch_size, size_t(1)));
+    buffers.resize(batch.size());
+    batch_len = batch_idx = 0;
+
     if ( ! PrecompileFilter(0, "") || ! SetFilter(0) ) {
         Close();
         return;
@@ -97,6 +104,11 @@ void PktSrc::InternalError(const std::string& msg) { reporter->InternalError("%s
 void PktSrc::InitSource() { Open(); }
 
 void PktSrc::Done() {
+    // The source's memory goes away with Close().
+    for ( auto& b : buffers )
+        if ( b && b->Shared() )
+            b->Detach();
+
     if ( IsOpen() )
         Close();
 }
@@ -117,10 +129,16 @@ void PktSrc::Process() {
     if ( ! ExtractNextPacketInternal() )
         return;
 
-    run_state::detail::dispatch_packet(&current_packet, this);
-
-    have_packet = false;
-    DoneWithPacket();
+    // Drain the whole batch before going back to the main loop. In
+    // pseudo-realtime mode GetNextTimeout() paces individual packets,
+    // so we only dispatch one per call there.
+    do {
+        PacketBuffer::SetCurrent(buffers[batch_idx].get());
+        run_state::detail::dispatch_packet(&batch[batch_idx], this);
+        PacketBuffer::SetCurrent(nullptr);
+        ++batch_idx;
+    } while ( NextBatchPacket() && IsOpen() && ! run_state::pseudo_realtime &&
+              ! run_state::is_processing_suspended() );
 }
 
 const char* PktSrc::Tag() { return "PktSrc"; }
@@ -139,19 +157,19 @@ bool PktSrc::ExtractNextPacketInternal() {
     if ( run_state::pseudo_realtime )
         run_state::detail::current_wallclock = util::current_time(true);
 
-    if ( ExtractNextPacket(&current_packet) ) {
-        had_packet = true;
+    batch_idx = 0;
+    batch_len = ExtractNextPacketBatch(batch.data(), batch.size());
 
-        if ( current_packet.time < 0 ) {
-            Weird("negative_packet_timestamp", &current_packet);
-            return false;
-        }
+    if ( batch_len > 0 ) {
+        for ( size_t i = 0; i < batch_len; ++i ) {
+            if ( ! buffers[i] )
+                buffers[i] = make_intrusive<PacketBuffer>();
 
-        if ( ! run_state::detail::first_timestamp )
-            run_state::detail::first_timestamp = current_packet.time;
+            buffers[i]->Bind(batch[i].data, batch[i].cap_len);
+        }
 
-        have_packet = true;
-        return true;
+        had_packet = true;
+        return NextBatchPacket();
     }
     else {
         // Update the idle_at timestamp the first time we've failed
@@ -171,6 +189,49 @@ bool PktSrc::ExtractNextPacketInternal() {
     return false;
 }
 
+bool PktSrc::NextBatchPacket() {
+    while ( batch_idx < batch_len ) {
+        const Packet& pkt = batch[batch_idx];
+
+        if ( pkt.time >= 0 ) {
+            if ( ! run_state::detail::first_timestamp )
+                run_state::detail::first_timestamp = pkt.time;
+
+            have_packet = true;
+            return true;
+        }
+
+        Weird("negative_packet_timestamp", &pkt);
+        ++batch_idx;
+    }
+
+    ReleasePacketBuffers(buffers.data(), batch_len);
+
+    for ( size_t i = 0; i < batch_len; ++i )
+        if ( buffers[i]->Shared() )
+            buffers[i] = nullptr;
+
+    have_packet = false;
+    batch_len = batch_idx = 0;
+    DoneWithPacketBatch();
+    return false;
+}
+
+size_t PktSrc::ExtractNextPacketBatch(Packet* pkts, size_t max) {
+    if ( max == 0 )
+        return 0;
+
+    return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+}
+
+void PktSrc::DoneWithPacketBatch() { DoneWithPacket(); }
+
+void PktSrc::ReleasePacketBuffers(PacketBufferPtr* buffers, size_t n) {
+    for ( size_t i = 0; i < n; ++i )
+        if ( buffers[i]->Shared() )
+            buffers[i]->Detach();
+}
+
 detail::BPF_Program* PktSrc::CompileFilter(const std::string& filter) {
     auto code = std::make_unique<detail::BPF_Program>();
 
@@ -233,7 +294,7 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt) {
     if ( ! have_packet )
         return false;
 
-    *pkt = &current_packet;
+    *pkt = &batch[batch_idx];
     return true;
 }
 
@@ -247,7 +308,7 @@ double PktSrc::GetNextTimeout() {
         ExtractNextPacketInternal();
 
         // This duplicates the calculation used in run_state::check_pseudo_time().
-        double pseudo_time = current_packet.time - run_state::detail::first_timestamp;
+        double pseudo_time = batch[batch_idx].time - run_state::detail::first_timestamp;
         double ct = (util::current_time(true) - run_state::detail::first_wallclock) * run_state::pseudo_realtime;
         return std::max(0.0, pseudo_time - ct);
     }
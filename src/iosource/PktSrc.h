@@ -9,6 +9,7 @@
 #include "zeek/iosource/BPF_Program.h"
 #include "zeek/iosource/IOSource.h"
 #include "zeek/iosource/Packet.h"
+#include "zeek/iosource/PacketBuffer.h"
 
 struct pcap_pkthdr;
 
@@ -260,6 +261,12 @@ protected:
          */
         bool is_live;
 
+        /**
+         * The maximum number of packets the source may return from a
+         * single call to \a ExtractNextPacketBatch(). Defaults to 1.
+         */
+        size_t batch_size;
+
         Properties();
     };
 
@@ -350,6 +357,56 @@ protected:
      */
     virtual void DoneWithPacket() = 0;
 
+    /**
+     * Provides up to \a max packets from the source in a single call.
+     *
+     * The main loop dispatches all packets of a batch before asking the
+     * source for more, which saves a virtual call and a main loop
+     * iteration for every packet after the first. Sources should
+     * advertise the batch size they want to use through the \a
+     * batch_size field of the properties passed to \a Opened().
+     *
+     * The default implementation falls back to a single \a
+     * ExtractNextPacket() call, so existing sources don't need to
+     * implement this.
+     *
+     * @param pkts Array of packet structures to fill in. The callee
+     * keeps ownership of the data but must guarantee that it stays
+     * available for all packets of the batch at least until \a
+     * DoneWithPacketBatch() is called. It is guaranteed that no two calls
+     * to this method will happen with \a DoneWithPacketBatch() in between.
+     *
+     * @param max The number of entries in \a pkts.
+     *
+     * @return The number of packets filled in, starting at index 0. Zero
+     * if no packet is available or an error occurred (which must be
+     * flagged via Error()).
+     */
+    virtual size_t ExtractNextPacketBatch(Packet* pkts, size_t max);
+
+    /**
+     * Signals that the data of all packets returned by the previous call
+     * to \a ExtractNextPacketBatch() will no longer be needed. The
+     * default implementation calls \a DoneWithPacket().
+     */
+    virtual void DoneWithPacketBatch();
+
+    /**
+     * Called once all packets of a batch have been processed, right
+     * before \a DoneWithPacketBatch(). Analyzers may still reference the
+     * data of some of the packets through their buffers, see
+     * PacketBuffer::Shared(). The default implementation detaches those
+     * buffers, copying their data so that the source is free to reuse its
+     * memory. Sources that can keep the memory around for longer may
+     * override this to hold references to the buffers instead, but then
+     * must detach them before reusing the memory.
+     *
+     * @param buffers The buffers of the batch's packets, in order.
+     *
+     * @param n The number of entries in \a buffers.
+     */
+    virtual void ReleasePacketBuffers(PacketBufferPtr* buffers, size_t n);
+
     /**
      * Performs the actual filter compilation. This can be overridden to
      * provide a different implementation of the compilation called by
@@ -366,6 +423,10 @@ private:
     // Internal helper for ExtractNextPacket().
     bool ExtractNextPacketInternal();
 
+    // Moves on to the next usable packet of the current batch, starting
+    // at batch_idx. Releases the batch and returns false once exhausted.
+    bool NextBatchPacket();
+
     // IOSource interface implementation.
     void InitSource() override;
     void Done() override;
@@ -375,7 +436,18 @@ private:
     Properties props;
 
     bool have_packet;
-    Packet current_packet;
+
+    // Packets returned by the latest ExtractNextPacketBatch() call. The
+    // packet currently being processed is batch[batch_idx].
+    std::vector<Packet> batch;
+    size_t batch_len = 0;
+
+    // For each packet of the batch, the buffer through which analyzers
+    // may reference its data. Buffers still referenced once the batch is
+    // done leave the rotation, the others get reused.
+    std::vector<PacketBufferPtr> buffers;
+    size_t batch_idx = 0;
+
     // Did the previous call to ExtractNextPacket() yield a packet.
     bool had_packet;
 
@@ -0,0 +1,356 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/af_packet/AF_Packet.h"
+
+#include "zeek/zeek-config.h"
+
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/Desc.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/af_packet/af_packet.bif.h"
+
+namespace zeek::iosource::af_packet {
+
+// Returns the script-level name of an enum constant, e.g. "AF_Packet::FANOUT_HASH".
+static std::string enum_const_name(const ValPtr& v) {
+    ODesc d;
+    v->Describe(&d);
+    return {(const char*)d.Bytes(), static_cast<size_t>(d.Len())};
+}
+
+AF_PacketSource::~AF_PacketSource() { Close(); }
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live) {
+    props.path = path;
+    props.is_live = is_live;
+}
+
+void AF_PacketSource::Open() {
+    if ( ! props.is_live ) {
+        Error("AF_Packet source does not support offline input");
+        return;
+    }
+
+    if ( props.path.empty() ) {
+        Error("AF_Packet source requires an interface name");
+        return;
+    }
+
+    auto checksum_mode_name = enum_const_name(BifConst::AF_Packet::checksum_validation_mode);
+
+    if ( checksum_mode_name == "AF_Packet::CHECKSUM_ON" )
+        checksum_mode = ChecksumMode::ON;
+    else if ( checksum_mode_name == "AF_Packet::CHECKSUM_OFF" )
+        checksum_mode = ChecksumMode::OFF;
+    else if ( checksum_mode_name == "AF_Packet::CHECKSUM_KERNEL" )
+        checksum_mode = ChecksumMode::KERNEL;
+    else {
+        Error(util::fmt("invalid checksum validation mode %s", checksum_mode_name.c_str()));
+        return;
+    }
+
+    socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+    if ( socket_fd < 0 ) {
+        Error(util::fmt("unable to create socket: %s", strerror(errno)));
+        return;
+    }
+
+    if ( ! BindInterface() ) {
+        SocketError("unable to bind to interface");
+        return;
+    }
+
+    int version = TPACKET_V3;
+    if ( setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ) {
+        SocketError("unable to set TPACKET_V3");
+        return;
+    }
+
+    if ( ! EnablePromiscMode() ) {
+        SocketError("unable to enter promiscuous mode");
+        return;
+    }
+
+    if ( BifConst::AF_Packet::enable_hw_timestamping && ! EnableHWTimestamping() ) {
+        SocketError("unable to enable hardware timestamping");
+        return;
+    }
+
+    rx_ring = std::make_unique<RX_Ring>();
+
+    if ( ! rx_ring->Init(socket_fd, BifConst::AF_Packet::buffer_size, BifConst::AF_Packet::block_size,
+                         static_cast<unsigned int>(BifConst::AF_Packet::block_timeout * 1000)) ) {
+        SocketError("unable to set up the receive ring");
+        return;
+    }
+
+    // Joining the fanout group has to come last, the kernel starts
+    // balancing packets onto the socket right away.
+    if ( BifConst::AF_Packet::enable_fanout && ! EnableFanout() ) {
+        SocketError("unable to join fanout group");
+        return;
+    }
+
+    props.selectable_fd = socket_fd;
+    props.link_type = BifConst::AF_Packet::link_type;
+    props.netmask = NETMASK_UNKNOWN;
+    props.batch_size = BifConst::AF_Packet::batch_size;
+
+    // Holding on to more than half of the ring would leave the kernel
+    // starved for blocks to fill.
+    max_held_blocks = std::min(static_cast<size_t>(BifConst::AF_Packet::max_held_blocks),
+                               static_cast<size_t>(rx_ring->NumBlocks() / 2));
+
+    Opened(props);
+}
+
+bool AF_PacketSource::BindInterface() {
+    if_index = if_nametoindex(props.path.c_str());
+
+    if ( if_index == 0 )
+        return false;
+
+    struct sockaddr_ll addr = {};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_index;
+
+    return bind(socket_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+}
+
+bool AF_PacketSource::EnablePromiscMode() {
+    struct packet_mreq mreq = {};
+    mreq.mr_ifindex = if_index;
+    mreq.mr_type = PACKET_MR_PROMISC;
+
+    return setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+}
+
+bool AF_PacketSource::EnableFanout() {
+    auto mode_name = enum_const_name(BifConst::AF_Packet::fanout_mode);
+    uint32_t mode;
+
+    if ( mode_name == "AF_Packet::FANOUT_HASH" )
+        mode = PACKET_FANOUT_HASH;
+    else if ( mode_name == "AF_Packet::FANOUT_CPU" )
+        mode = PACKET_FANOUT_CPU;
+    else if ( mode_name == "AF_Packet::FANOUT_QM" )
+        mode = PACKET_FANOUT_QM;
+    else {
+        errno = EINVAL;
+        return false;
+    }
+
+    if ( BifConst::AF_Packet::enable_defrag )
+        mode |= PACKET_FANOUT_FLAG_DEFRAG;
+
+    uint32_t fanout_arg = (BifConst::AF_Packet::fanout_id & 0xffff) | (mode << 16);
+    return setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) == 0;
+}
+
+bool AF_PacketSource::EnableHWTimestamping() {
+    struct hwtstamp_config config = {};
+    config.tx_type = HWTSTAMP_TX_OFF;
+    config.rx_filter = HWTSTAMP_FILTER_ALL;
+
+    struct ifreq ifr = {};
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", props.path.c_str());
+    ifr.ifr_data = reinterpret_cast<char*>(&config);
+
+    if ( ioctl(socket_fd, SIOCSHWTSTAMP, &ifr) < 0 )
+        return false;
+
+    int opt = SOF_TIMESTAMPING_RAW_HARDWARE;
+    return setsockopt(socket_fd, SOL_PACKET, PACKET_TIMESTAMP, &opt, sizeof(opt)) == 0;
+}
+
+void AF_PacketSource::Close() {
+    if ( socket_fd < 0 )
+        return;
+
+    ReturnHeldBlocks(true);
+    rx_ring.reset();
+    close(socket_fd);
+    socket_fd = -1;
+
+    Closed();
+}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt) { return ExtractNextPacketBatch(pkt, 1) == 1; }
+
+void AF_PacketSource::DoneWithPacket() { DoneWithPacketBatch(); }
+
+size_t AF_PacketSource::ExtractNextPacketBatch(Packet* pkts, size_t max) {
+    if ( ! rx_ring )
+        return 0;
+
+    // A batch never spans blocks: the packets of a block stay valid only
+    // until we hand the block back to the kernel.
+    while ( rx_ring->HasBlock() || rx_ring->AcquireBlock() ) {
+        size_t n = 0;
+
+        while ( n < max ) {
+            tpacket3_hdr* hdr = rx_ring->NextPacket();
+
+            if ( ! hdr )
+                break;
+
+            if ( InitPacket(&pkts[n], hdr) )
+                ++n;
+        }
+
+        if ( n > 0 )
+            return n;
+
+        // Nothing usable left in this block, move on to the next one.
+        RetireBlock();
+        ReturnHeldBlocks();
+    }
+
+    return 0;
+}
+
+void AF_PacketSource::DoneWithPacketBatch() {
+    if ( rx_ring && rx_ring->BlockExhausted() )
+        RetireBlock();
+
+    ReturnHeldBlocks();
+}
+
+void AF_PacketSource::ReleasePacketBuffers(PacketBufferPtr* buffers, size_t n) {
+    // A batch never spans blocks, so all of these belong to the current one.
+    for ( size_t i = 0; i < n; ++i )
+        if ( buffers[i]->Shared() )
+            current_block_buffers.push_back(buffers[i]);
+}
+
+void AF_PacketSource::RetireBlock() {
+    rx_ring->HoldBlock(std::move(current_block_buffers));
+    current_block_buffers.clear();
+}
+
+void AF_PacketSource::ReturnHeldBlocks(bool force) {
+    if ( force ) {
+        for ( auto& b : current_block_buffers )
+            if ( b->Shared() )
+                b->Detach();
+
+        current_block_buffers.clear();
+    }
+
+    if ( rx_ring )
+        rx_ring->ReturnHeldBlocks(max_held_blocks, force);
+}
+
+bool AF_PacketSource::InitPacket(Packet* pkt, const tpacket3_hdr* hdr) {
+    pkt_timeval ts = {static_cast<time_t>(hdr->tp_sec), static_cast<suseconds_t>(hdr->tp_nsec / 1000)};
+    const u_char* data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+
+    pkt->Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len, data);
+
+    if ( hdr->tp_len == 0 || hdr->tp_snaplen == 0 ) {
+        Weird("empty_af_packet_header", pkt);
+        return false;
+    }
+
+    // The kernel strips the VLAN tag off the packet data.
+    if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+        pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+    switch ( checksum_mode ) {
+        case ChecksumMode::ON: break;
+        case ChecksumMode::OFF: pkt->l4_checksummed = true; break;
+        case ChecksumMode::KERNEL:
+#ifdef TP_STATUS_CSUM_VALID
+            if ( hdr->tp_status & TP_STATUS_CSUM_VALID )
+                pkt->l4_checksummed = true;
+#endif
+            break;
+    }
+
+    ++stats.received;
+    stats.bytes_received += hdr->tp_len;
+    return true;
+}
+
+bool AF_PacketSource::SetFilter(int index) {
+    if ( socket_fd < 0 )
+        return true; // Prevent error message
+
+    iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+    if ( ! code ) {
+        Error(util::fmt("No precompiled filter for index %d", index));
+        return false;
+    }
+
+    if ( code->GetState() == FilterState::FATAL )
+        return false;
+
+    if ( code->MatchesAnything() ) {
+        // Fails with ENOENT if there's no filter attached, which is fine.
+        setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_FILTER, nullptr, 0);
+        return true;
+    }
+
+    auto* program = code->GetProgram();
+
+    if ( ! program )
+        return code->GetState() == FilterState::OK;
+
+    // The kernel's socket filters use the same instruction layout as
+    // libpcap's BPF programs.
+    struct sock_fprog fprog = {};
+    fprog.len = program->bf_len;
+    fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+    if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 ) {
+        Error(util::fmt("unable to attach filter: %s", strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+void AF_PacketSource::Statistics(Stats* s) {
+    if ( socket_fd >= 0 ) {
+        // The kernel resets its counters on every read, and tp_packets
+        // includes the drops.
+        struct tpacket_stats_v3 tp_stats = {};
+        socklen_t len = sizeof(tp_stats);
+
+        if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0 ) {
+            stats.link += tp_stats.tp_packets;
+            stats.dropped += tp_stats.tp_drops;
+        }
+    }
+
+    s->link = stats.link;
+    s->dropped = stats.dropped;
+    s->received = stats.received;
+    s->bytes_received = stats.bytes_received;
+}
+
+void AF_PacketSource::SocketError(const char* where) {
+    Error(util::fmt("%s: %s", where, strerror(errno)));
+    Close();
+}
+
+PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live) {
+    return new AF_PacketSource(path, is_live);
+}
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,89 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <linux/if_packet.h>
+#include <sys/types.h> // for u_char
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+namespace zeek::iosource::af_packet {
+
+/**
+ * Packet source reading from a memory-mapped TPACKET_V3 ring of an
+ * AF_PACKET socket.
+ *
+ * Packets are handed to Zeek in batches straight out of the ring without
+ * being copied. A ring block returns to the kernel once all of its
+ * packets have been processed, unless analyzers still reference some of
+ * them. Then the block is held back until they let go, up to
+ * AF_Packet::max_held_blocks blocks. Beyond that, the referenced packets
+ * of the oldest held block get copied so that it can return to the kernel.
+ */
+class AF_PacketSource : public PktSrc {
+public:
+    /**
+     * Constructor.
+     *
+     * @param path The name of the interface to capture from.
+     *
+     * @param is_live Must be true, AF_PACKET only supports live capture.
+     */
+    AF_PacketSource(const std::string& path, bool is_live);
+    ~AF_PacketSource() override;
+
+    static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+    // PktSrc interface.
+    void Open() override;
+    void Close() override;
+    bool ExtractNextPacket(Packet* pkt) override;
+    void DoneWithPacket() override;
+    size_t ExtractNextPacketBatch(Packet* pkts, size_t max) override;
+    void DoneWithPacketBatch() override;
+    void ReleasePacketBuffers(PacketBufferPtr* buffers, size_t n) override;
+    bool SetFilter(int index) override;
+    void Statistics(Stats* stats) override;
+
+private:
+    enum class ChecksumMode { ON, OFF, KERNEL };
+
+    // Helpers for Open(). On failure, they leave an explanation in errno.
+    bool BindInterface();
+    bool EnablePromiscMode();
+    bool EnableFanout();
+    bool EnableHWTimestamping();
+
+    // Fills in a Packet from a ring entry. Returns false if the entry
+    // should be skipped.
+    bool InitPacket(Packet* pkt, const tpacket3_hdr* hdr);
+
+    // Closes the source with an error message including strerror(errno).
+    void SocketError(const char* where);
+
+    // Moves on from the current block, returning it to the kernel unless
+    // some of its packets are still referenced.
+    void RetireBlock();
+
+    // Returns held blocks that are no longer referenced to the kernel, and
+    // if there are still too many, the oldest ones after detaching their
+    // buffers. With force set, returns all of them.
+    void ReturnHeldBlocks(bool force = false);
+
+    Properties props;
+    Stats stats;
+
+    int socket_fd = -1;
+    int if_index = 0;
+    std::unique_ptr<RX_Ring> rx_ring;
+    std::vector<PacketBufferPtr> current_block_buffers;
+    size_t max_held_blocks = 0;
+    ChecksumMode checksum_mode = ChecksumMode::ON;
+};
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,257 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/af_packet/RX_Ring.h"
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::iosource::af_packet {
+
+// The frame size only matters to the kernel's sanity checks of the ring
+// layout, with TPACKET_V3 packets are packed into blocks back to back.
+static constexpr unsigned int FRAME_SIZE = TPACKET_ALIGNMENT << 7;
+
+static inline uint32_t block_status(const tpacket_block_desc* b) {
+    return *static_cast<const volatile uint32_t*>(&b->hdr.bh1.block_status);
+}
+
+RX_Ring::~RX_Ring() { Close(); }
+
+bool RX_Ring::Init(int sock, size_t arg_buffer_size, size_t arg_block_size, unsigned int block_timeout_msec) {
+    if ( arg_block_size < FRAME_SIZE || arg_block_size % FRAME_SIZE != 0 || arg_buffer_size < arg_block_size ) {
+        errno = EINVAL;
+        return false;
+    }
+
+    block_size = arg_block_size;
+    block_num = arg_buffer_size / arg_block_size;
+
+    tpacket_req3 req = {};
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_num;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (block_size / FRAME_SIZE) * block_num;
+    req.tp_retire_blk_tov = block_timeout_msec;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+    if ( setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+        return false;
+
+    ring_size = block_size * block_num;
+    void* mem = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock, 0);
+
+    if ( mem == MAP_FAILED ) {
+        ring_size = 0;
+        return false;
+    }
+
+    ring = static_cast<u_char*>(mem);
+    block_idx = 0;
+    return true;
+}
+
+void RX_Ring::Init(u_char* mem, size_t arg_block_size, unsigned int arg_block_num) {
+    ring = mem;
+    ring_size = 0;
+    block_size = arg_block_size;
+    block_num = arg_block_num;
+    block_idx = 0;
+}
+
+void RX_Ring::Close() {
+    if ( ! ring )
+        return;
+
+    ReturnHeldBlocks(0, true);
+
+    if ( ring_size > 0 )
+        munmap(ring, ring_size);
+
+    ring = nullptr;
+    ring_size = 0;
+    block = nullptr;
+    packet = nullptr;
+    packets_left = 0;
+}
+
+bool RX_Ring::AcquireBlock() {
+    if ( block )
+        return true;
+
+    if ( ! ring )
+        return false;
+
+    // If we're still holding on to this block from the previous round,
+    // it has to go back to the kernel before we can see new packets in it.
+    auto held = std::find_if(held_blocks.begin(), held_blocks.end(),
+                             [this](const HeldBlock& h) { return h.idx == block_idx; });
+
+    if ( held != held_blocks.end() ) {
+        ReturnHeldBlock(*held);
+        held_blocks.erase(held);
+        return false;
+    }
+
+    tpacket_block_desc* b = BlockAt(block_idx);
+
+    if ( (block_status(b) & TP_STATUS_USER) == 0 )
+        return false;
+
+    // Make sure we don't see block contents older than its status.
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    block = b;
+    packets_left = b->hdr.bh1.num_pkts;
+    packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<u_char*>(b) + b->hdr.bh1.offset_to_first_pkt);
+    return true;
+}
+
+tpacket3_hdr* RX_Ring::NextPacket() {
+    if ( ! block || packets_left == 0 )
+        return nullptr;
+
+    tpacket3_hdr* p = packet;
+    packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<u_char*>(packet) + packet->tp_next_offset);
+    --packets_left;
+    return p;
+}
+
+tpacket_block_desc* RX_Ring::TakeBlock() {
+    tpacket_block_desc* b = block;
+
+    if ( ! b )
+        return nullptr;
+
+    block = nullptr;
+    packet = nullptr;
+    packets_left = 0;
+    block_idx = (block_idx + 1) % block_num;
+    return b;
+}
+
+void RX_Ring::HoldBlock(std::vector<PacketBufferPtr> buffers) {
+    if ( ! block )
+        return;
+
+    if ( buffers.empty() ) {
+        ReleaseBlock();
+        return;
+    }
+
+    held_blocks.push_back({block_idx, std::move(buffers)});
+    TakeBlock();
+}
+
+void RX_Ring::ReturnHeldBlocks(size_t max_held, bool force) {
+    // The order in which blocks go back doesn't matter to the kernel, it
+    // only needs them back by the time it wraps around.
+    for ( auto it = held_blocks.begin(); it != held_blocks.end(); ) {
+        bool referenced = std::any_of(it->buffers.begin(), it->buffers.end(), [](const auto& b) { return b->Shared(); });
+
+        if ( referenced && ! force && held_blocks.size() <= max_held ) {
+            ++it;
+            continue;
+        }
+
+        ReturnHeldBlock(*it);
+        it = held_blocks.erase(it);
+    }
+}
+
+void RX_Ring::ReturnHeldBlock(HeldBlock& b) {
+    for ( auto& buf : b.buffers )
+        if ( buf->Shared() )
+            buf->Detach();
+
+    ReturnBlock(BlockAt(b.idx));
+}
+
+void RX_Ring::ReturnBlock(tpacket_block_desc* b) {
+    if ( ! b )
+        return;
+
+    // All our reads of the block have to complete before the kernel may
+    // reuse it.
+    std::atomic_thread_fence(std::memory_order_release);
+    *static_cast<volatile uint32_t*>(&b->hdr.bh1.block_status) = TP_STATUS_KERNEL;
+}
+
+TEST_SUITE_BEGIN("RX_Ring");
+
+// Plays the kernel's part: puts a single packet into a block and retires it
+// to user space.
+static void fill_block(u_char* mem, size_t block_size, unsigned int idx, u_char content) {
+    auto b = reinterpret_cast<tpacket_block_desc*>(mem + idx * block_size);
+    memset(b, 0, block_size);
+    b->hdr.bh1.num_pkts = 1;
+    b->hdr.bh1.offset_to_first_pkt = TPACKET_ALIGN(sizeof(tpacket_block_desc));
+
+    auto p = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<u_char*>(b) + b->hdr.bh1.offset_to_first_pkt);
+    p->tp_mac = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+    p->tp_len = p->tp_snaplen = 16;
+    memset(reinterpret_cast<u_char*>(p) + p->tp_mac, content, 16);
+
+    b->hdr.bh1.block_status = TP_STATUS_USER;
+}
+
+TEST_CASE("held block across a ring wrap") {
+    constexpr size_t block_size = 256;
+    constexpr unsigned int block_num = 4;
+    alignas(tpacket_block_desc) u_char mem[block_size * block_num];
+
+    RX_Ring ring;
+    ring.Init(mem, block_size, block_num);
+
+    fill_block(mem, block_size, 0, 'a');
+    REQUIRE(ring.AcquireBlock());
+    tpacket3_hdr* hdr = ring.NextPacket();
+    REQUIRE(hdr);
+
+    // An analyzer keeps a reference to the packet.
+    auto ref = make_intrusive<PacketBuffer>();
+    ref->Bind(reinterpret_cast<u_char*>(hdr) + hdr->tp_mac, hdr->tp_snaplen);
+    ring.HoldBlock({ref});
+    CHECK(ring.NumHeldBlocks() == 1);
+
+    for ( unsigned int i = 1; i < block_num; ++i ) {
+        fill_block(mem, block_size, i, 'b');
+        REQUIRE(ring.AcquireBlock());
+        ring.ReleaseBlock();
+        ring.ReturnHeldBlocks(block_num);
+    }
+
+    // Back at the first block, which still carries its old status. The ring
+    // must not hand out its stale packets again, and has to return it.
+    auto first = reinterpret_cast<tpacket_block_desc*>(mem);
+    CHECK(first->hdr.bh1.block_status == TP_STATUS_USER);
+    CHECK_FALSE(ring.AcquireBlock());
+    CHECK(first->hdr.bh1.block_status == TP_STATUS_KERNEL);
+    CHECK(ring.NumHeldBlocks() == 0);
+    CHECK(ref->IsDetached());
+
+    // Once the kernel refilled the block, the new packet shows up and the
+    // old reference still sees the old data.
+    fill_block(mem, block_size, 0, 'c');
+    REQUIRE(ring.AcquireBlock());
+    hdr = ring.NextPacket();
+    REQUIRE(hdr);
+    CHECK(*(reinterpret_cast<u_char*>(hdr) + hdr->tp_mac) == 'c');
+    CHECK(ref->Data()[0] == 'a');
+
+    // The block went back once already, nothing to return twice.
+    ring.ReturnHeldBlocks(0, true);
+    CHECK(first->hdr.bh1.block_status == TP_STATUS_USER);
+
+    ring.ReleaseBlock();
+    CHECK(first->hdr.bh1.block_status == TP_STATUS_KERNEL);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,173 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <linux/if_packet.h>
+#include <sys/types.h> // for u_char
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "zeek/iosource/PacketBuffer.h"
+
+namespace zeek::iosource::af_packet {
+
+/**
+ * A TPACKET_V3 receive ring mapped into our address space.
+ *
+ * The kernel fills the ring block by block. Once it retires a block to
+ * user space, the block's packets can be walked in place until the block
+ * is handed back via ReleaseBlock(), which is what allows packets to
+ * reach the analyzers without any copying.
+ *
+ * Blocks whose packets analyzers still reference can be held back from
+ * the kernel via HoldBlock(). The ring never hands out a block that is
+ * still held: if it comes around to one, it detaches the block's buffers
+ * and returns it to the kernel first.
+ */
+class RX_Ring {
+public:
+    RX_Ring() = default;
+    ~RX_Ring();
+
+    RX_Ring(const RX_Ring&) = delete;
+    RX_Ring& operator=(const RX_Ring&) = delete;
+
+    /**
+     * Sets up the ring on a socket and maps it into memory. The socket
+     * must already be switched to TPACKET_V3.
+     *
+     * @param sock The AF_PACKET socket.
+     *
+     * @param buffer_size The total size of the ring in bytes.
+     *
+     * @param block_size The size of a single block in bytes. Must be a
+     * multiple of the page size.
+     *
+     * @param block_timeout_msec Time after which the kernel retires a
+     * block even if it isn't full yet.
+     *
+     * @return True on success. On failure, errno describes the problem.
+     */
+    bool Init(int sock, size_t buffer_size, size_t block_size, unsigned int block_timeout_msec);
+
+    /**
+     * Sets up the ring on memory laid out like a TPACKET_V3 ring by the
+     * caller, who keeps ownership of it. Used for testing.
+     *
+     * @param mem The ring memory, *block_num* blocks of *block_size*
+     * bytes each.
+     *
+     * @param block_size The size of a single block in bytes.
+     *
+     * @param block_num The number of blocks.
+     */
+    void Init(u_char* mem, size_t block_size, unsigned int block_num);
+
+    /**
+     * Unmaps the ring. The ring is torn down by the kernel once the
+     * socket gets closed.
+     */
+    void Close();
+
+    /**
+     * Returns true if we currently own a block, i.e., have acquired it
+     * and not yet released it.
+     */
+    bool HasBlock() const { return block != nullptr; }
+
+    /**
+     * Takes ownership of the next block if the kernel has retired it to
+     * user space.
+     *
+     * @return True if a block has been acquired.
+     */
+    bool AcquireBlock();
+
+    /**
+     * Returns the next packet of the currently owned block, or null if
+     * all of its packets have been handed out already.
+     */
+    tpacket3_hdr* NextPacket();
+
+    /**
+     * Returns true if all packets of the currently owned block have been
+     * handed out.
+     */
+    bool BlockExhausted() const { return packets_left == 0; }
+
+    /**
+     * Hands the currently owned block back to the kernel. Pointers to
+     * its packets must not be used afterwards.
+     */
+    void ReleaseBlock() { ReturnBlock(TakeBlock()); }
+
+    /**
+     * Moves on from the currently owned block without handing it back to
+     * the kernel yet, so that its packets stay valid for as long as the
+     * given buffers are referenced.
+     *
+     * @param buffers The buffers of the block's packets that are still
+     * referenced.
+     */
+    void HoldBlock(std::vector<PacketBufferPtr> buffers);
+
+    /**
+     * Hands held blocks that are no longer referenced back to the kernel,
+     * and if there are still more than *max_held*, the oldest ones after
+     * detaching their buffers.
+     *
+     * @param max_held The number of referenced blocks to keep holding.
+     *
+     * @param force If true, returns all held blocks.
+     */
+    void ReturnHeldBlocks(size_t max_held, bool force = false);
+
+    /**
+     * Returns the number of blocks currently held.
+     */
+    size_t NumHeldBlocks() const { return held_blocks.size(); }
+
+    /**
+     * Returns the number of blocks in the ring.
+     */
+    unsigned int NumBlocks() const { return block_num; }
+
+private:
+    // A block kept from the kernel, along with the buffers of its packets
+    // that analyzers still reference.
+    struct HeldBlock {
+        unsigned int idx;
+        std::vector<PacketBufferPtr> buffers;
+    };
+
+    // Detaches a held block's buffers and hands it to the kernel.
+    void ReturnHeldBlock(HeldBlock& b);
+
+    // Hands a block back to the kernel.
+    void ReturnBlock(tpacket_block_desc* b);
+
+    // Moves on from the currently owned block, returning its descriptor.
+    tpacket_block_desc* TakeBlock();
+
+    tpacket_block_desc* BlockAt(unsigned int idx) const {
+        return reinterpret_cast<tpacket_block_desc*>(ring + static_cast<size_t>(idx) * block_size);
+    }
+
+    u_char* ring = nullptr;
+    size_t ring_size = 0; // Zero if we didn't map the ring ourselves.
+    size_t block_size = 0;
+    unsigned int block_num = 0;
+
+    // Index of the block we're going to process next, and its
+    // descriptor if we currently own it.
+    unsigned int block_idx = 0;
+    tpacket_block_desc* block = nullptr;
+
+    tpacket3_hdr* packet = nullptr;
+    uint32_t packets_left = 0;
+
+    std::deque<HeldBlock> held_blocks;
+};
+
+} // namespace zeek::iosource::af_packet
@@ -11,6 +11,7 @@
 #endif
 
 #include <stdio.h>
+#include <algorithm>
 
 #include "zeek/Event.h"
 #include "zeek/iosource/BPF_Program.h"
@@ -149,6 +150,7 @@ void PcapSource::OpenLive() {
 
     props.link_type = pcap_datalink(pd);
     props.is_live = true;
+    props.batch_size = BifConst::Pcap::batch_size;
 
     Opened(props);
 }
@@ -198,6 +200,7 @@ void PcapSource::OpenOffline() {
 
     props.link_type = pcap_datalink(pd);
     props.is_live = false;
+    props.batch_size = BifConst::Pcap::batch_size;
 
     Opened(props);
 }
@@ -265,6 +268,77 @@ void PcapSource::DoneWithPacket() {
     // Nothing to do.
 }
 
+size_t PcapSource::ExtractNextPacketBatch(Packet* pkts, size_t max) {
+    // Without batching, pcap_next_ex() avoids copying the packet data.
+    if ( max <= 1 )
+        return PktSrc::ExtractNextPacketBatch(pkts, max);
+
+    if ( ! pd )
+        return 0;
+
+    if ( batch_buf.empty() ) {
+        batch_slot_size = std::max(pcap_snapshot(pd), 1);
+        batch_buf.resize(max * batch_slot_size);
+    }
+
+    batch_pkts = pkts;
+    batch_len = 0;
+
+    int res = pcap_dispatch(pd, static_cast<int>(max), BatchCallback, reinterpret_cast<u_char*>(this));
+
+    switch ( res ) {
+        case PCAP_ERROR_BREAK: // -2
+            // Only raised through pcap_breakloop(), which we don't use.
+            assert(! props.is_live);
+            Close();
+            return 0;
+        case PCAP_ERROR: // -1
+            // Error occurred while reading packets.
+            if ( props.is_live )
+                reporter->Error("failed to read a packet from %s: %s", props.path.data(), pcap_geterr(pd));
+            else
+                reporter->FatalError("failed to read a packet from %s: %s", props.path.data(), pcap_geterr(pd));
+            return 0;
+        case 0:
+            // Either the read from a live interface timed out (ok), or
+            // we exhausted the pcap file.
+            if ( ! props.is_live )
+                Close();
+            return 0;
+        default: break;
+    }
+
+    batch_pkts = nullptr;
+    return batch_len;
+}
+
+void PcapSource::BatchCallback(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data) {
+    auto* src = reinterpret_cast<PcapSource*>(user);
+
+    if ( ! data ) {
+        reporter->Weird("pcap_null_data_packet");
+        return;
+    }
+
+    // The snapshot length bounds caplen, but don't trust that blindly.
+    uint32_t caplen = std::min(hdr->caplen, static_cast<uint32_t>(src->batch_slot_size));
+    u_char* slot = src->batch_buf.data() + src->batch_len * src->batch_slot_size;
+    memcpy(slot, data, caplen);
+
+    pkt_timeval ts = hdr->ts;
+    Packet* pkt = &src->batch_pkts[src->batch_len];
+    pkt->Init(src->props.link_type, &ts, caplen, hdr->len, slot);
+
+    if ( hdr->len == 0 || caplen == 0 ) {
+        src->Weird("empty_pcap_header", pkt);
+        return;
+    }
+
+    ++src->stats.received;
+    src->stats.bytes_received += hdr->len;
+    ++src->batch_len;
+}
+
 detail::BPF_Program* PcapSource::CompileFilter(const std::string& filter) {
     auto code = std::make_unique<detail::BPF_Program>();
 
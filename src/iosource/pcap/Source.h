@@ -27,6 +27,7 @@ protected:
     void Close() override;
     bool ExtractNextPacket(Packet* pkt) override;
     void DoneWithPacket() override;
+    size_t ExtractNextPacketBatch(Packet* pkts, size_t max) override;
     bool SetFilter(int index) override;
     void Statistics(Stats* stats) override;
 
@@ -37,6 +38,9 @@ private:
     void OpenOffline();
     void PcapError(const char* where = nullptr);
 
+    // Callback for pcap_dispatch(), adds a packet to the current batch.
+    static void BatchCallback(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data);
+
     Properties props;
     Stats stats;
 
@@ -45,6 +49,14 @@ private:
 
     // Buffer provided to setvbuf() when reading from a PCAP file.
     std::vector<char> iobuf;
+
+    // State of the pcap_dispatch() burst filling the current batch.
+    // Packet data is copied into fixed-size slots of batch_buf since
+    // libpcap may reuse its buffers once the callback returns.
+    Packet* batch_pkts = nullptr;
+    size_t batch_len = 0;
+    size_t batch_slot_size = 0;
+    std::vector<u_char> batch_buf;
 };
 
 } // namespace zeek::iosource::pcap
@@ -0,0 +1,88 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/LogArena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::logging::detail {
+
+void* LogArena::Allocate(size_t size, size_t align) {
+    auto misalignment = reinterpret_cast<uintptr_t>(pos) & (align - 1);
+    size_t padding = misalignment ? align - misalignment : 0;
+
+    if ( padding + size > left ) {
+        // Large allocations get a chunk of their own, so that they don't
+        // waste the remainder of the current one.
+        if ( size > chunk_size / 4 ) {
+            chunks.emplace_back(new char[size]);
+            bytes_used += size;
+            return chunks.back().get();
+        }
+
+        chunks.emplace_back(new char[chunk_size]);
+        pos = chunks.back().get();
+        left = chunk_size;
+        padding = 0;
+    }
+
+    void* result = pos + padding;
+    pos += padding + size;
+    left -= padding + size;
+    bytes_used += size;
+    return result;
+}
+
+char* LogArena::CopyString(const char* data, size_t len) {
+    auto* buf = static_cast<char*>(Allocate(len + 1, 1));
+    memcpy(buf, data, len);
+    buf[len] = '\0';
+    return buf;
+}
+
+threading::Value** LogArena::NewValueArray(size_t n) {
+    return static_cast<threading::Value**>(Allocate(n * sizeof(threading::Value*), alignof(threading::Value*)));
+}
+
+threading::Value* LogArena::NewValue(threading::Value&& v) {
+    void* mem = Allocate(sizeof(threading::Value), alignof(threading::Value));
+    return new (mem) threading::Value(std::move(v));
+}
+
+TEST_SUITE_BEGIN("LogArena");
+
+TEST_CASE("log arena strings and values") {
+    LogArena arena(256);
+
+    char* s = arena.CopyString("hello", 5);
+    CHECK(strcmp(s, "hello") == 0);
+
+    // Large strings don't disturb the current chunk.
+    std::string big(1000, 'x');
+    char* b = arena.CopyString(big.data(), big.size());
+    CHECK(std::string(b, big.size()) == big);
+    CHECK(arena.CopyString("", 0) == s + 6);
+
+    auto** vals = arena.NewValueArray(3);
+    CHECK(reinterpret_cast<uintptr_t>(vals) % alignof(threading::Value*) == 0);
+
+    for ( int i = 0; i < 3; ++i ) {
+        threading::Value v{TYPE_STRING};
+        v.borrowed = true;
+        v.val.string_val.data = arena.CopyString("abc", 3);
+        v.val.string_val.length = 3;
+        vals[i] = arena.NewValue(std::move(v));
+        CHECK(reinterpret_cast<uintptr_t>(vals[i]) % alignof(threading::Value) == 0);
+    }
+
+    CHECK(vals[2]->borrowed);
+    CHECK(std::string(vals[2]->val.string_val.data, vals[2]->val.string_val.length) == "abc");
+    CHECK(arena.BytesUsed() >= 1000 + 6 + 3 * sizeof(threading::Value));
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::logging::detail
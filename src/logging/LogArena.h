@@ -0,0 +1,63 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging::detail {
+
+/**
+ * Memory arena backing the log records of one write batch.
+ *
+ * The logging manager converts script values into threading::Values whose
+ * strings, set and vector elements would otherwise each be allocated
+ * individually, and then freed again by the writer thread. Instead, a
+ * WriterFrontend hands out one arena per batch. Values carved from it are
+ * marked as borrowed, so their destructors leave the memory alone, and the
+ * whole arena is released at once after the backend has written the batch.
+ */
+class LogArena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit LogArena(size_t chunk_size = DEFAULT_CHUNK_SIZE) : chunk_size(chunk_size) {}
+
+    LogArena(const LogArena&) = delete;
+    LogArena& operator=(const LogArena&) = delete;
+
+    /**
+     * Copies string data into the arena, like util::copy_string().
+     */
+    char* CopyString(const char* data, size_t len);
+
+    /**
+     * Allocates an array of \a n value pointers.
+     */
+    threading::Value** NewValueArray(size_t n);
+
+    /**
+     * Moves a value into the arena. The value must have been created
+     * from this arena as well, its destructor won't run.
+     */
+    threading::Value* NewValue(threading::Value&& v);
+
+    /**
+     * Returns the number of bytes handed out so far.
+     */
+    size_t BytesUsed() const { return bytes_used; }
+
+private:
+    void* Allocate(size_t size, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char* pos = nullptr;
+    size_t left = 0;
+    size_t chunk_size;
+    size_t bytes_used = 0;
+};
+
+} // namespace zeek::logging::detail
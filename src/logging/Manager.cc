@@ -1146,10 +1146,14 @@ bool Manager::WriteToFilters(const Manager::Stream* stream, zeek::RecordValPtr c
 
         assert(writer);
 
-        // Alright, can do the write now.
-        auto rec = RecordToLogRecord(stream, filter, columns.get());
-
-        if ( zeek::plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_LOG_WRITE) ) {
+        // Alright, can do the write now. Plugins hooking into writes may
+        // replace values, so only build the record in the writer's arena
+        // if there are none.
+        bool have_write_hook = zeek::plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_LOG_WRITE);
+        auto* arena = have_write_hook ? nullptr : writer->WriteArena();
+        auto rec = RecordToLogRecord(stream, filter, columns.get(), arena);
+
+        if ( have_write_hook ) {
             // The current HookLogWrite API takes a threading::Value**.
             // Fabricate the pointer array on the fly. Mutation is allowed.
             std::vector<threading::Value*> vals;
@@ -1382,11 +1386,16 @@ bool Manager::SetMaxDelayQueueSize(const EnumValPtr& id, zeek_uint_t queue_size)
     return true;
 }
 
-threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
+threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, detail::LogArena* arena) {
     if ( ! val )
         return {ty->Tag(), false};
 
     threading::Value lval{ty->Tag()};
+    lval.borrowed = arena != nullptr;
+
+    auto copy_string = [arena](const char* s, size_t len) {
+        return arena ? arena->CopyString(s, len) : util::copy_string(s, len);
+    };
 
     switch ( lval.type ) {
         case TYPE_BOOL:
@@ -1397,14 +1406,14 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
 
             if ( s ) {
                 auto len = strlen(s);
-                lval.val.string_val.data = util::copy_string(s, len);
+                lval.val.string_val.data = copy_string(s, len);
                 lval.val.string_val.length = len;
             }
 
             else {
                 auto err_msg = "enum type does not contain value:" + std::to_string(val->AsInt());
                 ty->Error(err_msg.c_str());
-                lval.val.string_val.data = util::copy_string("", 0);
+                lval.val.string_val.data = copy_string("", 0);
                 lval.val.string_val.length = 0;
             }
             break;
@@ -1442,8 +1451,14 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
 
         case TYPE_STRING: {
             const String* s = val->AsString()->AsString();
-            char* buf = new char[s->Len()];
-            memcpy(buf, s->Bytes(), s->Len());
+            char* buf;
+
+            if ( arena )
+                buf = arena->CopyString(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+            else {
+                buf = new char[s->Len()];
+                memcpy(buf, s->Bytes(), s->Len());
+            }
 
             lval.val.string_val.data = buf;
             lval.val.string_val.length = s->Len();
@@ -1454,7 +1469,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
             const File* f = val->AsFile();
             const char* s = f->Name();
             auto len = strlen(s);
-            lval.val.string_val.data = util::copy_string(s, len);
+            lval.val.string_val.data = copy_string(s, len);
             lval.val.string_val.length = len;
             break;
         }
@@ -1465,7 +1480,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
             f->Describe(&d);
             const char* s = d.Description();
             auto len = strlen(s);
-            lval.val.string_val.data = util::copy_string(s, len);
+            lval.val.string_val.data = copy_string(s, len);
             lval.val.string_val.length = len;
             break;
         }
@@ -1484,11 +1499,14 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
             bool is_managed = ZVal::IsManagedType(set_t);
 
             lval.val.set_val.size = set->Length();
-            lval.val.set_val.vals = new threading::Value*[lval.val.set_val.size];
+            lval.val.set_val.vals = arena ? arena->NewValueArray(lval.val.set_val.size) :
+                                            new threading::Value*[lval.val.set_val.size];
 
             for ( zeek_int_t i = 0; i < lval.val.set_val.size; i++ ) {
                 std::optional<ZVal> s_i = ZVal(set->Idx(i), set_t);
-                lval.val.set_val.vals[i] = new threading::Value(ValToLogVal(s_i, set_t.get()));
+                auto elem = ValToLogVal(s_i, set_t.get(), arena);
+                lval.val.set_val.vals[i] = arena ? arena->NewValue(std::move(elem)) :
+                                                   new threading::Value(std::move(elem));
                 if ( is_managed )
                     ZVal::DeleteManagedType(*s_i);
             }
@@ -1499,13 +1517,16 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
         case TYPE_VECTOR: {
             VectorVal* vec = val->AsVector();
             lval.val.vector_val.size = vec->Size();
-            lval.val.vector_val.vals = new threading::Value*[lval.val.vector_val.size];
+            lval.val.vector_val.vals = arena ? arena->NewValueArray(lval.val.vector_val.size) :
+                                               new threading::Value*[lval.val.vector_val.size];
 
             auto& vv = vec->RawVec();
             auto& vt = vec->GetType()->Yield();
 
             for ( zeek_int_t i = 0; i < lval.val.vector_val.size; i++ ) {
-                lval.val.vector_val.vals[i] = new threading::Value(ValToLogVal(vv[i], vt.get()));
+                auto elem = ValToLogVal(vv[i], vt.get(), arena);
+                lval.val.vector_val.vals[i] = arena ? arena->NewValue(std::move(elem)) :
+                                                      new threading::Value(std::move(elem));
             }
 
             break;
@@ -1517,7 +1538,8 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty) {
     return lval;
 }
 
-detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns) {
+detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns,
+                                             detail::LogArena* arena) {
     RecordValPtr ext_rec;
 
     if ( filter->num_ext_fields > 0 ) {
@@ -1567,7 +1589,7 @@ detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filte
         }
 
         if ( val )
-            vals.emplace_back(ValToLogVal(val, vt));
+            vals.emplace_back(ValToLogVal(val, vt, arena));
     }
 
     return vals;
@@ -32,6 +32,7 @@ class RotationTimer;
 
 namespace detail {
 
+class LogArena;
 class LogFlushWriteBufferTimer;
 
 class DelayInfo;
@@ -398,8 +399,10 @@ private:
     bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, TableVal* include, TableVal* exclude,
                         const std::string& path, const std::list<int>& indices);
 
-    detail::LogRecord RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns);
-    threading::Value ValToLogVal(std::optional<ZVal>& val, Type* ty);
+    // If arena is given, the values' data is allocated from it.
+    detail::LogRecord RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns,
+                                        detail::LogArena* arena = nullptr);
+    threading::Value ValToLogVal(std::optional<ZVal>& val, Type* ty, detail::LogArena* arena = nullptr);
 
     Stream* FindStream(EnumVal* id);
     void RemoveDisabledWriters(Stream* stream);
@@ -51,15 +51,19 @@ private:
 
 class WriteMessage final : public threading::InputMessage<WriterBackend> {
 public:
-    WriteMessage(WriterBackend* backend, int num_fields, std::vector<detail::LogRecord>&& records)
+    WriteMessage(WriterBackend* backend, int num_fields, std::vector<detail::LogRecord>&& records,
+                 std::unique_ptr<detail::LogArena> arena)
         : threading::InputMessage<WriterBackend>("Write", backend),
           num_fields(num_fields),
+          arena(std::move(arena)),
           records(std::move(records)) {}
 
     bool Process() override { return Object()->Write(num_fields, zeek::Span{records}); }
 
 private:
     int num_fields;
+    // Declared before the records so that it outlives them.
+    std::unique_ptr<detail::LogArena> arena;
     std::vector<detail::LogRecord> records;
 };
 
@@ -204,8 +208,10 @@ void WriterFrontend::FlushWriteBuffer() {
         // Nothing to do.
         return;
 
-    if ( backend )
-        backend->SendIn(new WriteMessage(backend, num_fields, std::move(write_buffer).TakeRecords()));
+    if ( backend ) {
+        auto arena = std::move(write_buffer).TakeArena();
+        backend->SendIn(new WriteMessage(backend, num_fields, std::move(write_buffer).TakeRecords(), std::move(arena)));
+    }
 }
 
 void WriterFrontend::SetBuf(bool enabled) {
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "zeek/logging/LogArena.h"
 #include "zeek/logging/WriterBackend.h"
 
 namespace zeek::logging {
@@ -46,6 +47,25 @@ public:
         return tmp;
     }
 
+    /**
+     * Returns the arena for the values of the currently buffered records,
+     * creating it if needed.
+     */
+    LogArena* Arena() {
+        if ( ! arena )
+            arena = std::make_unique<LogArena>();
+
+        return arena.get();
+    }
+
+    /**
+     * Moves the arena out of the buffer. This must go along with
+     * TakeRecords(), as the records may point into the arena.
+     *
+     * @return The current arena, or null if none has been used.
+     */
+    std::unique_ptr<LogArena> TakeArena() && { return std::move(arena); }
+
     /**
      * @return The size of the buffer.
      */
@@ -64,6 +84,7 @@ public:
 private:
     size_t buffer_size;
     std::vector<LogRecord> records;
+    std::unique_ptr<LogArena> arena;
 };
 
 } // namespace detail
@@ -153,6 +174,16 @@ public:
      */
     void Write(detail::LogRecord&& rec);
 
+    /**
+     * Returns the arena that the values of the next record passed to
+     * Write() may be allocated from, or null if the writer can't take such
+     * records. The arena stays alive until the backend has processed the
+     * record.
+     *
+     * This method must only be called from the main thread.
+     */
+    detail::LogArena* WriteArena() { return (backend && ! disabled) ? write_buffer.Arena() : nullptr; }
+
     /**
      * Sets the buffering state.
      *
@@ -21,6 +21,7 @@
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/writers/ascii/ascii.bif.h"
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/TaskPool.h"
 #include "zeek/util.h"
 
 using namespace std;
@@ -119,6 +120,8 @@ static std::optional<LeftoverLog> parse_shadow_log(const std::string& fname) {
     string default_ext = "." + Ascii::LogExt();
     if ( BifConst::LogAscii::gzip_level > 0 )
         default_ext += ".gz";
+    else if ( BifConst::LogAscii::zstd_level > 0 )
+        default_ext += ".zst";
 
     LeftoverLog rval = {};
     rval.filename = fname;
@@ -213,6 +216,10 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend) {
     formatter = nullptr;
     gzip_level = 0;
     gzfile = nullptr;
+    zstd_level = 0;
+    zstd_window_log = 0;
+    compression_threads = 0;
+    compression_block_size = 0;
 
     InitConfigOptions();
     init_options = InitFilterOptions();
@@ -224,6 +231,10 @@ void Ascii::InitConfigOptions() {
     use_json = BifConst::LogAscii::use_json;
     enable_utf_8 = BifConst::LogAscii::enable_utf_8;
     gzip_level = BifConst::LogAscii::gzip_level;
+    zstd_level = BifConst::LogAscii::zstd_level;
+    zstd_window_log = BifConst::LogAscii::zstd_window_log;
+    compression_threads = BifConst::LogAscii::compression_threads;
+    compression_block_size = BifConst::LogAscii::compression_block_size;
 
     separator.assign((const char*)BifConst::LogAscii::separator->Bytes(), BifConst::LogAscii::separator->Len());
 
@@ -245,6 +256,9 @@ void Ascii::InitConfigOptions() {
     gzip_file_extension.assign((const char*)BifConst::LogAscii::gzip_file_extension->Bytes(),
                                BifConst::LogAscii::gzip_file_extension->Len());
 
+    zstd_file_extension.assign((const char*)BifConst::LogAscii::zstd_file_extension->Bytes(),
+                               BifConst::LogAscii::zstd_file_extension->Len());
+
     logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
 }
 
@@ -264,14 +278,18 @@ bool Ascii::InitFilterOptions() {
             }
         }
 
-        else if ( strcmp(i->first, "gzip_level") == 0 ) {
+        else if ( strcmp(i->first, "gzip_level") == 0 )
             gzip_level = atoi(i->second);
 
-            if ( gzip_level < 0 || gzip_level > 9 ) {
-                Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
-                return false;
-            }
-        }
+        else if ( strcmp(i->first, "zstd_level") == 0 )
+            zstd_level = atoi(i->second);
+
+        else if ( strcmp(i->first, "zstd_window_log") == 0 )
+            zstd_window_log = atoi(i->second);
+
+        else if ( strcmp(i->first, "compression_block_size") == 0 )
+            compression_block_size = strtoull(i->second, nullptr, 10);
+
         else if ( strcmp(i->first, "use_json") == 0 ) {
             if ( strcmp(i->second, "T") == 0 )
                 use_json = true;
@@ -340,6 +358,42 @@ bool Ascii::InitFilterOptions() {
 
         else if ( strcmp(i->first, "gzip_file_extension") == 0 )
             gzip_file_extension.assign(i->second);
+
+        else if ( strcmp(i->first, "zstd_file_extension") == 0 )
+            zstd_file_extension.assign(i->second);
+    }
+
+    // The levels may come from the script-level options or the filter's
+    // config, check them only once both have been applied.
+    if ( gzip_level < 0 || gzip_level > 9 ) {
+        Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
+        return false;
+    }
+
+    if ( zstd_level < 0 || zstd_level > 22 ) {
+        Error("invalid value for 'zstd_level', must be a number between 0 and 22.");
+        return false;
+    }
+
+    if ( zstd_window_log != 0 && (zstd_window_log < 10 || zstd_window_log > 31) ) {
+        Error("invalid value for 'zstd_window_log', must be 0 or a number between 10 and 31.");
+        return false;
+    }
+
+    if ( compression_block_size == 0 || compression_block_size > BlockCompressor::MAX_BLOCK_SIZE ) {
+        Error(Fmt("invalid value for 'compression_block_size', must be a number between 1 and %zu.",
+                  BlockCompressor::MAX_BLOCK_SIZE));
+        return false;
+    }
+
+    if ( gzip_level > 0 && zstd_level > 0 ) {
+        Error("'gzip_level' and 'zstd_level' can't both be enabled");
+        return false;
+    }
+
+    if ( zstd_level > 0 && ! BlockCompressor::Available(BlockCompressor::Codec::Zstd) ) {
+        Error("zstd compression requested, but Zeek was built without zstd support");
+        return false;
     }
 
     if ( ! InitFormatter() )
@@ -348,6 +402,16 @@ bool Ascii::InitFilterOptions() {
     return true;
 }
 
+std::string Ascii::CompressionExt() const {
+    if ( gzip_level > 0 )
+        return "." + (gzip_file_extension.empty() ? std::string("gz") : gzip_file_extension);
+
+    if ( zstd_level > 0 )
+        return "." + (zstd_file_extension.empty() ? std::string("zst") : zstd_file_extension);
+
+    return "";
+}
+
 bool Ascii::InitFormatter() {
     delete formatter;
     formatter = nullptr;
@@ -411,6 +475,7 @@ void Ascii::CloseFile(double t) {
     InternalClose(fd);
     fd = 0;
     gzfile = nullptr;
+    compressor.reset();
 }
 
 bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) {
@@ -427,12 +492,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
     fname = path;
 
     if ( ! IsSpecial(fname) ) {
-        std::string ext = "." + LogExt();
-
-        if ( gzip_level > 0 ) {
-            ext += ".";
-            ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-        }
+        std::string ext = "." + LogExt() + CompressionExt();
 
         if ( fname.front() != '/' && ! logdir.empty() )
             fname = (zeek::filesystem::path(logdir) / fname).string();
@@ -481,12 +541,20 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
         return false;
     }
 
-    if ( gzip_level > 0 ) {
-        if ( gzip_level < 0 || gzip_level > 9 ) {
-            Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
-            return false;
-        }
+    if ( zstd_level > 0 || (gzip_level > 0 && compression_threads > 0) ) {
+        // Block mode. All writers share one pool, sized by the first
+        // to need it.
+        BlockCompressor::Options options;
+        options.codec = zstd_level > 0 ? BlockCompressor::Codec::Zstd : BlockCompressor::Codec::Gzip;
+        options.level = zstd_level > 0 ? zstd_level : gzip_level;
+        options.window_log = zstd_window_log;
+        options.block_size = compression_block_size;
 
+        auto pool = compression_threads > 0 ? threading::TaskPool::Shared(compression_threads) : nullptr;
+        compressor = std::make_unique<BlockCompressor>(fd, options, pool);
+        gzfile = nullptr;
+    }
+    else if ( gzip_level > 0 ) {
         char mode[4];
         snprintf(mode, sizeof(mode), "wb%d", gzip_level);
         errno = 0; // errno will only be set under certain circumstances by gzdopen.
@@ -554,6 +622,11 @@ bool Ascii::WriteHeader(const string& path) {
 }
 
 bool Ascii::DoFlush(double network_time) {
+    if ( compressor && ! compressor->Flush() ) {
+        Error(Fmt("error writing to %s: %s", fname.c_str(), compressor->Error().c_str()));
+        return false;
+    }
+
     fsync(fd);
     return true;
 }
@@ -621,12 +694,7 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
     CloseFile(close);
 
-    string nname = string(rotated_path) + "." + LogExt();
-
-    if ( gzip_level > 0 ) {
-        nname += ".";
-        nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-    }
+    string nname = string(rotated_path) + "." + LogExt() + CompressionExt();
 
     if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
         char buf[256];
@@ -818,6 +886,14 @@ string Ascii::Timestamp(double t) {
 }
 
 bool Ascii::InternalWrite(int fd, const char* data, int len) {
+    if ( compressor ) {
+        if ( compressor->Write(data, len) )
+            return true;
+
+        Error(Fmt("Ascii::InternalWrite error: %s", compressor->Error().c_str()));
+        return false;
+    }
+
     if ( ! gzfile )
         return util::safe_write(fd, data, len);
 
@@ -838,6 +914,16 @@ bool Ascii::InternalWrite(int fd, const char* data, int len) {
 }
 
 bool Ascii::InternalClose(int fd) {
+    if ( compressor ) {
+        bool ok = compressor->Flush();
+
+        if ( ! ok )
+            Error(Fmt("Ascii::InternalClose error: %s", compressor->Error().c_str()));
+
+        util::safe_close(fd);
+        return ok;
+    }
+
     if ( ! gzfile ) {
         util::safe_close(fd);
         return true;
@@ -5,9 +5,11 @@
 #pragma once
 
 #include <zlib.h>
+#include <memory>
 
 #include "zeek/Desc.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/writers/ascii/BlockCompressor.h"
 #include "zeek/threading/formatters/Ascii.h"
 #include "zeek/threading/formatters/JSON.h"
 
@@ -48,11 +50,13 @@ private:
     void InitConfigOptions();
     bool InitFilterOptions();
     bool InitFormatter();
+    std::string CompressionExt() const;
     bool InternalWrite(int fd, const char* data, int len);
     bool InternalClose(int fd);
 
     int fd;
     gzFile gzfile;
+    std::unique_ptr<BlockCompressor> compressor;
     std::string fname;
     ODesc desc;
     bool ascii_done;
@@ -70,6 +74,11 @@ private:
 
     int gzip_level; // level > 0 enables gzip compression
     std::string gzip_file_extension;
+    int zstd_level; // level > 0 enables zstd compression
+    int zstd_window_log;
+    std::string zstd_file_extension;
+    uint64_t compression_threads; // > 0 compresses blocks on a thread pool
+    uint64_t compression_block_size;
     bool use_json;
     bool enable_utf_8;
     std::string json_timestamps;
@@ -0,0 +1,207 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/ascii/BlockCompressor.h"
+
+#include "zeek/zeek-config.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "zeek/threading/TaskPool.h"
+#include "zeek/util.h"
+
+namespace zeek::logging::writer::detail {
+
+namespace {
+
+void compress_gzip(const BlockCompressor::Options& options, const std::string& in, std::string* out,
+                   std::string* error) {
+    z_stream zs = {};
+    int level = options.level > 0 ? options.level : Z_DEFAULT_COMPRESSION;
+
+    // A window of 15 bits plus 16 produces a gzip wrapper.
+    if ( deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK ) {
+        *error = "deflateInit2 failed";
+        return;
+    }
+
+    out->resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out->data());
+    zs.avail_out = static_cast<uInt>(out->size());
+
+    if ( deflate(&zs, Z_FINISH) == Z_STREAM_END )
+        out->resize(zs.total_out);
+    else
+        *error = zs.msg ? zs.msg : "deflate failed";
+
+    deflateEnd(&zs);
+}
+
+#ifdef USE_ZSTD
+void compress_zstd(const BlockCompressor::Options& options, const std::string& in, std::string* out,
+                   std::string* error) {
+    // Contexts are expensive to set up, so each pool thread keeps one.
+    struct Context {
+        ZSTD_CCtx* cctx = ZSTD_createCCtx();
+        ~Context() { ZSTD_freeCCtx(cctx); }
+    };
+
+    thread_local Context ctx;
+
+    ZSTD_CCtx_reset(ctx.cctx, ZSTD_reset_session_and_parameters);
+
+    size_t rc = ZSTD_CCtx_setParameter(ctx.cctx, ZSTD_c_compressionLevel,
+                                       options.level > 0 ? options.level : ZSTD_CLEVEL_DEFAULT);
+
+    if ( ! ZSTD_isError(rc) && options.window_log > 0 )
+        rc = ZSTD_CCtx_setParameter(ctx.cctx, ZSTD_c_windowLog, options.window_log);
+
+    if ( ZSTD_isError(rc) ) {
+        *error = ZSTD_getErrorName(rc);
+        return;
+    }
+
+    out->resize(ZSTD_compressBound(in.size()));
+    rc = ZSTD_compress2(ctx.cctx, out->data(), out->size(), in.data(), in.size());
+
+    if ( ZSTD_isError(rc) )
+        *error = ZSTD_getErrorName(rc);
+    else
+        out->resize(rc);
+}
+#endif
+
+} // namespace
+
+BlockCompressor::BlockCompressor(int arg_fd, const Options& arg_options, threading::TaskPool* arg_pool)
+    : fd(arg_fd), options(arg_options), pool(arg_pool) {
+    assert(options.block_size > 0 && options.block_size <= MAX_BLOCK_SIZE);
+
+    // Enough to keep all threads busy while we wait for the oldest block,
+    // but bounded so that memory usage stays in check if the disk can't
+    // keep up.
+    max_pending = pool ? 2 * pool->NumThreads() : 0;
+}
+
+BlockCompressor::~BlockCompressor() {
+    for ( auto& p : pending )
+        p.second.wait();
+}
+
+bool BlockCompressor::Available(Codec codec) {
+#ifdef USE_ZSTD
+    return true;
+#else
+    return codec == Codec::Gzip;
+#endif
+}
+
+void BlockCompressor::Compress(const Options& options, Block* block) {
+    switch ( options.codec ) {
+        case Codec::Gzip: compress_gzip(options, block->in, &block->out, &block->error); break;
+
+        case Codec::Zstd:
+#ifdef USE_ZSTD
+            compress_zstd(options, block->in, &block->out, &block->error);
+#else
+            block->error = "zstd support not compiled in";
+#endif
+            break;
+    }
+
+    // Release the input right away, the block may wait a while to be
+    // written.
+    std::string().swap(block->in);
+}
+
+bool BlockCompressor::Write(const char* data, size_t len) {
+    while ( len > 0 ) {
+        if ( ! current ) {
+            current = std::make_unique<Block>();
+            current->in.reserve(options.block_size);
+        }
+
+        size_t n = std::min(len, options.block_size - current->in.size());
+        current->in.append(data, n);
+        data += n;
+        len -= n;
+
+        if ( current->in.size() == options.block_size ) {
+            Dispatch();
+
+            if ( ! WriteCompleted(max_pending) )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool BlockCompressor::Flush() {
+    if ( current && ! current->in.empty() )
+        Dispatch();
+
+    return WriteCompleted(0);
+}
+
+void BlockCompressor::Dispatch() {
+    Block* block = current.get();
+
+    if ( ! pool ) {
+        Compress(options, block);
+        std::promise<void> done;
+        done.set_value();
+        pending.emplace_back(std::move(current), done.get_future());
+        return;
+    }
+
+    auto done = std::make_shared<std::promise<void>>();
+    auto future = done->get_future();
+    pool->Submit([options = options, block, done] {
+        Compress(options, block);
+        done->set_value();
+    });
+
+    pending.emplace_back(std::move(current), std::move(future));
+}
+
+bool BlockCompressor::WriteCompleted(size_t max_left) {
+    while ( ! pending.empty() ) {
+        auto& [block, future] = pending.front();
+
+        if ( pending.size() > max_left )
+            future.wait();
+        else if ( future.wait_for(std::chrono::seconds(0)) != std::future_status::ready )
+            break;
+
+        bool ok = block->error.empty();
+
+        if ( ! ok )
+            error = block->error;
+
+        else if ( ! util::safe_write(fd, block->out.data(), static_cast<int>(block->out.size())) ) {
+            char buf[256];
+            util::zeek_strerror_r(errno, buf, sizeof(buf));
+            error = std::string("write failed: ") + buf;
+            ok = false;
+        }
+
+        pending.pop_front();
+
+        if ( ! ok )
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace zeek::logging::writer::detail
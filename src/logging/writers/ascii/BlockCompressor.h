@@ -0,0 +1,109 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+
+namespace zeek::threading {
+class TaskPool;
+}
+
+namespace zeek::logging::writer::detail {
+
+/**
+ * Compresses output in independent blocks, optionally spreading the work
+ * across the threads of a TaskPool.
+ *
+ * Output gets buffered until a block is full. Each block is then compressed
+ * into a self-contained gzip member or zstd frame. The standard tools
+ * decompress a concatenation of those as if it were one stream. Compressed
+ * blocks are written to the file descriptor in their original order.
+ */
+class BlockCompressor {
+public:
+    enum class Codec { Gzip, Zstd };
+
+    // Blocks larger than this would overflow zlib's 32-bit counters.
+    static constexpr size_t MAX_BLOCK_SIZE = size_t(1) << 30;
+
+    struct Options {
+        Codec codec = Codec::Gzip;
+        int level = 0;               //! Compression level; 0 selects the codec's default.
+        int window_log = 0;          //! zstd window size as a power of two; 0 for the default.
+        size_t block_size = 1 << 20; //! Uncompressed bytes per block, up to MAX_BLOCK_SIZE.
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param fd The file descriptor to write compressed data to. The
+     * compressor doesn't close it.
+     *
+     * @param options Compression parameters.
+     *
+     * @param pool The pool to compress blocks on, or null to compress on
+     * the calling thread.
+     */
+    BlockCompressor(int fd, const Options& options, threading::TaskPool* pool);
+
+    /**
+     * Destructor. Waits for blocks still being compressed, but discards
+     * them. Call Flush() first to write out everything.
+     */
+    ~BlockCompressor();
+
+    /**
+     * Adds data to the output. Returns false if an error occurred, see
+     * Error().
+     */
+    bool Write(const char* data, size_t len);
+
+    /**
+     * Compresses any buffered data as a final, possibly short, block and
+     * writes out all blocks. Returns false if an error occurred.
+     */
+    bool Flush();
+
+    /**
+     * Returns a description of the most recent error.
+     */
+    const std::string& Error() const { return error; }
+
+    /**
+     * Returns true if support for the codec has been compiled in.
+     */
+    static bool Available(Codec codec);
+
+private:
+    struct Block {
+        std::string in;
+        std::string out;
+        std::string error;
+    };
+
+    // Hands the current block off for compression.
+    void Dispatch();
+
+    // Writes out the compressed blocks at the front of the queue, stopping
+    // at the first that isn't done yet. If there are more than max_left
+    // blocks pending, waits for the oldest ones until that's no longer the
+    // case.
+    bool WriteCompleted(size_t max_left);
+
+    static void Compress(const Options& options, Block* block);
+
+    int fd;
+    Options options;
+    threading::TaskPool* pool;
+    size_t max_pending;
+
+    std::unique_ptr<Block> current;
+    std::deque<std::pair<std::unique_ptr<Block>, std::future<void>>> pending;
+    std::string error;
+};
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,287 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/columnar/Columnar.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "zeek/Val.h"
+#include "zeek/logging/writers/columnar/columnar.bif.h"
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail {
+
+using namespace columnar;
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend) {
+    row_group_size = BifConst::LogColumnar::row_group_size;
+    compression_level = static_cast<int>(BifConst::LogColumnar::compression_level);
+    logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
+
+    // Validated in DoInit(), once we can report errors.
+    std::string name = BifConst::LogColumnar::compression->ToStdString();
+    if ( ! ParseCompression(name, &compression) )
+        compression = Compression::None;
+}
+
+Columnar::~Columnar() {
+    if ( ! done )
+        // In case of errors aborting the logging altogether,
+        // DoFinish() may not have been called.
+        CloseFile();
+}
+
+bool Columnar::InitFilterOptions() {
+    const WriterInfo& info = Info();
+    std::string codec = BifConst::LogColumnar::compression->ToStdString();
+
+    for ( const auto& [key, value] : info.config ) {
+        if ( strcmp(key, "compression") == 0 )
+            codec = value;
+
+        else if ( strcmp(key, "compression_level") == 0 ) {
+            compression_level = atoi(value);
+
+            if ( compression_level < 0 ) {
+                Error("invalid value for 'compression_level', must not be negative");
+                return false;
+            }
+        }
+
+        else if ( strcmp(key, "row_group_size") == 0 )
+            row_group_size = strtoull(value, nullptr, 10);
+    }
+
+    if ( ! ParseCompression(codec, &compression) ) {
+        Error(Fmt("invalid or unsupported value for 'compression': '%s'", codec.c_str()));
+        return false;
+    }
+
+    if ( row_group_size == 0 ) {
+        Error("invalid value for 'row_group_size', must be positive");
+        return false;
+    }
+
+    return true;
+}
+
+bool Columnar::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields) {
+    if ( ! InitFilterOptions() )
+        return false;
+
+    for ( int i = 0; i < num_fields; ++i ) {
+        if ( fields[i]->type == TYPE_PATTERN ) {
+            Error(Fmt("field '%s' has unsupported type %s", fields[i]->name, type_name(fields[i]->type)));
+            return false;
+        }
+
+        columns.emplace_back(std::make_unique<ColumnEncoder>(fields[i]));
+    }
+
+    fname = info.path;
+
+    if ( fname.front() != '/' && ! logdir.empty() )
+        fname = (zeek::filesystem::path(logdir) / fname).string();
+
+    fname += "." + LogExt();
+
+    return OpenFile();
+}
+
+bool Columnar::OpenFile() {
+    fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if ( fd < 0 ) {
+        Error(Fmt("cannot open %s: %s", fname.c_str(), Strerror(errno)));
+        fd = -1;
+        return false;
+    }
+
+    if ( ! WriteHeader() ) {
+        Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+void Columnar::CloseFile() {
+    if ( fd < 0 )
+        return;
+
+    FlushRowGroup();
+    util::safe_close(fd);
+    fd = -1;
+}
+
+bool Columnar::WriteHeader() {
+    std::string header;
+    ByteWriter w(&header);
+
+    w.PutVarint(VERSION);
+    w.PutString(Info().path);
+    w.PutDouble(Info().network_time);
+    w.PutVarint(NumFields());
+
+    for ( int i = 0; i < NumFields(); ++i ) {
+        const Field* f = Fields()[i];
+        w.PutString(f->name);
+        w.PutU8(f->type);
+        w.PutU8(f->subtype);
+        w.PutU8(f->optional ? 1 : 0);
+    }
+
+    std::string prefix(MAGIC, sizeof(MAGIC));
+    ByteWriter pw(&prefix);
+    pw.PutVarint(header.size());
+
+    return InternalWrite(prefix) && InternalWrite(header);
+}
+
+bool Columnar::FlushRowGroup() {
+    if ( rows == 0 )
+        return true;
+
+    group.clear();
+    ByteWriter w(&group);
+    w.PutVarint(rows);
+    w.PutVarint(columns.size());
+
+    for ( auto& c : columns ) {
+        chunk.clear();
+        c->Finish(&chunk);
+
+        const std::string* stored = &chunk;
+        Compression used = Compression::None;
+
+        if ( compression != Compression::None ) {
+            if ( ! Compress(compression, compression_level, chunk, &compressed) ) {
+                Error(Fmt("%s compression failed for %s", CompressionName(compression), fname.c_str()));
+                return false;
+            }
+
+            // Not everything compresses. Keep such chunks as they are.
+            if ( compressed.size() < chunk.size() ) {
+                stored = &compressed;
+                used = compression;
+            }
+        }
+
+        w.PutU8(static_cast<uint8_t>(used));
+        w.PutVarint(chunk.size());
+        w.PutVarint(stored->size());
+        w.PutBytes(stored->data(), stored->size());
+    }
+
+    rows = 0;
+
+    std::string prefix;
+    ByteWriter pw(&prefix);
+    pw.PutU32(ROW_GROUP_MAGIC);
+    pw.PutU64(group.size());
+
+    if ( ! (InternalWrite(prefix) && InternalWrite(group)) ) {
+        Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+        return false;
+    }
+
+    return true;
+}
+
+bool Columnar::InternalWrite(const std::string& data) {
+    const char* p = data.data();
+    size_t len = data.size();
+
+    // safe_write() takes an int length.
+    while ( len > 0 ) {
+        int n = static_cast<int>(std::min(len, size_t(1) << 30));
+
+        if ( ! util::safe_write(fd, p, n) )
+            return false;
+
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+bool Columnar::DoWrite(int num_fields, const Field* const* fields, Value** vals) {
+    if ( fd < 0 && ! OpenFile() )
+        return false;
+
+    for ( int i = 0; i < num_fields; ++i )
+        columns[i]->Add(vals[i]);
+
+    if ( ++rows >= row_group_size || ! IsBuf() )
+        return FlushRowGroup();
+
+    return true;
+}
+
+bool Columnar::DoFlush(double network_time) {
+    if ( fd < 0 )
+        return true;
+
+    // This ends the current row group early, but makes everything logged
+    // so far visible to readers.
+    return FlushRowGroup();
+}
+
+bool Columnar::DoFinish(double network_time) {
+    if ( done ) {
+        fprintf(stderr, "internal error: duplicate finish\n");
+        abort();
+    }
+
+    done = true;
+    CloseFile();
+    return true;
+}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating) {
+    if ( fd < 0 ) {
+        FinishedRotation();
+        return true;
+    }
+
+    CloseFile();
+
+    std::string nname = std::string(rotated_path) + "." + LogExt();
+
+    if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
+        Error(Fmt("failed to rename %s to %s: %s", fname.c_str(), nname.c_str(), Strerror(errno)));
+        FinishedRotation();
+        return false;
+    }
+
+    if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) ) {
+        Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Columnar::DoSetBuf(bool enabled) {
+    // Unbuffered writing degrades to one row per row group, so flush what
+    // we have before that starts.
+    if ( ! enabled )
+        return FlushRowGroup();
+
+    return true;
+}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time) {
+    // Nothing to do.
+    return true;
+}
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,66 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for binary, column-oriented logs.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/writers/columnar/Format.h"
+
+namespace zeek::logging::writer::detail {
+
+/**
+ * Writes logs in a self-describing columnar format (see Format.h). Records
+ * are buffered into row groups. Once a row group is full, each of its
+ * columns gets encoded and compressed separately, which lets values of the
+ * same type and similar content end up next to each other.
+ */
+class Columnar : public WriterBackend {
+public:
+    explicit Columnar(WriterFrontend* frontend);
+    ~Columnar() override;
+
+    static std::string LogExt() { return "zcol"; }
+
+    static WriterBackend* Instantiate(WriterFrontend* frontend) { return new Columnar(frontend); }
+
+protected:
+    bool DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) override;
+    bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) override;
+    bool DoSetBuf(bool enabled) override;
+    bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
+    bool DoFlush(double network_time) override;
+    bool DoFinish(double network_time) override;
+    bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+    bool InitFilterOptions();
+    bool OpenFile();
+    void CloseFile();
+    bool WriteHeader();
+    bool FlushRowGroup();
+    bool InternalWrite(const std::string& data);
+
+    int fd = -1;
+    std::string fname;
+    std::vector<std::unique_ptr<columnar::ColumnEncoder>> columns;
+    size_t rows = 0;
+    bool done = false;
+
+    // Scratch buffers, kept across row groups.
+    std::string group;
+    std::string chunk;
+    std::string compressed;
+
+    // Options set from the script-level.
+    uint64_t row_group_size;
+    columnar::Compression compression;
+    int compression_level;
+    std::string logdir;
+};
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,882 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/columnar/Format.h"
+
+#include "zeek/zeek-config.h"
+
+#include <zlib.h>
+#include <cstring>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+using zeek::threading::Field;
+using zeek::threading::Value;
+
+namespace zeek::logging::writer::detail::columnar {
+
+namespace {
+
+// Beyond this many distinct values per row group, we stop building a
+// dictionary.
+constexpr size_t MAX_DICT_ENTRIES = 65536;
+
+uint64_t to_bits(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+double from_bits(uint64_t u) {
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+bool is_double(TypeTag t) { return t == TYPE_DOUBLE || t == TYPE_TIME || t == TYPE_INTERVAL; }
+
+// The 64-bit pattern a numeric value is stored as. Ports keep their
+// protocol in the lowest two bits.
+uint64_t to_num(const Value& v) {
+    switch ( v.type ) {
+        case TYPE_BOOL:
+        case TYPE_INT: return static_cast<uint64_t>(v.val.int_val);
+        case TYPE_COUNT: return v.val.uint_val;
+        case TYPE_PORT: return (v.val.port_val.port << 2) | (v.val.port_val.proto & 0x3);
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: return to_bits(v.val.double_val);
+        default: return 0;
+    }
+}
+
+void from_num(uint64_t n, Value* v) {
+    switch ( v->type ) {
+        case TYPE_BOOL:
+        case TYPE_INT: v->val.int_val = static_cast<zeek_int_t>(n); break;
+        case TYPE_COUNT: v->val.uint_val = n; break;
+        case TYPE_PORT:
+            v->val.port_val.port = n >> 2;
+            v->val.port_val.proto = static_cast<TransportProto>(n & 0x3);
+            break;
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: v->val.double_val = from_bits(n); break;
+        default: break;
+    }
+}
+
+void put_addr(ByteWriter* w, const Value::addr_t& a) {
+    if ( a.family == IPv4 ) {
+        w->PutU8(4);
+        w->PutBytes(&a.in.in4, sizeof(a.in.in4));
+    }
+    else {
+        w->PutU8(6);
+        w->PutBytes(&a.in.in6, sizeof(a.in.in6));
+    }
+}
+
+bool get_addr(ByteReader* r, Value::addr_t* a) {
+    switch ( r->GetU8() ) {
+        case 4:
+            if ( const uint8_t* b = r->GetBytes(sizeof(a->in.in4)) ) {
+                a->family = IPv4;
+                memcpy(&a->in.in4, b, sizeof(a->in.in4));
+                return true;
+            }
+            return false;
+
+        case 6:
+            if ( const uint8_t* b = r->GetBytes(sizeof(a->in.in6)) ) {
+                a->family = IPv6;
+                memcpy(&a->in.in6, b, sizeof(a->in.in6));
+                return true;
+            }
+            return false;
+
+        default: return false;
+    }
+}
+
+void put_raw(ByteWriter* w, const Value& v);
+
+// Container elements carry their own presence flag, and non-numeric ones
+// a length.
+void put_element(ByteWriter* w, const Value& v) {
+    w->PutU8(v.present ? 1 : 0);
+
+    if ( ! v.present )
+        return;
+
+    if ( is_double(v.type) )
+        w->PutDouble(v.val.double_val);
+    else if ( v.type == TYPE_INT )
+        w->PutZigZag(v.val.int_val);
+    else if ( IsNumeric(v.type) )
+        w->PutVarint(to_num(v));
+    else {
+        std::string raw;
+        ByteWriter rw(&raw);
+        put_raw(&rw, v);
+        w->PutString(raw);
+    }
+}
+
+// Serializes a non-numeric value without any framing.
+void put_raw(ByteWriter* w, const Value& v) {
+    switch ( v.type ) {
+        case TYPE_STRING:
+        case TYPE_ENUM:
+        case TYPE_FILE:
+        case TYPE_FUNC: w->PutBytes(v.val.string_val.data, v.val.string_val.length); break;
+
+        case TYPE_ADDR: put_addr(w, v.val.addr_val); break;
+
+        case TYPE_SUBNET: {
+            // The logging framework hands us IPv4 prefix lengths relative
+            // to the IPv6 address space, the input framework wants them
+            // relative to IPv4. We store the latter.
+            uint8_t len = v.val.subnet_val.length;
+            if ( v.val.subnet_val.prefix.family == IPv4 && len >= 96 )
+                len -= 96;
+
+            put_addr(w, v.val.subnet_val.prefix);
+            w->PutU8(len);
+            break;
+        }
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR:
+            w->PutVarint(v.val.set_val.size);
+            for ( zeek_int_t i = 0; i < v.val.set_val.size; ++i )
+                put_element(w, *v.val.set_val.vals[i]);
+            break;
+
+        default: break;
+    }
+}
+
+bool get_raw(TypeTag type, TypeTag subtype, const uint8_t* data, size_t len, Value* v);
+
+bool get_element(ByteReader* r, TypeTag type, Value** v) {
+    if ( ! r->GetU8() ) {
+        *v = new Value(type, false);
+        return r->Ok();
+    }
+
+    *v = new Value(type, true);
+
+    if ( is_double(type) )
+        (*v)->val.double_val = r->GetDouble();
+    else if ( type == TYPE_INT )
+        (*v)->val.int_val = r->GetZigZag();
+    else if ( IsNumeric(type) )
+        from_num(r->GetVarint(), *v);
+    else {
+        uint64_t n = r->GetVarint();
+        const uint8_t* b = r->GetBytes(n);
+        if ( ! b || ! get_raw(type, TYPE_VOID, b, n, *v) )
+            return false;
+    }
+
+    return r->Ok();
+}
+
+bool get_raw(TypeTag type, TypeTag subtype, const uint8_t* data, size_t len, Value* v) {
+    ByteReader r(data, len);
+
+    switch ( type ) {
+        case TYPE_STRING:
+        case TYPE_ENUM:
+        case TYPE_FILE:
+        case TYPE_FUNC:
+            v->val.string_val.data = new char[len];
+            v->val.string_val.length = static_cast<int>(len);
+            memcpy(v->val.string_val.data, data, len);
+            return true;
+
+        case TYPE_ADDR: return get_addr(&r, &v->val.addr_val) && r.Remaining() == 0;
+
+        case TYPE_SUBNET:
+            if ( ! get_addr(&r, &v->val.subnet_val.prefix) )
+                return false;
+
+            v->val.subnet_val.length = r.GetU8();
+            return r.Ok() && r.Remaining() == 0;
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: {
+            uint64_t n = r.GetVarint();
+
+            // Each element takes at least a byte.
+            if ( ! r.Ok() || n > r.Remaining() )
+                return false;
+
+            v->val.set_val.size = static_cast<zeek_int_t>(n);
+            v->val.set_val.vals = new Value*[n];
+
+            for ( uint64_t i = 0; i < n; ++i ) {
+                if ( ! get_element(&r, subtype, &v->val.set_val.vals[i]) ) {
+                    // get_element() always allocates the element, so this
+                    // keeps the value consistent for its destructor.
+                    v->val.set_val.size = static_cast<zeek_int_t>(i + 1);
+                    return false;
+                }
+            }
+
+            return r.Remaining() == 0;
+        }
+
+        default: return false;
+    }
+}
+
+} // namespace
+
+bool IsNumeric(TypeTag t) {
+    switch ( t ) {
+        case TYPE_BOOL:
+        case TYPE_INT:
+        case TYPE_COUNT:
+        case TYPE_PORT:
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: return true;
+        default: return false;
+    }
+}
+
+bool CompressionAvailable(Compression c) {
+    switch ( c ) {
+        case Compression::None:
+        case Compression::Deflate: return true;
+#ifdef USE_ZSTD
+        case Compression::Zstd: return true;
+#endif
+#ifdef USE_LZ4
+        case Compression::Lz4: return true;
+#endif
+        default: return false;
+    }
+}
+
+const char* CompressionName(Compression c) {
+    switch ( c ) {
+        case Compression::None: return "none";
+        case Compression::Deflate: return "deflate";
+        case Compression::Zstd: return "zstd";
+        case Compression::Lz4: return "lz4";
+    }
+
+    return "<unknown>";
+}
+
+bool ParseCompression(const std::string& name, Compression* c) {
+    if ( name == "auto" ) {
+        *c = CompressionAvailable(Compression::Zstd) ? Compression::Zstd : Compression::Deflate;
+        return true;
+    }
+
+    for ( auto candidate : {Compression::None, Compression::Deflate, Compression::Zstd, Compression::Lz4} ) {
+        if ( name == CompressionName(candidate) ) {
+            *c = candidate;
+            return CompressionAvailable(candidate);
+        }
+    }
+
+    return false;
+}
+
+bool Compress(Compression c, int level, const std::string& in, std::string* out) {
+    switch ( c ) {
+        case Compression::None: *out = in; return true;
+
+        case Compression::Deflate: {
+            uLongf n = compressBound(in.size());
+            out->resize(n);
+            int rc = compress2(reinterpret_cast<Bytef*>(out->data()), &n, reinterpret_cast<const Bytef*>(in.data()),
+                               in.size(), level > 0 ? level : Z_DEFAULT_COMPRESSION);
+            if ( rc != Z_OK )
+                return false;
+
+            out->resize(n);
+            return true;
+        }
+
+#ifdef USE_ZSTD
+        case Compression::Zstd: {
+            out->resize(ZSTD_compressBound(in.size()));
+            size_t n = ZSTD_compress(out->data(), out->size(), in.data(), in.size(),
+                                     level > 0 ? level : ZSTD_CLEVEL_DEFAULT);
+            if ( ZSTD_isError(n) )
+                return false;
+
+            out->resize(n);
+            return true;
+        }
+#endif
+
+#ifdef USE_LZ4
+        case Compression::Lz4: {
+            if ( in.size() > LZ4_MAX_INPUT_SIZE )
+                return false;
+
+            out->resize(LZ4_compressBound(static_cast<int>(in.size())));
+            // For LZ4, the level is the acceleration factor: higher is
+            // faster, but compresses less.
+            int n = LZ4_compress_fast(in.data(), out->data(), static_cast<int>(in.size()),
+                                      static_cast<int>(out->size()), level > 0 ? level : 1);
+            if ( n <= 0 )
+                return false;
+
+            out->resize(n);
+            return true;
+        }
+#endif
+
+        default: return false;
+    }
+}
+
+bool Decompress(Compression c, const uint8_t* in, size_t len, size_t raw_size, std::string* out) {
+    if ( raw_size > MAX_CHUNK_SIZE )
+        return false;
+
+    out->resize(raw_size);
+
+    switch ( c ) {
+        case Compression::None:
+            if ( len != raw_size )
+                return false;
+
+            memcpy(out->data(), in, len);
+            return true;
+
+        case Compression::Deflate: {
+            uLongf n = raw_size;
+            return uncompress(reinterpret_cast<Bytef*>(out->data()), &n, in, len) == Z_OK && n == raw_size;
+        }
+
+#ifdef USE_ZSTD
+        case Compression::Zstd: {
+            size_t n = ZSTD_decompress(out->data(), raw_size, in, len);
+            return ! ZSTD_isError(n) && n == raw_size;
+        }
+#endif
+
+#ifdef USE_LZ4
+        case Compression::Lz4: {
+            int n = LZ4_decompress_safe(reinterpret_cast<const char*>(in), out->data(), static_cast<int>(len),
+                                        static_cast<int>(raw_size));
+            return n >= 0 && static_cast<size_t>(n) == raw_size;
+        }
+#endif
+
+        default: return false;
+    }
+}
+
+void ByteWriter::PutU32(uint32_t v) {
+    for ( int i = 0; i < 4; ++i )
+        PutU8(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+void ByteWriter::PutU64(uint64_t v) {
+    for ( int i = 0; i < 8; ++i )
+        PutU8(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+void ByteWriter::PutDouble(double v) { PutU64(to_bits(v)); }
+
+void ByteWriter::PutVarint(uint64_t v) {
+    while ( v >= 0x80 ) {
+        PutU8(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+
+    PutU8(static_cast<uint8_t>(v));
+}
+
+uint8_t ByteReader::GetU8() {
+    if ( pos >= end ) {
+        ok = false;
+        return 0;
+    }
+
+    return *pos++;
+}
+
+uint32_t ByteReader::GetU32() {
+    uint32_t v = 0;
+    for ( int i = 0; i < 4; ++i )
+        v |= static_cast<uint32_t>(GetU8()) << (8 * i);
+    return v;
+}
+
+uint64_t ByteReader::GetU64() {
+    uint64_t v = 0;
+    for ( int i = 0; i < 8; ++i )
+        v |= static_cast<uint64_t>(GetU8()) << (8 * i);
+    return v;
+}
+
+double ByteReader::GetDouble() { return from_bits(GetU64()); }
+
+uint64_t ByteReader::GetVarint() {
+    uint64_t v = 0;
+
+    for ( int shift = 0; shift < 64; shift += 7 ) {
+        uint8_t b = GetU8();
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+        if ( ! (b & 0x80) )
+            return v;
+    }
+
+    ok = false;
+    return 0;
+}
+
+const uint8_t* ByteReader::GetBytes(size_t len) {
+    if ( static_cast<size_t>(end - pos) < len ) {
+        ok = false;
+        return nullptr;
+    }
+
+    const uint8_t* b = pos;
+    pos += len;
+    return b;
+}
+
+bool ByteReader::GetString(std::string* s) {
+    uint64_t len = GetVarint();
+    const uint8_t* b = GetBytes(len);
+
+    if ( ! b )
+        return false;
+
+    s->assign(reinterpret_cast<const char*>(b), len);
+    return true;
+}
+
+ColumnEncoder::ColumnEncoder(const Field* field) : type(field->type), subtype(field->subtype) {}
+
+void ColumnEncoder::Add(const Value* val) {
+    if ( rows % 8 == 0 )
+        presence.push_back(0);
+
+    ++rows;
+
+    if ( ! val->present ) {
+        ++nulls;
+        return;
+    }
+
+    presence.back() |= 1 << ((rows - 1) % 8);
+
+    if ( IsNumeric(type) ) {
+        nums.push_back(to_num(*val));
+        return;
+    }
+
+    size_t start = pool.size();
+    ByteWriter w(&pool);
+    put_raw(&w, *val);
+    offsets.push_back(static_cast<uint32_t>(start));
+
+    if ( ! use_dict )
+        return;
+
+    auto [it, inserted] = dict.try_emplace(pool.substr(start), static_cast<uint32_t>(dict.size()));
+    dict_indices.push_back(it->second);
+
+    if ( dict.size() > MAX_DICT_ENTRIES ) {
+        use_dict = false;
+        dict.clear();
+        dict_indices.clear();
+    }
+}
+
+Encoding ColumnEncoder::ChooseIntEncoding() const {
+    if ( is_double(type) )
+        return Encoding::XorDelta;
+
+    if ( type == TYPE_BOOL )
+        return Encoding::RunLength;
+
+    size_t runs = 0;
+    for ( size_t i = 0; i < nums.size(); ++i )
+        if ( i == 0 || nums[i] != nums[i - 1] )
+            ++runs;
+
+    return runs * 4 <= nums.size() ? Encoding::RunLength : Encoding::Delta;
+}
+
+void ColumnEncoder::Finish(std::string* out) {
+    ByteWriter w(out);
+    Encoding enc;
+
+    if ( IsNumeric(type) )
+        enc = ChooseIntEncoding();
+    else
+        enc = (use_dict && dict.size() * 2 <= offsets.size()) ? Encoding::Dictionary : Encoding::Plain;
+
+    w.PutU8(static_cast<uint8_t>(enc));
+    w.PutVarint(nulls);
+
+    if ( nulls > 0 )
+        w.PutBytes(presence.data(), presence.size());
+
+    switch ( enc ) {
+        case Encoding::Delta: {
+            uint64_t prev = 0;
+            for ( auto n : nums ) {
+                w.PutZigZag(static_cast<int64_t>(n - prev));
+                prev = n;
+            }
+            break;
+        }
+
+        case Encoding::RunLength:
+            for ( size_t i = 0; i < nums.size(); ) {
+                size_t j = i + 1;
+                while ( j < nums.size() && nums[j] == nums[i] )
+                    ++j;
+
+                w.PutZigZag(static_cast<int64_t>(nums[i]));
+                w.PutVarint(j - i);
+                i = j;
+            }
+            break;
+
+        case Encoding::XorDelta: {
+            uint64_t prev = 0;
+            for ( auto n : nums ) {
+                w.PutVarint(n ^ prev);
+                prev = n;
+            }
+            break;
+        }
+
+        case Encoding::Dictionary: {
+            std::vector<const std::string*> entries(dict.size());
+            for ( const auto& [value, idx] : dict )
+                entries[idx] = &value;
+
+            w.PutVarint(entries.size());
+            for ( const auto* e : entries )
+                w.PutString(*e);
+
+            for ( auto idx : dict_indices )
+                w.PutVarint(idx);
+            break;
+        }
+
+        case Encoding::Plain:
+            for ( size_t i = 0; i < offsets.size(); ++i ) {
+                size_t end = i + 1 < offsets.size() ? offsets[i + 1] : pool.size();
+                w.PutString(pool.data() + offsets[i], end - offsets[i]);
+            }
+            break;
+    }
+
+    rows = nulls = 0;
+    presence.clear();
+    nums.clear();
+    pool.clear();
+    offsets.clear();
+    dict.clear();
+    dict_indices.clear();
+    use_dict = true;
+}
+
+bool DecodeColumn(const Field* field, const uint8_t* data, size_t len, size_t rows, std::vector<Value*>* out) {
+    ByteReader r(data, len);
+    auto enc = static_cast<Encoding>(r.GetU8());
+    uint64_t nulls = r.GetVarint();
+
+    if ( ! r.Ok() || nulls > rows )
+        return false;
+
+    const uint8_t* bitmap = nullptr;
+    if ( nulls > 0 && ! (bitmap = r.GetBytes((rows + 7) / 8)) )
+        return false;
+
+    size_t present = rows - nulls;
+    std::vector<uint64_t> nums;
+    std::vector<std::pair<const uint8_t*, size_t>> raws;
+
+    switch ( enc ) {
+        case Encoding::Plain:
+            for ( size_t i = 0; i < present && r.Ok(); ++i ) {
+                uint64_t n = r.GetVarint();
+                if ( const uint8_t* b = r.GetBytes(n) )
+                    raws.emplace_back(b, n);
+            }
+            break;
+
+        case Encoding::Dictionary: {
+            uint64_t n = r.GetVarint();
+            if ( n > r.Remaining() )
+                return false;
+
+            std::vector<std::pair<const uint8_t*, size_t>> entries;
+            for ( uint64_t i = 0; i < n && r.Ok(); ++i ) {
+                uint64_t elen = r.GetVarint();
+                if ( const uint8_t* b = r.GetBytes(elen) )
+                    entries.emplace_back(b, elen);
+            }
+
+            for ( size_t i = 0; i < present && r.Ok(); ++i ) {
+                uint64_t idx = r.GetVarint();
+                if ( idx >= entries.size() )
+                    return false;
+
+                raws.push_back(entries[idx]);
+            }
+            break;
+        }
+
+        case Encoding::Delta: {
+            uint64_t prev = 0;
+            for ( size_t i = 0; i < present && r.Ok(); ++i ) {
+                prev += static_cast<uint64_t>(r.GetZigZag());
+                nums.push_back(prev);
+            }
+            break;
+        }
+
+        case Encoding::RunLength:
+            while ( nums.size() < present && r.Ok() ) {
+                uint64_t v = static_cast<uint64_t>(r.GetZigZag());
+                uint64_t run = r.GetVarint();
+                if ( run == 0 || run > present - nums.size() )
+                    return false;
+
+                nums.insert(nums.end(), run, v);
+            }
+            break;
+
+        case Encoding::XorDelta: {
+            uint64_t prev = 0;
+            for ( size_t i = 0; i < present && r.Ok(); ++i ) {
+                prev ^= r.GetVarint();
+                nums.push_back(prev);
+            }
+            break;
+        }
+
+        default: return false;
+    }
+
+    if ( ! r.Ok() || nums.size() + raws.size() != present || (IsNumeric(field->type) != raws.empty() && present) )
+        return false;
+
+    out->reserve(out->size() + rows);
+    size_t next = 0;
+
+    for ( size_t i = 0; i < rows; ++i ) {
+        if ( bitmap && ! (bitmap[i / 8] & (1 << (i % 8))) ) {
+            out->push_back(new Value(field->type, field->subtype, false));
+            continue;
+        }
+
+        auto* v = new Value(field->type, field->subtype, true);
+        out->push_back(v);
+
+        if ( IsNumeric(field->type) )
+            from_num(nums[next], v);
+        else if ( ! get_raw(field->type, field->subtype, raws[next].first, raws[next].second, v) )
+            return false;
+
+        ++next;
+    }
+
+    return true;
+}
+
+TEST_SUITE_BEGIN("ColumnarFormat");
+
+namespace {
+
+Value* make_string(const char* s) {
+    auto* v = new Value(TYPE_STRING, true);
+    v->val.string_val.length = static_cast<int>(strlen(s));
+    v->val.string_val.data = new char[v->val.string_val.length];
+    memcpy(v->val.string_val.data, s, v->val.string_val.length);
+    return v;
+}
+
+std::vector<Value*> roundtrip(const Field& field, const std::vector<Value*>& vals, Encoding* enc = nullptr) {
+    ColumnEncoder encoder(&field);
+    for ( auto* v : vals )
+        encoder.Add(v);
+
+    CHECK(encoder.Rows() == vals.size());
+
+    std::string chunk;
+    encoder.Finish(&chunk);
+    CHECK(encoder.Rows() == 0);
+
+    if ( enc )
+        *enc = static_cast<Encoding>(chunk[0]);
+
+    std::vector<Value*> out;
+    CHECK(DecodeColumn(&field, reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size(), vals.size(), &out));
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("columnar varints") {
+    std::string buf;
+    ByteWriter w(&buf);
+    w.PutVarint(0);
+    w.PutVarint(300);
+    w.PutVarint(UINT64_MAX);
+    w.PutZigZag(-1);
+    w.PutZigZag(INT64_MIN);
+    w.PutDouble(1.5);
+
+    ByteReader r(reinterpret_cast<const uint8_t*>(buf.data()), buf.size());
+    CHECK(r.GetVarint() == 0);
+    CHECK(r.GetVarint() == 300);
+    CHECK(r.GetVarint() == UINT64_MAX);
+    CHECK(r.GetZigZag() == -1);
+    CHECK(r.GetZigZag() == INT64_MIN);
+    CHECK(r.GetDouble() == 1.5);
+    CHECK(r.Ok());
+    CHECK(r.Remaining() == 0);
+
+    r.GetU8();
+    CHECK_FALSE(r.Ok());
+}
+
+TEST_CASE("columnar numeric columns") {
+    Field counts("c", nullptr, TYPE_COUNT, TYPE_VOID, true);
+    std::vector<Value*> vals;
+    for ( int i = 0; i < 100; ++i ) {
+        auto* v = new Value(TYPE_COUNT, i % 10 != 3);
+        v->val.uint_val = 1000 + i * 3;
+        vals.push_back(v);
+    }
+
+    Encoding enc;
+    auto out = roundtrip(counts, vals, &enc);
+    CHECK(enc == Encoding::Delta);
+    REQUIRE(out.size() == vals.size());
+    for ( size_t i = 0; i < vals.size(); ++i ) {
+        CHECK(out[i]->present == vals[i]->present);
+        if ( vals[i]->present )
+            CHECK(out[i]->val.uint_val == vals[i]->val.uint_val);
+    }
+
+    Field times("ts", nullptr, TYPE_TIME, TYPE_VOID, false);
+    std::vector<Value*> tvals;
+    for ( int i = 0; i < 50; ++i ) {
+        auto* v = new Value(TYPE_TIME, true);
+        v->val.double_val = 1700000000.0 + i * 0.001234;
+        tvals.push_back(v);
+    }
+
+    auto tout = roundtrip(times, tvals, &enc);
+    CHECK(enc == Encoding::XorDelta);
+    for ( size_t i = 0; i < tvals.size(); ++i )
+        CHECK(tout[i]->val.double_val == tvals[i]->val.double_val);
+
+    Field ports("p", nullptr, TYPE_PORT, TYPE_VOID, false);
+    std::vector<Value*> pvals;
+    for ( int i = 0; i < 40; ++i ) {
+        auto* v = new Value(TYPE_PORT, true);
+        v->val.port_val.port = 53;
+        v->val.port_val.proto = TRANSPORT_UDP;
+        pvals.push_back(v);
+    }
+
+    auto pout = roundtrip(ports, pvals, &enc);
+    CHECK(enc == Encoding::RunLength);
+    for ( auto* v : pout ) {
+        CHECK(v->val.port_val.port == 53);
+        CHECK(v->val.port_val.proto == TRANSPORT_UDP);
+    }
+
+    for ( auto* vs : {&vals, &out, &tvals, &tout, &pvals, &pout} )
+        for ( auto* v : *vs )
+            delete v;
+}
+
+TEST_CASE("columnar string and container columns") {
+    Field strings("s", nullptr, TYPE_STRING, TYPE_VOID, true);
+    std::vector<Value*> vals;
+    const char* protos[] = {"http", "dns", "ssl"};
+    for ( int i = 0; i < 30; ++i )
+        vals.push_back(i == 7 ? new Value(TYPE_STRING, false) : make_string(protos[i % 3]));
+
+    Encoding enc;
+    auto out = roundtrip(strings, vals, &enc);
+    CHECK(enc == Encoding::Dictionary);
+    for ( size_t i = 0; i < vals.size(); ++i ) {
+        REQUIRE(out[i]->present == vals[i]->present);
+        if ( vals[i]->present )
+            CHECK(std::string(out[i]->val.string_val.data, out[i]->val.string_val.length) ==
+                  std::string(vals[i]->val.string_val.data, vals[i]->val.string_val.length));
+    }
+
+    Field sets("set", nullptr, TYPE_TABLE, TYPE_ADDR, false);
+    auto* set = new Value(TYPE_TABLE, TYPE_ADDR, true);
+    set->val.set_val.size = 2;
+    set->val.set_val.vals = new Value*[2];
+    for ( int i = 0; i < 2; ++i ) {
+        auto* a = new Value(TYPE_ADDR, true);
+        a->val.addr_val.family = IPv4;
+        a->val.addr_val.in.in4.s_addr = htonl(0x0a000001 + i);
+        set->val.set_val.vals[i] = a;
+    }
+
+    std::vector<Value*> svals = {set};
+    auto sout = roundtrip(sets, svals, &enc);
+    CHECK(enc == Encoding::Plain);
+    REQUIRE(sout[0]->val.set_val.size == 2);
+    CHECK(sout[0]->val.set_val.vals[1]->val.addr_val.family == IPv4);
+    CHECK(sout[0]->val.set_val.vals[1]->val.addr_val.in.in4.s_addr == htonl(0x0a000002));
+
+    for ( auto* vs : {&vals, &out, &svals, &sout} )
+        for ( auto* v : *vs )
+            delete v;
+}
+
+TEST_CASE("columnar compression") {
+    std::string raw(10000, 'x');
+    Compression c;
+
+    CHECK(ParseCompression("deflate", &c));
+    CHECK(c == Compression::Deflate);
+    CHECK(ParseCompression("auto", &c));
+    CHECK_FALSE(ParseCompression("bogus", &c));
+
+    for ( auto codec : {Compression::None, Compression::Deflate, Compression::Zstd, Compression::Lz4} ) {
+        if ( ! CompressionAvailable(codec) )
+            continue;
+
+        std::string packed;
+        std::string unpacked;
+        REQUIRE(Compress(codec, 0, raw, &packed));
+        CHECK(Decompress(codec, reinterpret_cast<const uint8_t*>(packed.data()), packed.size(), raw.size(),
+                         &unpacked));
+        CHECK(unpacked == raw);
+        CHECK_FALSE(
+            Decompress(codec, reinterpret_cast<const uint8_t*>(packed.data()), packed.size() / 2, raw.size(), &unpacked));
+    }
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::logging::writer::detail::columnar
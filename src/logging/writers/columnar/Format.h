@@ -0,0 +1,200 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// On-disk format shared by the columnar log writer and input reader.
+//
+// A file consists of a header describing the columns, followed by any number
+// of self-contained row groups. Each row group stores the values of each
+// column as a separate chunk, encoded and compressed on its own:
+//
+//   file       := MAGIC varint(header_len) header row_group*
+//   header     := varint(version) string(path) f64(open) varint(num_columns) column*
+//   column     := string(name) u8(type) u8(subtype) u8(optional)
+//   row_group  := u32(ROW_GROUP_MAGIC) u64(len) varint(rows) varint(num_columns) chunk*
+//   chunk      := u8(compression) varint(raw_size) varint(stored_size) bytes(stored_size)
+//
+// The uncompressed bytes of a chunk are
+//
+//   u8(encoding) varint(null_count) [presence bitmap] values
+//
+// where the bitmap (one bit per row, set if present) is only included if
+// there are nulls, and the values of the present rows follow in the chunk's
+// encoding. Fixed-size integers are little-endian, varints are LEB128 with
+// signed values zigzag-encoded, and strings are prefixed by their varint
+// length. A row group's length covers everything following it, so readers
+// can recognize a row group that's still being written.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging::writer::detail::columnar {
+
+constexpr char MAGIC[8] = {'Z', 'E', 'E', 'K', 'C', 'O', 'L', '\x01'};
+constexpr uint32_t ROW_GROUP_MAGIC = 0x4752435a; // "ZCRG"
+constexpr uint64_t VERSION = 1;
+
+// Upper bound for sizes we accept when reading, to guard against corrupt
+// input.
+constexpr uint64_t MAX_CHUNK_SIZE = uint64_t(1) << 30;
+
+enum class Encoding : uint8_t {
+    Plain = 0,      // Values one after the other.
+    Dictionary = 1, // Distinct values, then a varint index per row.
+    Delta = 2,      // Integers as differences to their predecessor.
+    RunLength = 3,  // Integers as (value, run length) pairs.
+    XorDelta = 4,   // Doubles as varint of their bits XORed with the predecessor's.
+};
+
+enum class Compression : uint8_t {
+    None = 0,
+    Deflate = 1,
+    Zstd = 2,
+    Lz4 = 3,
+};
+
+/**
+ * Maps a codec name ("none", "deflate", "zstd", "lz4", or "auto" for the best
+ * one available) to a compression. Returns false if the name is unknown or
+ * the codec isn't available in this build.
+ */
+bool ParseCompression(const std::string& name, Compression* c);
+
+/**
+ * Returns a codec's name.
+ */
+const char* CompressionName(Compression c);
+
+/**
+ * Returns true if support for a codec has been compiled in.
+ */
+bool CompressionAvailable(Compression c);
+
+/**
+ * Compresses data. A level of zero selects the codec's default. Returns false
+ * on error.
+ */
+bool Compress(Compression c, int level, const std::string& in, std::string* out);
+
+/**
+ * Decompresses data into a buffer of the given raw size. Returns false if
+ * the data is corrupt or the codec isn't available.
+ */
+bool Decompress(Compression c, const uint8_t* in, size_t len, size_t raw_size, std::string* out);
+
+/**
+ * Appends primitive values to a byte buffer.
+ */
+class ByteWriter {
+public:
+    explicit ByteWriter(std::string* arg_buf) : buf(arg_buf) {}
+
+    void PutU8(uint8_t v) { buf->push_back(static_cast<char>(v)); }
+    void PutU32(uint32_t v);
+    void PutU64(uint64_t v);
+    void PutDouble(double v);
+    void PutVarint(uint64_t v);
+    void PutZigZag(int64_t v) { PutVarint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63)); }
+    void PutBytes(const void* data, size_t len) { buf->append(static_cast<const char*>(data), len); }
+    void PutString(const char* data, size_t len) {
+        PutVarint(len);
+        PutBytes(data, len);
+    }
+    void PutString(const std::string& s) { PutString(s.data(), s.size()); }
+
+private:
+    std::string* buf;
+};
+
+/**
+ * Reads primitive values from a byte buffer. Reading past the end fails
+ * softly: it returns zeros and clears Ok().
+ */
+class ByteReader {
+public:
+    ByteReader(const uint8_t* data, size_t len) : pos(data), end(data + len) {}
+
+    uint8_t GetU8();
+    uint32_t GetU32();
+    uint64_t GetU64();
+    double GetDouble();
+    uint64_t GetVarint();
+    int64_t GetZigZag() {
+        uint64_t v = GetVarint();
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    // Returns a pointer to the next len bytes and skips them, or null if
+    // there aren't that many.
+    const uint8_t* GetBytes(size_t len);
+    bool GetString(std::string* s);
+
+    bool Ok() const { return ok; }
+    size_t Remaining() const { return end - pos; }
+
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+    bool ok = true;
+};
+
+/**
+ * Collects the values of one column for a row group and encodes them.
+ */
+class ColumnEncoder {
+public:
+    explicit ColumnEncoder(const threading::Field* field);
+
+    /**
+     * Adds the value of the next row.
+     */
+    void Add(const threading::Value* val);
+
+    /**
+     * Encodes the values added since the last call, appending the chunk's
+     * uncompressed bytes to out, and resets the encoder.
+     */
+    void Finish(std::string* out);
+
+    size_t Rows() const { return rows; }
+
+private:
+    // Returns the encoding to use for numeric values.
+    Encoding ChooseIntEncoding() const;
+
+    TypeTag type;
+    TypeTag subtype;
+    size_t rows = 0;
+    size_t nulls = 0;
+    std::vector<uint8_t> presence;
+
+    // Numeric columns keep their values as 64-bit patterns.
+    std::vector<uint64_t> nums;
+
+    // Other columns keep the serialized values in a pool, and build a
+    // dictionary along the way while that's promising.
+    std::string pool;
+    std::vector<uint32_t> offsets;
+    std::unordered_map<std::string, uint32_t> dict;
+    std::vector<uint32_t> dict_indices;
+    bool use_dict = true;
+};
+
+/**
+ * Decodes a column chunk's uncompressed bytes into values of the given field
+ * type, appending them to out. Returns false if the chunk is malformed, in
+ * which case out may have received some values nevertheless.
+ */
+bool DecodeColumn(const threading::Field* field, const uint8_t* data, size_t len, size_t rows,
+                  std::vector<threading::Value*>* out);
+
+/**
+ * Returns true if values of the type are stored as 64-bit numbers.
+ */
+bool IsNumeric(TypeTag t);
+
+} // namespace zeek::logging::writer::detail::columnar
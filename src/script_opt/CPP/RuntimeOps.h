@@ -20,8 +20,8 @@ class CPPRuntime {
 public:
     static auto& RawField(const RecordValPtr& rv, int field) { return rv->RawField(field); }
     static auto& RawField(RecordVal* rv, int field) { return rv->RawField(field); }
-    static auto& RawOptField(const RecordValPtr& rv, int field) { return rv->RawOptField(field); }
-    static auto& RawOptField(RecordVal* rv, int field) { return rv->RawOptField(field); }
+    static auto RawOptField(const RecordValPtr& rv, int field) { return rv->RawOptField(field); }
+    static auto RawOptField(RecordVal* rv, int field) { return rv->RawOptField(field); }
 
     static const auto& GetCreationInits(const RecordType* rt) { return rt->CreationInits(); }
 
@@ -163,6 +163,7 @@ static std::unordered_map<std::string, unsigned int> func_attrs = {
     {"Telemetry::__histogram_metric_get_or_add", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"Telemetry::__histogram_observe", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"Telemetry::__histogram_sum", ATTR_NO_SCRIPT_SIDE_EFFECTS},
+    {"Telemetry::__set_event_handler_sample_rate", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"WebSocket::__configure_analyzer", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"__init_primary_bifs", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"__init_secondary_bifs", ATTR_NO_SCRIPT_SIDE_EFFECTS},
@@ -454,6 +455,7 @@ static std::unordered_map<std::string, unsigned int> func_attrs = {
     {"syslog", ATTR_NO_ZEEK_SIDE_EFFECTS},
     {"system", ATTR_NO_SCRIPT_SIDE_EFFECTS},
     {"system_env", ATTR_NO_SCRIPT_SIDE_EFFECTS},
+    {"table_expire_stats", ATTR_NO_ZEEK_SIDE_EFFECTS},
     {"table_keys", ATTR_NO_ZEEK_SIDE_EFFECTS},
     {"table_pattern_matcher_stats", ATTR_NO_ZEEK_SIDE_EFFECTS},
     {"table_values", ATTR_NO_ZEEK_SIDE_EFFECTS},
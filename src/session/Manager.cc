@@ -9,6 +9,7 @@
 #include <pcap.h>
 #include <unistd.h>
 #include <cstdlib>
+#include <vector>
 
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
@@ -102,12 +103,7 @@ Connection* Manager::FindConnection(Val* v) {
 
 Connection* Manager::FindConnection(const zeek::detail::ConnKey& conn_key) {
     detail::Key key(&conn_key, sizeof(conn_key), detail::Key::CONNECTION_KEY_TYPE, false);
-
-    auto it = session_map.find(key);
-    if ( it != session_map.end() )
-        return static_cast<Connection*>(it->second);
-
-    return nullptr;
+    return static_cast<Connection*>(session_map.Lookup(key));
 }
 
 void Manager::Remove(Session* s) {
@@ -118,7 +114,7 @@ void Manager::Remove(Session* s) {
 
         detail::Key key = s->SessionKey(false);
 
-        if ( session_map.erase(key) == 0 )
+        if ( ! session_map.Remove(key) )
             reporter->InternalWarning("connection missing");
         else {
             Connection* c = static_cast<Connection*>(s);
@@ -137,17 +133,12 @@ void Manager::Remove(Session* s) {
 
 void Manager::Insert(Session* s, bool remove_existing) {
     Session* old = nullptr;
-    detail::Key key = s->SessionKey(true);
+    detail::Key key = s->SessionKey(false);
 
-    if ( remove_existing ) {
-        auto it = session_map.find(key);
-        if ( it != session_map.end() )
-            old = it->second;
-
-        session_map.erase(key);
-    }
+    if ( remove_existing )
+        old = session_map.Lookup(key);
 
-    InsertSession(std::move(key), s);
+    InsertSession(key, s);
 
     if ( old && old != s ) {
         // Some clean-ups similar to those in Remove() (but invisible
@@ -159,37 +150,38 @@ void Manager::Insert(Session* s, bool remove_existing) {
 }
 
 void Manager::Drain() {
+    // Neither Done() nor RemovalEvent() modify the table, so we can walk it
+    // in place.
+    if ( ! zeek::util::detail::have_random_seed() ) {
+        session_map.ForEach([](const detail::Key&, Session* s) {
+            s->Done();
+            s->RemovalEvent();
+        });
+
+        return;
+    }
+
     // If a random seed was passed in, we're most likely in testing mode and need the
     // order of the sessions to be consistent. Sort the keys to force that order
     // every run.
-    if ( zeek::util::detail::have_random_seed() ) {
-        std::vector<const detail::Key*> keys;
-        keys.reserve(session_map.size());
-
-        for ( auto& entry : session_map )
-            keys.push_back(&(entry.first));
-        std::sort(keys.begin(), keys.end(), [](const detail::Key* a, const detail::Key* b) { return *a < *b; });
-
-        for ( const auto* k : keys ) {
-            Session* tc = session_map.at(*k);
-            tc->Done();
-            tc->RemovalEvent();
-        }
-    }
-    else {
-        for ( const auto& entry : session_map ) {
-            Session* tc = entry.second;
-            tc->Done();
-            tc->RemovalEvent();
-        }
+    std::vector<std::pair<detail::Key, Session*>> entries;
+    entries.reserve(session_map.Size());
+
+    session_map.ForEach([&entries](const detail::Key& k, Session* s) {
+        entries.emplace_back(detail::Key{k.Data(), k.Size(), k.Type(), true}, s);
+    });
+
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for ( const auto& [k, tc] : entries ) {
+        tc->Done();
+        tc->RemovalEvent();
     }
 }
 
 void Manager::Clear() {
-    for ( const auto& entry : session_map )
-        Unref(entry.second);
-
-    session_map.clear();
+    session_map.ForEach([](const detail::Key&, Session* s) { Unref(s); });
+    session_map.Clear();
 
     zeek::detail::fragment_mgr->Clear();
 }
@@ -237,10 +229,9 @@ void Manager::Weird(const char* name, const IP_Hdr* ip, const char* addl) {
     reporter->Weird(ip->SrcAddr(), ip->DstAddr(), name, addl);
 }
 
-void Manager::InsertSession(detail::Key key, Session* session) {
+void Manager::InsertSession(const detail::Key& key, Session* session) {
     session->SetInSessionTable(true);
-    key.CopyData();
-    session_map.insert_or_assign(std::move(key), session);
+    session_map.Insert(key, session);
 
     std::string protocol = session->TransportIdentifier();
 
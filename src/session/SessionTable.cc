@@ -0,0 +1,343 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/SessionTable.h"
+
+#include <utility>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::session::detail {
+
+namespace {
+
+// A bitmask with one bit per control byte of a group.
+using GroupMask = uint32_t;
+
+// Helper for scanning a group of GROUP_SIZE control bytes.
+class Group {
+public:
+    explicit Group(const int8_t* pos) {
+#ifdef __SSE2__
+        ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(pos));
+#else
+        memcpy(ctrl, pos, SessionTable::GROUP_SIZE);
+#endif
+    }
+
+    // Returns the bytes equal to a given value.
+    GroupMask Match(int8_t c) const {
+#ifdef __SSE2__
+        return static_cast<GroupMask>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), ctrl)));
+#else
+        GroupMask m = 0;
+        for ( size_t i = 0; i < SessionTable::GROUP_SIZE; ++i )
+            if ( ctrl[i] == c )
+                m |= 1U << i;
+        return m;
+#endif
+    }
+
+    // Returns the empty and deleted bytes, i.e., all with the sign bit set.
+    GroupMask MatchEmptyOrDeleted() const {
+#ifdef __SSE2__
+        return static_cast<GroupMask>(_mm_movemask_epi8(ctrl));
+#else
+        GroupMask m = 0;
+        for ( size_t i = 0; i < SessionTable::GROUP_SIZE; ++i )
+            if ( ctrl[i] < 0 )
+                m |= 1U << i;
+        return m;
+#endif
+    }
+
+private:
+#ifdef __SSE2__
+    __m128i ctrl;
+#else
+    int8_t ctrl[SessionTable::GROUP_SIZE];
+#endif
+};
+
+inline int lowest_bit(GroupMask m) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(m);
+#else
+    int i = 0;
+    while ( ! (m & 1) ) {
+        m >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+} // namespace
+
+bool SessionTable::Slot::Matches(hash_t h, const Key& k) const {
+    return hash == h && size == k.Size() && type == k.Type() && memcmp(Data(), k.Data(), size) == 0;
+}
+
+void SessionTable::Slot::Assign(hash_t h, const Key& k, Session* s) {
+    hash = h;
+    session = s;
+    type = k.Type();
+    size = static_cast<uint32_t>(k.Size());
+
+    if ( size <= INLINE_KEY_SIZE )
+        memcpy(data.bytes, k.Data(), size);
+    else {
+        data.ptr = new uint8_t[size];
+        memcpy(data.ptr, k.Data(), size);
+    }
+}
+
+void SessionTable::Slot::Release() {
+    if ( size > INLINE_KEY_SIZE )
+        delete[] data.ptr;
+
+    size = 0;
+    session = nullptr;
+}
+
+SessionTable::~SessionTable() { Clear(); }
+
+void SessionTable::Clear() {
+    for ( size_t i = 0; i < capacity; ++i )
+        if ( IsFull(ctrl[i]) )
+            slots[i].Release();
+
+    ctrl_groups.reset();
+    ctrl = nullptr;
+    slots.reset();
+    capacity = num_groups = num_entries = growth_left = 0;
+}
+
+ptrdiff_t SessionTable::FindSlot(hash_t h, const Key& key) const {
+    if ( num_entries == 0 )
+        return -1;
+
+    // Probe groups in a triangular sequence, which visits every group
+    // exactly once as the number of groups is a power of two.
+    size_t g = FirstGroup(h);
+
+    for ( size_t i = 1; i <= num_groups; ++i ) {
+        const size_t base = g * GROUP_SIZE;
+        Group group(&ctrl[base]);
+
+        for ( GroupMask m = group.Match(H2(h)); m; m &= m - 1 ) {
+            size_t idx = base + lowest_bit(m);
+            if ( slots[idx].Matches(h, key) )
+                return static_cast<ptrdiff_t>(idx);
+        }
+
+        // An empty slot ends the probe sequence: an insert would have
+        // used it.
+        if ( group.Match(CTRL_EMPTY) )
+            return -1;
+
+        g = (g + i) & (num_groups - 1);
+    }
+
+    return -1;
+}
+
+size_t SessionTable::FindInsertSlot(hash_t h) const {
+    size_t g = FirstGroup(h);
+
+    for ( size_t i = 1;; ++i ) {
+        const size_t base = g * GROUP_SIZE;
+
+        if ( GroupMask m = Group(&ctrl[base]).MatchEmptyOrDeleted() )
+            return base + lowest_bit(m);
+
+        g = (g + i) & (num_groups - 1);
+    }
+}
+
+Session* SessionTable::Lookup(const Key& key) const {
+    ptrdiff_t idx = FindSlot(key.Hash(), key);
+    return idx >= 0 ? slots[idx].session : nullptr;
+}
+
+Session* SessionTable::Insert(const Key& key, Session* session) {
+    hash_t h = key.Hash();
+
+    if ( ptrdiff_t idx = FindSlot(h, key); idx >= 0 ) {
+        Session* old = slots[idx].session;
+        slots[idx].session = session;
+        return old;
+    }
+
+    if ( growth_left == 0 ) {
+        // Only grow if the table is actually filling up. Otherwise we got
+        // here because of tombstones, and rehashing at the same size
+        // clears them out.
+        size_t new_capacity = capacity == 0                    ? MIN_CAPACITY :
+                              num_entries * 2 >= capacity * 7 / 8 ? capacity * 2 :
+                                                                    capacity;
+        Rehash(new_capacity);
+    }
+
+    size_t idx = FindInsertSlot(h);
+
+    if ( ctrl[idx] == CTRL_EMPTY )
+        --growth_left;
+
+    ctrl[idx] = H2(h);
+    slots[idx].Assign(h, key, session);
+    ++num_entries;
+
+    return nullptr;
+}
+
+bool SessionTable::Remove(const Key& key) {
+    ptrdiff_t idx = FindSlot(key.Hash(), key);
+
+    if ( idx < 0 )
+        return false;
+
+    slots[idx].Release();
+    --num_entries;
+
+    // If the group still has an empty slot, no probe sequence ever
+    // continued past it, so the slot can become empty again. Otherwise
+    // we need a tombstone to keep later entries reachable.
+    const size_t base = (idx / GROUP_SIZE) * GROUP_SIZE;
+
+    if ( Group(&ctrl[base]).Match(CTRL_EMPTY) ) {
+        ctrl[idx] = CTRL_EMPTY;
+        ++growth_left;
+    }
+    else
+        ctrl[idx] = CTRL_DELETED;
+
+    return true;
+}
+
+void SessionTable::Rehash(size_t new_capacity) {
+    auto old_ctrl_groups = std::move(ctrl_groups);
+    auto old_slots = std::move(slots);
+    const int8_t* old_ctrl = ctrl;
+    size_t old_capacity = capacity;
+
+    num_groups = new_capacity / GROUP_SIZE;
+    ctrl_groups = std::make_unique<CtrlGroup[]>(num_groups);
+    ctrl = ctrl_groups[0].bytes;
+    slots = std::make_unique<Slot[]>(new_capacity);
+    memset(ctrl, CTRL_EMPTY, new_capacity);
+
+    capacity = new_capacity;
+    growth_left = new_capacity * 7 / 8 - num_entries;
+
+    for ( size_t i = 0; i < old_capacity; ++i ) {
+        if ( ! IsFull(old_ctrl[i]) )
+            continue;
+
+        // Slots are plain data, moving one just copies its bytes.
+        size_t idx = FindInsertSlot(old_slots[i].hash);
+        ctrl[idx] = H2(old_slots[i].hash);
+        slots[idx] = old_slots[i];
+    }
+}
+
+TEST_SUITE_BEGIN("SessionTable");
+
+TEST_CASE("session table insert lookup remove") {
+    SessionTable table;
+    auto* s1 = reinterpret_cast<Session*>(0x1000);
+    auto* s2 = reinterpret_cast<Session*>(0x2000);
+
+    uint64_t k1 = 1;
+    uint64_t k2 = 2;
+    Key key1(&k1, sizeof(k1), Key::CONNECTION_KEY_TYPE);
+    Key key2(&k2, sizeof(k2), Key::CONNECTION_KEY_TYPE);
+    Key key2_other_type(&k2, sizeof(k2), 1);
+
+    CHECK(table.Lookup(key1) == nullptr);
+    CHECK(table.Insert(key1, s1) == nullptr);
+    CHECK(table.Insert(key2, s2) == nullptr);
+    CHECK(table.Size() == 2);
+    CHECK(table.Lookup(key1) == s1);
+    CHECK(table.Lookup(key2) == s2);
+    CHECK(table.Lookup(key2_other_type) == nullptr);
+
+    // Replacing returns the previous session.
+    CHECK(table.Insert(key1, s2) == s1);
+    CHECK(table.Size() == 2);
+    CHECK(table.Lookup(key1) == s2);
+
+    CHECK(table.Remove(key1));
+    CHECK_FALSE(table.Remove(key1));
+    CHECK(table.Lookup(key1) == nullptr);
+    CHECK(table.Size() == 1);
+}
+
+TEST_CASE("session table growth and churn") {
+    SessionTable table;
+    constexpr uint64_t n = 10000;
+
+    for ( uint64_t i = 0; i < n; ++i ) {
+        Key key(&i, sizeof(i), Key::CONNECTION_KEY_TYPE);
+        table.Insert(key, reinterpret_cast<Session*>(i + 1));
+    }
+
+    CHECK(table.Size() == n);
+    CHECK(table.Capacity() >= n);
+
+    // Remove every other entry and insert new ones, which exercises
+    // tombstone handling.
+    for ( uint64_t i = 0; i < n; i += 2 ) {
+        Key key(&i, sizeof(i), Key::CONNECTION_KEY_TYPE);
+        CHECK(table.Remove(key));
+    }
+
+    for ( uint64_t i = n; i < 2 * n; i += 2 ) {
+        Key key(&i, sizeof(i), Key::CONNECTION_KEY_TYPE);
+        table.Insert(key, reinterpret_cast<Session*>(i + 1));
+    }
+
+    CHECK(table.Size() == n);
+
+    size_t found = 0;
+    for ( uint64_t i = 0; i < 2 * n; ++i ) {
+        Key key(&i, sizeof(i), Key::CONNECTION_KEY_TYPE);
+        Session* s = table.Lookup(key);
+        bool expected = (i < n) ? (i % 2 == 1) : (i % 2 == 0);
+        CHECK((s != nullptr) == expected);
+        if ( s ) {
+            CHECK(s == reinterpret_cast<Session*>(i + 1));
+            ++found;
+        }
+    }
+
+    CHECK(found == n);
+
+    size_t visited = 0;
+    table.ForEach([&visited](const Key&, Session*) { ++visited; });
+    CHECK(visited == n);
+}
+
+TEST_CASE("session table large keys") {
+    SessionTable table;
+    uint8_t big1[SessionTable::INLINE_KEY_SIZE + 16] = {1};
+    uint8_t big2[SessionTable::INLINE_KEY_SIZE + 16] = {2};
+    Key keys[] = {Key(big1, sizeof(big1), 7), Key(big2, sizeof(big2), 7)};
+    auto* s1 = reinterpret_cast<Session*>(0x1000);
+
+    table.Insert(keys[0], s1);
+
+    CHECK(table.Lookup(keys[0]) == s1);
+    CHECK(table.Lookup(keys[1]) == nullptr);
+
+    CHECK(table.Remove(keys[0]));
+    CHECK(table.Size() == 0);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::session::detail
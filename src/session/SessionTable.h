@@ -0,0 +1,153 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "zeek/Hash.h"
+#include "zeek/session/Key.h"
+
+namespace zeek::session {
+
+class Session;
+
+namespace detail {
+
+/**
+ * Flat, open-addressing hash table mapping session keys to sessions.
+ *
+ * The table keeps a separate array of one-byte control entries next to its
+ * slots. A control byte either marks its slot as empty or deleted, or holds
+ * seven bits of the slot's hash. Lookups scan a group of 16 control bytes at
+ * once (using SSE2 where available) and only touch slots whose hash bits
+ * match. Keys up to INLINE_KEY_SIZE bytes, which includes connection keys,
+ * are stored inside the slot itself, so inserting a session doesn't
+ * allocate anything beyond the occasional growth of the table.
+ */
+class SessionTable {
+public:
+    /**
+     * Key data up to this size is stored inline within the table.
+     */
+    static constexpr size_t INLINE_KEY_SIZE = 48;
+
+    /**
+     * Number of control bytes probed at once.
+     */
+    static constexpr size_t GROUP_SIZE = 16;
+
+    SessionTable() = default;
+    ~SessionTable();
+
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    /**
+     * Returns the session stored under a key, or null if none.
+     */
+    Session* Lookup(const Key& key) const;
+
+    /**
+     * Stores a session under a key, replacing any existing entry. The key
+     * data is copied into the table.
+     *
+     * @return The session previously stored under the key, or null.
+     */
+    Session* Insert(const Key& key, Session* session);
+
+    /**
+     * Removes the entry for a key.
+     *
+     * @return True if an entry was removed.
+     */
+    bool Remove(const Key& key);
+
+    /**
+     * Removes all entries and releases the table's memory.
+     */
+    void Clear();
+
+    /**
+     * Returns the number of entries.
+     */
+    size_t Size() const { return num_entries; }
+
+    /**
+     * Returns the number of slots currently allocated.
+     */
+    size_t Capacity() const { return capacity; }
+
+    /**
+     * Calls a function for every entry, passing the entry's key and
+     * session. The function must not modify the table.
+     */
+    template<typename F>
+    void ForEach(F f) const {
+        for ( size_t i = 0; i < capacity; ++i )
+            if ( IsFull(ctrl[i]) )
+                f(slots[i].GetKey(), slots[i].session);
+    }
+
+private:
+    using hash_t = zeek::detail::hash_t;
+
+    struct Slot {
+        hash_t hash;
+        Session* session;
+        size_t type;
+        uint32_t size;
+
+        union {
+            uint8_t bytes[INLINE_KEY_SIZE];
+            uint8_t* ptr;
+        } data;
+
+        const uint8_t* Data() const { return size <= INLINE_KEY_SIZE ? data.bytes : data.ptr; }
+        Key GetKey() const { return Key{Data(), size, type, false}; }
+        bool Matches(hash_t h, const Key& k) const;
+        void Assign(hash_t h, const Key& k, Session* s);
+        void Release();
+    };
+
+    // Control byte values. Full slots use the low seven bits of their
+    // hash, so all special values have the sign bit set.
+    static constexpr int8_t CTRL_EMPTY = -128;
+    static constexpr int8_t CTRL_DELETED = -2;
+
+    static constexpr size_t MIN_CAPACITY = GROUP_SIZE;
+
+    static bool IsFull(int8_t c) { return c >= 0; }
+    static int8_t H2(hash_t h) { return static_cast<int8_t>(h & 0x7f); }
+    size_t FirstGroup(hash_t h) const { return (h >> 7) & (num_groups - 1); }
+
+    // Returns the slot index holding a key, or -1 if not found.
+    ptrdiff_t FindSlot(hash_t h, const Key& key) const;
+
+    // Returns the index of the first empty or deleted slot on the probe
+    // sequence of a hash. The table must have room.
+    size_t FindInsertSlot(hash_t h) const;
+
+    // Reallocates the table with a new capacity, dropping tombstones.
+    void Rehash(size_t new_capacity);
+
+    // Control bytes get loaded with aligned SSE2 loads, so we allocate
+    // them in aligned groups. ctrl points to the first byte.
+    struct alignas(GROUP_SIZE) CtrlGroup {
+        int8_t bytes[GROUP_SIZE];
+    };
+
+    std::unique_ptr<CtrlGroup[]> ctrl_groups;
+    int8_t* ctrl = nullptr;
+    std::unique_ptr<Slot[]> slots;
+    size_t capacity = 0;
+    size_t num_groups = 0;
+    size_t num_entries = 0;
+    // Number of empty slots we can still fill before the load factor
+    // requires a rehash.
+    size_t growth_left = 0;
+};
+
+} // namespace detail
+} // namespace zeek::session
@@ -1,11 +1,12 @@
 #pragma once
 
 #include <sys/time.h>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <mutex>
-#include <queue>
+#include <vector>
 
 #include "zeek/Reporter.h"
 #include "zeek/threading/BasicThread.h"
@@ -17,13 +18,17 @@ namespace zeek::threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation is a lock-free ring buffer of fixed capacity. Reader
+ * and writer each own one of the ring's indices and only read the other
+ * side's index when they would otherwise consider the ring empty or full.
+ * If the ring fills up, further elements spill over into a mutex-protected
+ * overflow list until the reader has caught up, so that Put() never blocks.
+ * The mutex is also used for waking up a reader waiting for input, which
+ * the writer does only if the reader actually went to sleep on an empty
+ * queue.
  *
- * All Queue instances must be instantiated by Zeek's main thread.
- *
- * TODO: Unclear how critical performance is for this queue. We could likely
- * optimize it further if helpful.
+ * Only one thread may call Put() and only one other thread Get(). All Queue
+ * instances must be instantiated by Zeek's main thread.
  */
 template<typename T>
 class Queue {
@@ -34,8 +39,11 @@ public:
      * reader, writer: The corresponding threads. This is for checking
      * whether they have terminated so that we can abort I/O operations.
      * Can be left null for the main thread.
+     *
+     * capacity: The number of elements the ring buffer holds before
+     * spilling into the overflow list. Rounded up to a power of two.
      */
-    Queue(BasicThread* arg_reader, BasicThread* arg_writer);
+    Queue(BasicThread* arg_reader, BasicThread* arg_writer, size_t capacity = DEFAULT_CAPACITY);
 
     /**
      * Destructor.
@@ -55,20 +63,17 @@ public:
     void Put(T data);
 
     /**
-     * Returns true if the next Get() operation will succeed.
+     * Returns true if the next Get() operation will succeed. Must only be
+     * called by the reader.
      */
     bool Ready();
 
     /**
-     * Returns true if the next Get() operation might succeed. This
-     * function may occasionally return a value not indicating the actual
-     * state, but won't do so very often. Note that this means that it can
-     * consistently return false even if there is something in the Queue.
-     * You have to check real queue status from time to time to be sure that
-     * it is empty. In other words, this method helps to avoid locking the queue
-     * frequently, but doesn't allow you to forgo it completely.
+     * Returns true if the next Get() operation might succeed. This used to
+     * be a cheaper, inexact version of Ready(). As Ready() no longer needs
+     * to lock the queue, the two are now the same.
      */
-    bool MaybeReady() { return (num_reads != num_writes); }
+    bool MaybeReady() { return Ready(); }
 
     /**
      * Wake up the reader if it's currently blocked for input. This is
@@ -87,6 +92,7 @@ public:
     struct Stats {
         uint64_t num_reads;  //! Number of messages read from the queue.
         uint64_t num_writes; //! Number of messages written to the queue.
+        uint64_t num_full;   //! Number of writes that found the ring buffer full.
     };
 
     /**
@@ -98,23 +104,44 @@ public:
     void GetStats(Stats* stats);
 
 private:
-    static const int NUM_QUEUES = 8;
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+    // Keeps the indices of reader and writer on separate cache lines.
+    static constexpr size_t CACHE_LINE_SIZE = 64;
 
-    std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+    // Takes the next element out of the ring, if any. Reader only.
+    bool PopRing(T* data);
 
-    std::mutex mutex[NUM_QUEUES];                 // Mutex protected shared accesses.
-    std::condition_variable has_data[NUM_QUEUES]; // Signals when data becomes available
-    std::queue<T> messages[NUM_QUEUES];           // Actually holds the queued messages
+    // Takes the next element out of the ring or the overflow list, if any.
+    // Reader only.
+    bool TryGet(T* data);
 
-    int read_ptr;  // Where the next operation will read from
-    int write_ptr; // Where the next operation will write to
+    bool HaveData() const;
+
+    std::vector<T> ring;
+    uint64_t mask;
 
     BasicThread* reader;
     BasicThread* writer;
 
-    // Statistics.
-    uint64_t num_reads;
-    uint64_t num_writes;
+    // Owned by the writer.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail{0};
+    uint64_t cached_head = 0; // Last value of head the writer has seen.
+    std::atomic<uint64_t> num_writes{0};
+    std::atomic<uint64_t> num_full{0};
+
+    // Owned by the reader.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head{0};
+    uint64_t cached_tail = 0; // Last value of tail the reader has seen.
+    std::atomic<uint64_t> num_reads{0};
+
+    // Shared, but only touched when the ring is full or the reader is
+    // going to sleep.
+    alignas(CACHE_LINE_SIZE) std::mutex mutex;
+    std::condition_variable has_data; // Signals when data becomes available
+    std::deque<T> overflow;           // Elements that didn't fit into the ring
+    std::atomic<bool> overflowing{false};
+    std::atomic<bool> reader_waiting{false};
 };
 
 inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m) {
@@ -128,10 +155,13 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m) {
 }
 
 template<typename T>
-inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer) {
-    read_ptr = 0;
-    write_ptr = 0;
-    num_reads = num_writes = 0;
+inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer, size_t capacity) {
+    size_t size = 1;
+    while ( size < capacity )
+        size <<= 1;
+
+    ring.resize(size);
+    mask = size - 1;
     reader = arg_reader;
     writer = arg_writer;
 }
@@ -140,103 +170,144 @@ template<typename T>
 inline Queue<T>::~Queue() {}
 
 template<typename T>
-inline T Queue<T>::Get() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+inline bool Queue<T>::PopRing(T* data) {
+    uint64_t h = head.load(std::memory_order_relaxed);
 
-    int old_read_ptr = read_ptr;
+    if ( h == cached_tail ) {
+        cached_tail = tail.load(std::memory_order_acquire);
 
-    if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) ) {
-        if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-            return nullptr;
+        if ( h == cached_tail )
+            return false;
     }
 
-    if ( messages[read_ptr].empty() )
-        return nullptr;
+    *data = std::move(ring[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline bool Queue<T>::TryGet(T* data) {
+    if ( ! PopRing(data) ) {
+        if ( ! overflowing.load(std::memory_order_acquire) )
+            return false;
 
-    T data = messages[read_ptr].front();
-    messages[read_ptr].pop();
+        auto lock = acquire_lock(mutex);
 
-    read_ptr = (read_ptr + 1) % NUM_QUEUES;
-    ++num_reads;
+        // While the overflow list is in use, the writer doesn't touch the
+        // ring, so anything still in there is older than the overflow.
+        if ( ! PopRing(data) ) {
+            if ( overflow.empty() )
+                return false;
 
-    return data;
+            *data = std::move(overflow.front());
+            overflow.pop_front();
+
+            if ( overflow.empty() )
+                overflowing.store(false, std::memory_order_release);
+        }
+    }
+
+    num_reads.store(num_reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
 }
 
 template<typename T>
-inline void Queue<T>::Put(T data) {
-    auto lock = acquire_lock(mutex[write_ptr]);
+inline bool Queue<T>::HaveData() const {
+    return head.load(std::memory_order_relaxed) != tail.load(std::memory_order_acquire) ||
+           overflowing.load(std::memory_order_acquire);
+}
 
-    int old_write_ptr = write_ptr;
+template<typename T>
+inline T Queue<T>::Get() {
+    T data;
 
-    bool need_signal = messages[write_ptr].empty();
+    if ( TryGet(&data) )
+        return data;
 
-    messages[write_ptr].push(data);
+    if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
+        return nullptr;
 
-    write_ptr = (write_ptr + 1) % NUM_QUEUES;
-    ++num_writes;
+    {
+        auto lock = acquire_lock(mutex);
+        reader_waiting.store(true, std::memory_order_relaxed);
 
-    if ( need_signal ) {
-        lock.unlock();
-        has_data[old_write_ptr].notify_one();
-    }
-}
+        // Pairs with the fence in Put(): either the writer sees that
+        // we're waiting, or we see its data.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-template<typename T>
-inline bool Queue<T>::Ready() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+        if ( ! HaveData() )
+            has_data.wait_for(lock, std::chrono::seconds(5));
+
+        reader_waiting.store(false, std::memory_order_relaxed);
+    }
 
-    bool ret = (messages[read_ptr].size());
+    if ( TryGet(&data) )
+        return data;
 
-    return ret;
+    return nullptr;
 }
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues() {
-    std::vector<std::unique_lock<std::mutex>> locks;
+inline void Queue<T>::Put(T data) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    bool queued = false;
+
+    // Once we're spilling into the overflow list, we keep doing so until
+    // the reader has drained it to preserve ordering.
+    if ( ! overflowing.load(std::memory_order_relaxed) ) {
+        if ( t - cached_head > mask )
+            cached_head = head.load(std::memory_order_acquire);
+
+        if ( t - cached_head <= mask ) {
+            ring[t & mask] = std::move(data);
+            tail.store(t + 1, std::memory_order_release);
+            queued = true;
+        }
+    }
 
-    try {
-        for ( int i = 0; i < NUM_QUEUES; i++ )
-            locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
+    if ( ! queued ) {
+        auto lock = acquire_lock(mutex);
+        overflow.push_back(std::move(data));
+        overflowing.store(true, std::memory_order_release);
+        num_full.store(num_full.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
 
-    catch ( const std::system_error& e ) {
-        reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-        // Never gets here.
-        throw std::exception();
+    num_writes.store(num_writes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if ( reader_waiting.load(std::memory_order_relaxed) ) {
+        auto lock = acquire_lock(mutex);
+        has_data.notify_one();
     }
+}
 
-    return locks;
+template<typename T>
+inline bool Queue<T>::Ready() {
+    return HaveData();
 }
 
 template<typename T>
 inline uint64_t Queue<T>::Size() {
-    // Need to lock all queues.
-    auto locks = LocksForAllQueues();
+    auto lock = acquire_lock(mutex);
 
-    uint64_t size = 0;
-
-    for ( int i = 0; i < NUM_QUEUES; i++ )
-        size += messages[i].size();
-
-    return size;
+    // Load head first, it can't move past the tail.
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    return t - h + overflow.size();
 }
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats) {
-    // To be safe, we look all queues. That's probably unnecessary, but
-    // doesn't really hurt.
-    auto locks = LocksForAllQueues();
-
-    stats->num_reads = num_reads;
-    stats->num_writes = num_writes;
+    stats->num_reads = num_reads.load(std::memory_order_relaxed);
+    stats->num_writes = num_writes.load(std::memory_order_relaxed);
+    stats->num_full = num_full.load(std::memory_order_relaxed);
 }
 
 template<typename T>
 inline void Queue<T>::WakeUp() {
-    for ( int i = 0; i < NUM_QUEUES; i++ ) {
-        auto lock = acquire_lock(mutex[i]);
-        has_data[i].notify_all();
-    }
+    auto lock = acquire_lock(mutex);
+    has_data.notify_all();
 }
 
 } // namespace zeek::threading
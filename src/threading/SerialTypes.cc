@@ -122,6 +122,7 @@ Value::Value(const Value& other) {
 
 Value::Value(Value&& other) noexcept {
     present = other.present;
+    borrowed = other.borrowed;
     type = other.type;
     subtype = other.type;
     line_number = other.line_number;
@@ -131,10 +132,11 @@ Value::Value(Value&& other) noexcept {
     other.val = _val();
     other.line_number = -1;
     other.present = false;
+    other.borrowed = false;
 }
 
 Value::~Value() {
-    if ( ! present )
+    if ( ! present || borrowed )
         return;
 
     if ( type == TYPE_ENUM || type == TYPE_STRING || type == TYPE_FILE || type == TYPE_FUNC )
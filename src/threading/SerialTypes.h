@@ -104,9 +104,10 @@ private:
  * those Vals supported).
  */
 struct Value {
-    TypeTag type;         //! The type of the value.
-    TypeTag subtype;      //! Inner type for sets and vectors.
-    bool present = false; //! False for optional record fields that are not set.
+    TypeTag type;          //! The type of the value.
+    TypeTag subtype;       //! Inner type for sets and vectors.
+    bool present = false;  //! False for optional record fields that are not set.
+    bool borrowed = false; //! True if the value doesn't own its string, set, or vector data.
 
     struct set_t {
         zeek_int_t size;
@@ -0,0 +1,108 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/TaskPool.h"
+
+#include "zeek/zeek-config.h"
+
+#include <pthread.h>
+#include <atomic>
+#include <csignal>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::threading {
+
+TaskPool::TaskPool(size_t num_threads) {
+    if ( num_threads == 0 )
+        num_threads = 1;
+
+    workers.reserve(num_threads);
+
+    for ( size_t i = 0; i < num_threads; ++i )
+        workers.emplace_back(&TaskPool::Run, this);
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    has_tasks.notify_all();
+
+    for ( auto& w : workers )
+        w.join();
+}
+
+void TaskPool::Submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+
+    has_tasks.notify_one();
+}
+
+TaskPool* TaskPool::Shared(size_t num_threads) {
+    // Initialization of function-level statics is thread-safe.
+    static TaskPool pool(num_threads);
+    return &pool;
+}
+
+void TaskPool::Run() {
+#ifndef _MSC_VER
+    // Same as BasicThread: signals are for the main thread, except for
+    // those where blocking them leads to undefined behavior.
+    sigset_t mask_set;
+    sigfillset(&mask_set);
+    sigdelset(&mask_set, SIGFPE);
+    sigdelset(&mask_set, SIGILL);
+    sigdelset(&mask_set, SIGSEGV);
+    sigdelset(&mask_set, SIGBUS);
+    pthread_sigmask(SIG_BLOCK, &mask_set, nullptr);
+#endif
+
+    while ( true ) {
+        Task task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            has_tasks.wait(lock, [this] { return stopping || ! tasks.empty(); });
+
+            if ( tasks.empty() )
+                return; // stopping
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+TEST_SUITE_BEGIN("TaskPool");
+
+TEST_CASE("task pool runs all tasks") {
+    std::atomic<int> sum{0};
+
+    {
+        TaskPool pool(3);
+        CHECK(pool.NumThreads() == 3);
+
+        for ( int i = 1; i <= 1000; ++i )
+            pool.Submit([&sum, i] { sum += i; });
+
+        // The destructor waits for pending tasks.
+    }
+
+    CHECK(sum == 500500);
+}
+
+TEST_CASE("task pool with zero threads") {
+    TaskPool pool(0);
+    CHECK(pool.NumThreads() == 1);
+}
+
+TEST_SUITE_END();
+
+} // namespace zeek::threading
@@ -0,0 +1,74 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zeek::threading {
+
+/**
+ * A small pool of worker threads running independent, CPU-bound tasks on
+ * behalf of other threads, such as compressing blocks of log output.
+ *
+ * Unlike BasicThread, the pool's threads aren't known to the threading
+ * manager and don't exchange messages with the main thread. Tasks must not
+ * touch any of Zeek's state besides the data handed to them, and must
+ * report results through that data. Like other threads, the workers block
+ * signals.
+ *
+ * Tasks may be submitted from any thread.
+ */
+class TaskPool {
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * Constructor. Starts the worker threads right away.
+     *
+     * @param num_threads The number of worker threads, at least one.
+     */
+    explicit TaskPool(size_t num_threads);
+
+    /**
+     * Destructor. Runs all tasks still pending, then joins the workers.
+     */
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * Queues a task for execution by the next idle worker. Tasks start in
+     * the order they're submitted, but may complete in any order.
+     */
+    void Submit(Task task);
+
+    /**
+     * Returns the number of worker threads.
+     */
+    size_t NumThreads() const { return workers.size(); }
+
+    /**
+     * Returns a process-wide pool, creating it on first use with the given
+     * number of threads. Later calls return the same pool, regardless of
+     * the argument.
+     */
+    static TaskPool* Shared(size_t num_threads);
+
+private:
+    void Run();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable has_tasks;
+    std::deque<Task> tasks;
+    bool stopping = false;
+};
+
+} // namespace zeek::threading
@@ -8,36 +8,211 @@
 #define __STDC_LIMIT_MACROS
 #endif
 
-#define RAPIDJSON_HAS_STDSTRING 1
-
-#include <rapidjson/internal/ieee754.h>
+#include <rapidjson/internal/dtoa.h>
+#include <rapidjson/internal/itoa.h>
+#include <algorithm>
 #include <cerrno>
 #include <cmath>
 #include <cstdint>
-#include <sstream>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/3rdparty/zeek_inet_ntop.h"
 #include "zeek/Desc.h"
 #include "zeek/threading/MsgThread.h"
-#include "zeek/threading/formatters/detail/json.h"
+
+extern "C" {
+#include "zeek/3rdparty/modp_numtoa.h"
+}
 
 namespace zeek::threading::formatter {
 
+namespace {
+
+// True for bytes that go into JSON strings unchanged: printable ASCII
+// other than quotes and backslashes.
+inline bool is_plain(unsigned char c) { return c >= 0x20 && c < 0x7f && c != '"' && c != '\\'; }
+
+// Returns the length of the leading run of plain bytes.
+size_t plain_prefix_length(const char* s, size_t len) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // Signed comparison catches both control characters and bytes with the
+    // high bit set.
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    for ( ; i + 16 <= len; i += 16 ) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+
+        if ( int mask = _mm_movemask_epi8(special) )
+            return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for ( ; i < len; ++i )
+        if ( ! is_plain(s[i]) )
+            return i;
+
+    return len;
+}
+
+// Appends s with the escaping that rapidjson's writer applies. Unless
+// sanitized is set, stops at the first byte that json_escape_utf8() might
+// change and returns its offset. Otherwise returns len.
+size_t append_escaped(std::string& out, const char* s, size_t len, bool sanitized) {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    size_t i = 0;
+
+    while ( true ) {
+        size_t n = plain_prefix_length(s + i, len - i);
+        out.append(s + i, n);
+        i += n;
+
+        if ( i == len )
+            return len;
+
+        auto c = static_cast<unsigned char>(s[i]);
+
+        switch ( c ) {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+
+            default:
+                if ( ! sanitized )
+                    return i;
+
+                if ( c < 0x20 ) {
+                    char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                    out.append(u, sizeof(u));
+                }
+                else
+                    out.push_back(static_cast<char>(c));
+
+                break;
+        }
+
+        ++i;
+    }
+}
+
+// Appends a string value, quoted and escaped like the formatter always did:
+// json_escape_utf8() first, then the JSON escaping.
+void append_string(std::string& out, const char* s, size_t len) {
+    out.push_back('"');
+
+    size_t i = append_escaped(out, s, len, false);
+
+    if ( i < len ) {
+        // Only bytes that json_escape_utf8() leaves alone precede i, so it's
+        // fine to sanitize just the remainder.
+        auto rest = util::json_escape_utf8(s + i, len - i);
+        append_escaped(out, rest.data(), rest.size(), true);
+    }
+
+    out.push_back('"');
+}
+
+void append_uint(std::string& out, uint64_t u) {
+    char buf[24];
+    char* end = rapidjson::internal::u64toa(u, buf);
+    out.append(buf, end - buf);
+}
+
+void append_int(std::string& out, int64_t i) {
+    char buf[24];
+    char* end = rapidjson::internal::i64toa(i, buf);
+    out.append(buf, end - buf);
+}
+
+void append_double(std::string& out, double d) {
+    if ( ! std::isfinite(d) ) {
+        out.append("null", 4);
+        return;
+    }
+
+    char buf[32];
+    char* end = rapidjson::internal::dtoa(d, buf);
+    out.append(buf, end - buf);
+}
+
+// Appends an address without quotes. Renderings of addresses never need
+// escaping.
+void append_addr(std::string& out, const threading::Value::addr_t& addr) {
+    char s[INET6_ADDRSTRLEN];
+
+    if ( addr.family == IPv4 ) {
+        if ( zeek_inet_ntop(AF_INET, &addr.in.in4, s, INET_ADDRSTRLEN) )
+            out.append(s);
+        else
+            out.append("<bad IPv4 address conversion>");
+    }
+    else {
+        if ( zeek_inet_ntop(AF_INET6, &addr.in.in6, s, INET6_ADDRSTRLEN) )
+            out.append(s);
+        else
+            out.append("<bad IPv6 address conversion>");
+    }
+}
+
+} // namespace
+
 JSON::JSON(MsgThread* t, TimeFormat tf, bool arg_include_unset_fields)
     : Formatter(t), timestamps(tf), include_unset_fields(arg_include_unset_fields) {}
 
+void JSON::UpdateKeys(int num_fields, const Field* const* fields) const {
+    if ( key_fields.size() == static_cast<size_t>(num_fields) &&
+         std::equal(key_fields.begin(), key_fields.end(), fields) )
+        return;
+
+    key_fields.assign(fields, fields + num_fields);
+    keys.clear();
+    keys.reserve(num_fields);
+
+    for ( int i = 0; i < num_fields; i++ ) {
+        std::string key = ",\"";
+        append_escaped(key, fields[i]->name, strlen(fields[i]->name), true);
+        key += "\":";
+        keys.push_back(std::move(key));
+    }
+}
+
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const {
-    rapidjson::StringBuffer buffer;
-    zeek::json::detail::NullDoubleWriter writer(buffer);
+    UpdateKeys(num_fields, fields);
+
+    buffer.clear();
+    buffer.push_back('{');
 
-    writer.StartObject();
+    bool first = true;
 
     for ( int i = 0; i < num_fields; i++ ) {
-        if ( vals[i]->present || include_unset_fields )
-            BuildJSON(writer, vals[i], fields[i]->name);
+        if ( ! vals[i]->present && ! include_unset_fields )
+            continue;
+
+        // Skip the comma in front of the first key.
+        const std::string& key = keys[i];
+        buffer.append(key, first ? 1 : 0);
+        first = false;
+
+        BuildJSON(buffer, vals[i]);
     }
 
-    writer.EndObject();
-    desc->Add(buffer.GetString());
+    buffer.push_back('}');
+    desc->AddN(buffer.data(), buffer.size());
 
     return true;
 }
@@ -51,15 +226,13 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const {
     if ( (! val->present && ! include_unset_fields) || name.empty() )
         return true;
 
-    rapidjson::Document doc;
-    rapidjson::StringBuffer buffer;
-    zeek::json::detail::NullDoubleWriter writer(buffer);
+    buffer.assign("{\"");
+    append_escaped(buffer, name.data(), name.size(), true);
+    buffer.append("\":");
+    BuildJSON(buffer, val);
+    buffer.push_back('}');
 
-    writer.StartObject();
-    BuildJSON(writer, val, name);
-    writer.EndObject();
-
-    desc->Add(buffer.GetString());
+    desc->AddN(buffer.data(), buffer.size());
     return true;
 }
 
@@ -68,30 +241,51 @@ Value* JSON::ParseValue(const std::string& s, const std::string& name, TypeTag t
     return nullptr;
 }
 
-void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, const std::string& name) const {
-    if ( ! name.empty() )
-        writer.Key(name);
-
+void JSON::BuildJSON(std::string& out, Value* val) const {
     if ( ! val->present ) {
-        writer.Null();
+        out.append("null", 4);
         return;
     }
 
     switch ( val->type ) {
-        case TYPE_BOOL: writer.Bool(val->val.int_val != 0); break;
+        case TYPE_BOOL:
+            if ( val->val.int_val != 0 )
+                out.append("true", 4);
+            else
+                out.append("false", 5);
+            break;
 
-        case TYPE_INT: writer.Int64(val->val.int_val); break;
+        case TYPE_INT: append_int(out, val->val.int_val); break;
 
-        case TYPE_COUNT: writer.Uint64(val->val.uint_val); break;
+        case TYPE_COUNT: append_uint(out, val->val.uint_val); break;
 
-        case TYPE_PORT: writer.Uint64(val->val.port_val.port); break;
+        case TYPE_PORT: append_uint(out, val->val.port_val.port); break;
 
-        case TYPE_SUBNET: writer.String(Formatter::Render(val->val.subnet_val)); break;
+        case TYPE_SUBNET: {
+            const auto& subnet = val->val.subnet_val;
+            char l[16];
 
-        case TYPE_ADDR: writer.String(Formatter::Render(val->val.addr_val)); break;
+            if ( subnet.prefix.family == IPv4 )
+                modp_uitoa10(subnet.length - 96, l);
+            else
+                modp_uitoa10(subnet.length, l);
+
+            out.push_back('"');
+            append_addr(out, subnet.prefix);
+            out.push_back('/');
+            out.append(l);
+            out.push_back('"');
+            break;
+        }
+
+        case TYPE_ADDR:
+            out.push_back('"');
+            append_addr(out, val->val.addr_val);
+            out.push_back('"');
+            break;
 
         case TYPE_DOUBLE:
-        case TYPE_INTERVAL: writer.Double(val->val.double_val); break;
+        case TYPE_INTERVAL: append_double(out, val->val.double_val); break;
 
         case TYPE_TIME: {
             if ( timestamps == TS_ISO8601 ) {
@@ -105,7 +299,7 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
                         GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
                     // This was a failure, doesn't really matter what gets put here
                     // but it should probably stand out...
-                    writer.String("2000-01-01T00:00:00.000000");
+                    out.append("\"2000-01-01T00:00:00.000000\"");
                 }
                 else {
                     double integ;
@@ -114,17 +308,20 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
                     if ( frac < 0 )
                         frac += 1;
 
+                    // No escaping needed, it's all digits and punctuation.
                     snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-                    writer.String(buffer2, strlen(buffer2));
+                    out.push_back('"');
+                    out.append(buffer2);
+                    out.push_back('"');
                 }
             }
 
             else if ( timestamps == TS_EPOCH )
-                writer.Double(val->val.double_val);
+                append_double(out, val->val.double_val);
 
             else if ( timestamps == TS_MILLIS ) {
                 // ElasticSearch uses milliseconds for timestamps
-                writer.Uint64((uint64_t)(val->val.double_val * 1000));
+                append_uint(out, (uint64_t)(val->val.double_val * 1000));
             }
 
             break;
@@ -134,27 +331,35 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
         case TYPE_STRING:
         case TYPE_FILE:
         case TYPE_FUNC: {
-            writer.String(util::json_escape_utf8(std::string(val->val.string_val.data, val->val.string_val.length)));
+            append_string(out, val->val.string_val.data, val->val.string_val.length);
             break;
         }
 
         case TYPE_TABLE: {
-            writer.StartArray();
+            out.push_back('[');
 
-            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
-                BuildJSON(writer, val->val.set_val.vals[idx]);
+            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ ) {
+                if ( idx > 0 )
+                    out.push_back(',');
+
+                BuildJSON(out, val->val.set_val.vals[idx]);
+            }
 
-            writer.EndArray();
+            out.push_back(']');
             break;
         }
 
         case TYPE_VECTOR: {
-            writer.StartArray();
+            out.push_back('[');
 
-            for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
-                BuildJSON(writer, val->val.vector_val.vals[idx]);
+            for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ ) {
+                if ( idx > 0 )
+                    out.push_back(',');
 
-            writer.EndArray();
+                BuildJSON(out, val->val.vector_val.vals[idx]);
+            }
+
+            out.push_back(']');
             break;
         }
 
@@ -162,4 +367,67 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
     }
 }
 
+TEST_SUITE_BEGIN("JSON formatter");
+
+TEST_CASE("json formatter plain_prefix_length") {
+    CHECK(plain_prefix_length("", 0) == 0);
+    CHECK(plain_prefix_length("abc", 3) == 3);
+    CHECK(plain_prefix_length("abc\"", 4) == 3);
+
+    // Cross the 16-byte boundary of the vectorized scan.
+    std::string s(40, 'x');
+    CHECK(plain_prefix_length(s.data(), s.size()) == 40);
+
+    for ( size_t pos : {0, 15, 16, 17, 31, 39} ) {
+        for ( char c : {'\\', '"', '\n', '\x7f', '\x80', '\xff', '\0'} ) {
+            std::string t = s;
+            t[pos] = c;
+            CHECK(plain_prefix_length(t.data(), t.size()) == pos);
+        }
+    }
+}
+
+TEST_CASE("json formatter append_string") {
+    auto escape = [](const std::string& s) {
+        std::string out;
+        append_string(out, s.data(), s.size());
+        return out;
+    };
+
+    CHECK(escape("") == "\"\"");
+    CHECK(escape("string") == "\"string\"");
+    CHECK(escape("a \"quoted\" \\path") == "\"a \\\"quoted\\\" \\\\path\"");
+    CHECK(escape("line\nbreak\ttab") == "\"line\\nbreak\\ttab\"");
+
+    // Valid UTF-8 passes through.
+    CHECK(escape("\"\xc3\xb1\"") == "\"\\\"\xc3\xb1\\\"\"");
+
+    // Invalid UTF-8 gets escaped by json_escape_utf8(), and its backslashes
+    // again for JSON. That includes valid sequences preceding invalid ones.
+    CHECK(escape("a\x82") == "\"a\\\\x82\"");
+    CHECK(escape("\"\xc3\xb1\xc0\x81") == "\"\\\"\\\\xc3\\\\xb1\\\\xc0\\\\x81\"");
+    CHECK(escape(std::string("\x00\x01", 2)) == "\"\\\\x00\\\\x01\"");
+    CHECK(escape("\x7f") == "\"\\\\x7f\"");
+}
+
+TEST_CASE("json formatter numbers") {
+    std::string out;
+
+    append_int(out, -42);
+    out.push_back(' ');
+    append_uint(out, UINT64_MAX);
+    out.push_back(' ');
+    append_double(out, 3.14);
+    out.push_back(' ');
+    append_double(out, 100.0);
+    out.push_back(' ');
+    append_double(out, NAN);
+    out.push_back(' ');
+    append_double(out, -INFINITY);
+
+    CHECK(out == "-42 18446744073709551615 3.14 100.0 null null");
+}
+
+TEST_SUITE_END();
+
 } // namespace zeek::threading::formatter
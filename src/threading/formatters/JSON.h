@@ -2,19 +2,21 @@
 
 #pragma once
 
-#include <memory>
+#include <string>
+#include <vector>
 
 #include "zeek/threading/Formatter.h"
 
-namespace zeek::json::detail {
-class NullDoubleWriter;
-}
-
 namespace zeek::threading::formatter {
 
 /**
  * A thread-safe class for converting values into a JSON representation
  * and vice versa.
+ *
+ * Output is produced directly, without going through a general-purpose
+ * JSON library, and is identical to what rapidjson's writer produces. An
+ * instance keeps scratch state across calls, so like all formatters it must
+ * only be used by the thread it belongs to.
  */
 class JSON : public Formatter {
 public:
@@ -34,10 +36,22 @@ public:
                       TypeTag subtype = TYPE_ERROR) const override;
 
 private:
-    void BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+    // Appends the JSON representation of a value to the buffer.
+    void BuildJSON(std::string& out, Value* val) const;
+
+    // Updates the cached keys if the fields have changed.
+    void UpdateKeys(int num_fields, const Field* const* fields) const;
 
     TimeFormat timestamps;
     bool include_unset_fields;
+
+    // Reused across calls to avoid allocating for each record.
+    mutable std::string buffer;
+
+    // The fields the keys were built for, and for each of them the escaped,
+    // quoted name preceded by a comma and followed by a colon.
+    mutable std::vector<const Field*> key_fields;
+    mutable std::vector<std::string> keys;
 };
 
 } // namespace zeek::threading::formatter
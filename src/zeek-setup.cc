@@ -381,6 +381,10 @@ static void terminate_zeek() {
     event_mgr.Drain();
 
     session_mgr->Clear();
+
+    if ( rule_matcher )
+        rule_matcher->SaveDFACache();
+
     plugin_mgr->FinishPlugins();
 
     finish_script_execution();
@@ -890,6 +894,8 @@ SetupResult setup(int argc, char** argv, Options* zopts) {
         if ( options.print_signature_debug_info )
             rule_matcher->PrintDebug();
 
+        rule_matcher->LoadDFACache(id::find_val("signature_dfa_cache")->AsStringVal()->ToStdString());
+
         file_mgr->InitMagic();
     }
 